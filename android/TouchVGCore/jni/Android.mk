@@ -34,7 +34,11 @@ geom_files := $(core_src)/geom/mgbase.cpp \
               $(core_src)/geom/mgmat.cpp \
               $(core_src)/geom/mgnear.cpp \
               $(core_src)/geom/mgnearbz.cpp \
+              $(core_src)/geom/mgsegcache.cpp \
+              $(core_src)/geom/mgpathbool.cpp \
+              $(core_src)/geom/mgcurvefit.cpp \
               $(core_src)/geom/fitcurves.cpp \
+              $(core_src)/geom/fitcurvesf.cpp \
               $(core_src)/geom/mgvec.cpp \
               $(core_src)/geom/mgpnt.cpp \
               $(core_src)/geom/mgpath.cpp \
@@ -65,6 +69,7 @@ shape_files := $(core_src)/shape/mgcomposite.cpp \
               $(core_src)/shape/mgimagesp.cpp \
               $(core_src)/shape/mgshape.cpp \
               $(core_src)/shape/mgshapes.cpp \
+              $(core_src)/shape/mgshapequery.cpp \
               $(core_src)/shape/mgbasicspreg.cpp
 
 doc_files  := $(core_src)/shapedoc/mgshapedoc.cpp \
@@ -72,6 +77,7 @@ doc_files  := $(core_src)/shapedoc/mgshapedoc.cpp \
               $(core_src)/shapedoc/spfactoryimpl.cpp
 
 test_files := $(core_src)/test/testcanvas.cpp \
+              $(core_src)/test/testfitcurves.cpp \
               $(core_src)/test/RandomShape.cpp
 
 base_files := $(core_src)/cmdbase/mgcmddraw.cpp \
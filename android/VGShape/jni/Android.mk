@@ -18,7 +18,11 @@ geom_files := $(core_src)/geom/mgbase.cpp \
               $(core_src)/geom/mgmat.cpp \
               $(core_src)/geom/mgnear.cpp \
               $(core_src)/geom/mgnearbz.cpp \
+              $(core_src)/geom/mgsegcache.cpp \
+              $(core_src)/geom/mgpathbool.cpp \
+              $(core_src)/geom/mgcurvefit.cpp \
               $(core_src)/geom/fitcurves.cpp \
+              $(core_src)/geom/fitcurvesf.cpp \
               $(core_src)/geom/mgvec.cpp \
               $(core_src)/geom/mgpnt.cpp \
               $(core_src)/geom/mgpath.cpp \
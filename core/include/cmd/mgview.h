@@ -81,6 +81,8 @@ struct MgView
     virtual void shapeAdded(MgShape* shape) = 0;                //!< 通知已添加图形，由视图重新构建显示
     virtual bool shapeWillDeleted(const MgShape* shape) = 0;    //!< 通知将删除图形
     virtual int removeShape(const MgShape* shape) = 0;          //!< 删除图形
+    virtual void beginShapesBatch() {}                          //!< 开始批量增删改图形，期间不逐个通知观察者
+    virtual int endShapesBatch() { return 0; }                  //!< 结束批量增删改图形并汇总通知一次，再由调用者 regenAll
     virtual bool shapeCanRotated(const MgShape* shape) = 0;     //!< 通知是否能旋转图形
     virtual bool shapeCanTransform(const MgShape* shape) = 0;   //!< 通知是否能对图形变形
     virtual bool shapeCanUnlock(const MgShape* shape) = 0;      //!< 通知是否能对图形解锁
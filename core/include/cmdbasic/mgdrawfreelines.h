@@ -8,7 +8,8 @@
 #include "mgcmddraw.h"
 
 //! 自由折线绘图命令类
-/*! \ingroup CORE_COMMAND
+/*! 视图选项 compactStrokes 为 true 时，每笔在加入图形列表前转为紧凑存储(MgBaseLines::compact)
+    \ingroup CORE_COMMAND
     \see MgLines
 */
 class MgCmdDrawFreeLines : public MgCommandDraw
@@ -6,9 +6,11 @@
 #define TOUCHVG_CMD_DRAW_SPLINES_H_
 
 #include "mgcmddraw.h"
+#include "mgcurvefit.h"
 
 //! 样条曲线绘图命令类
-/*! \ingroup CORE_COMMAND
+/*! 徒手绘制时，视图选项 compactStrokes 为 true 则每笔在加入图形列表前转为紧凑存储
+    \ingroup CORE_COMMAND
     \see MgSplines
 */
 class MgCmdDrawSplines : public MgCommandDraw
@@ -35,8 +37,11 @@ private:
     
 private:
     bool canAddPoint(const MgMotion* sender, bool ended);
+    bool smoothFitted(const MgMotion* sender);
     
-    bool    m_freehand;
+    bool            m_freehand;
+    bool            m_fitting;      // 手绘时是否边画边拟合
+    MgCurveFitter   m_fitter;       // 手绘点的增量拟合器，使用显示坐标
 };
 
 //! 用点击绘制样条曲线的命令类
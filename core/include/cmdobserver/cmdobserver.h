@@ -67,6 +67,8 @@ struct CmdObserver {
     //! 添加不捕捉的图形, sp为NULL时添加不在静态图形中显示的图形的ID
     virtual void onGatherSnapIgnoredID(const MgMotion* sender, const MgShape* sp,
                                        int* ids, int& i, int n) = 0;
+    //! 批量增删改图形后的汇总通知，批量中不发出逐个图形的增删改通知，ids依次为新增、修改和删除的图形ID
+    virtual void onShapesBatchChanged(const MgMotion*, int, int, int, const int*) {}
 #endif
 
     virtual void onSelectionChanged(const MgMotion* sender) = 0;               //!< 选择集改变的通知
@@ -130,6 +132,8 @@ public:
                                     int handleIndex, int snapid, int snapHandle,
                                     int count, const int* ids) {}
     virtual void onGatherSnapIgnoredID(const MgMotion* sender, const MgShape* sp, int* ids, int& i, int n) {}
+    virtual void onShapesBatchChanged(const MgMotion* sender, int added, int changed,
+                                      int deleted, const int* ids) {}
 #endif
     virtual bool onPreGesture(MgMotion* sender) { return true; }
     virtual void onPostGesture(const MgMotion* sender) {}
@@ -85,6 +85,13 @@ static void bezier4P(const Point2d& pt1, const Point2d& pt2, const Point2d& pt3,
 static int fitCurve(int knotCount, Point2d* knots, Vector2d* knotvs,
                     int count, const Point2d* pts, float tol);
 
+//! 对数据点光滑拟合为三次贝塞尔曲线，单精度并行计算的快速版本
+/*! 参数和结果格式同 fitCurve，数据点一次性转为单精度数组，按每4点一组(SSE/NEON)计算参数和误差。
+    \see fitCurve
+*/
+static int fitCurveFast(int knotCount, Point2d* knots, Vector2d* knotvs,
+                        int count, const Point2d* pts, float tol);
+
 #ifndef SWIG
 typedef Point2d (*PtCallback)(void* data, int i);
 static int fitCurve2(int knotCount, Point2d* knots, int count, PtCallback pts, void* data, float tol);
@@ -92,6 +99,7 @@ static int fitCurve2(int knotCount, Point2d* knots, int count, PtCallback pts, v
 typedef void (*FitCubicCallback)(void* data, const Point2d curve[4]);
 static void fitCurve3(FitCubicCallback fc, void* data, const Point2d *pts, int n, float tol);
 static void fitCurve4(FitCubicCallback fc, void* data, PtCallback pts, void* data2, int n, float tol);
+static void fitCurve3Fast(FitCubicCallback fc, void* data, const Point2d *pts, int n, float tol);
 #endif
 
 //! 二次贝塞尔曲线段转为三次贝塞尔曲线段
@@ -232,13 +240,32 @@ static int crossLineCircle(Point2d& pt1, Point2d& pt2,
 */
 static bool triEquations(int n, float *a, float *b, float *c, Vector2d *vs);
 
+//! 求解循环三对角线方程组
+/*! 循环三对角线方程组如下所示，在 triEquations 基础上多了两个角元素: \n
+    　　　| b0　　　c0　　　　　　　a[n-1] | \n
+    A　=　| a0　　　b1　　　c1　　　　　　| \n
+    　　　|　　..　　　..　　.. 　　　　　| \n
+    　　　| c[n-1]　　　a[n-2]　　b[n-1] | \n
+    A * (x,y) = (rx,ry) \n
+    用 Sherman-Morrison 公式化为两个三对角线方程组求解，计算量为O(n)
+
+    \param[in] n 方程组阶数，最小为3
+    \param[in] a 系数矩阵中的左对角线元素数组，a[0..n-2]，a[n-1]为右上角元素
+    \param[in,out] b 系数矩阵中的中对角线元素数组，b[0..n-1]，会被修改
+    \param[in] c 系数矩阵中的右对角线元素数组，c[0..n-2]，c[n-1]为左下角元素
+    \param[in,out] vs 输入方程组等号右边的已知n个矢量，输出求解出的未知矢量
+    \return 是否求解成功，失败原因可能是参数错误或因系数矩阵非主角占优而出现除零
+    \see triEquations
+*/
+static bool cyclicTriEquations(int n, float *a, float *b, float *c, Vector2d *vs);
+
 //! Gauss-Jordan法求解线性方程组
 /*!
     \param[in] n 方程组阶数，最小为2
     \param[in,out] mat 系数矩阵，n维方阵，会被修改
     \param[in,out] vs 输入方程组等号右边的已知n个矢量，输出求解出的未知矢量
     \return 是否求解成功，失败原因可能是参数错误或因系数矩阵非主角占优而出现除零
-    \see triEquations
+    \see triEquations, cyclicTriEquations
 */
 static bool gaussJordan(int n, float *mat, Vector2d *vs);
 #endif
@@ -0,0 +1,66 @@
+﻿//! \file mgcurvefit.h
+//! \brief 定义手绘线的增量曲线拟合类 MgCurveFitter
+// Copyright (c) 2004-2015, https://github.com/rhcad/vgcore, BSD License
+
+#ifndef TOUCHVG_CURVE_FITTER_H_
+#define TOUCHVG_CURVE_FITTER_H_
+
+#include "mgpnt.h"
+#include <vector>
+
+//! 手绘线的增量曲线拟合类
+/*! 在手势过程中逐点添加数据点，已拟合好的前部曲线段固定不变，只重新拟合末尾未定的部分，
+    拟合结果与 mgcurv::fitCurve 的格式相同。末尾部分的点数不超过 maxTail，每点的计算量有上限。\n
+    末尾重新拟合出多段时固定除最后一段外的各段，新的末尾从最后一段的起点开始，并保持切向连续。
+    \ingroup GEOMAPI
+    \see mgcurv::fitCurve
+*/
+class MgCurveFitter
+{
+public:
+    MgCurveFitter();
+    
+    //! 清除所有数据点和曲线段，tol 同 mgcurv::fitCurve，maxTail 为末尾部分的最多点数
+    void reset(float tol, int maxTail = 64);
+    
+    //! 添加一个数据点并重新拟合末尾部分，返回曲线是否改变
+    bool addPoint(const Point2d& pt);
+    
+    //! 去掉最后添加的数据点，已固定的曲线段不变，返回是否去掉了
+    bool removeLastPoint();
+    
+    //! 结束拟合，固定所有曲线段
+    void finish();
+    
+    //! 返回已固定的曲线段数
+    int getFrozenCount() const { return (int)_frozen.size() / 4; }
+    
+    //! 返回总的曲线段数，包括末尾待定的曲线段
+    int getSegmentCount() const { return (int)(_frozen.size() + _tail.size()) / 4; }
+    
+    //! 返回第 index 段贝塞尔曲线的4个控制点
+    const Point2d* getSegment(int index) const;
+    
+    //! 返回末尾部分的数据点数，包括起点
+    int getTailPointCount() const { return (int)_points.size(); }
+    
+    //! 得到曲线的顶点和切向矢量，格式同 mgcurv::fitCurve，返回顶点数
+    int getKnots(int knotCount, Point2d* knots, Vector2d* knotvs) const;
+    
+    //! 返回 getKnots 需要的最多顶点数
+    int getMaxKnotCount() const { return getSegmentCount() * 2; }
+    
+private:
+    void fitTail();
+    void freeze(int count);
+    static void appendCurve(void* data, const Point2d curve[4]);
+    
+    std::vector<Point2d>    _points;    // 末尾部分的数据点，首点为已固定曲线的终点
+    std::vector<Point2d>    _frozen;    // 已固定的曲线段，每段4点
+    std::vector<Point2d>    _tail;      // 末尾待定的曲线段，每段4点
+    Vector2d                _tangent;   // 末尾部分起点的单位切向，零矢量表示自由
+    float                   _tol;
+    int                     _maxTail;
+};
+
+#endif // TOUCHVG_CURVE_FITTER_H_
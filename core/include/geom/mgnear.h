@@ -7,6 +7,17 @@
 
 #include "mgbox.h"
 
+//! 三次贝塞尔曲线段的幂基系数，用于快速求最近点
+/*! Q(t) = ((a t + b) t + c) t + p0，k1~k5 为 (Q(t)-P)·Q'(t) 中与给定点P无关的系数。\n
+    由 mgnear::bezierCoeffs 生成，只与曲线段有关，可随图形按段缓存。
+    \ingroup GEOMAPI
+*/
+struct MgBezierCoeffs {
+    Point2d     p0;             //!< 起点
+    Vector2d    a, b, c;        //!< 三次、二次、一次项系数
+    float       k5, k4, k3, k2, k1;
+};
+
 //! 求曲线上最近点的函数
 /*! \ingroup GEOMAPI
 */
@@ -21,6 +32,20 @@ struct mgnear {
 */
 static float nearestOnBezier(const Point2d& pt, const Point2d* pts, Point2d& nearpt);
 
+#ifndef SWIG
+//! 计算三次贝塞尔曲线段的幂基系数，用于 nearestOnBezier
+static void bezierCoeffs(const Point2d* pts, MgBezierCoeffs& coeffs);
+
+//! 用预计算的系数求一点到三次贝塞尔曲线段上的最近点，结果同 nearestOnBezier
+/*! 在[0,1]内取样找出距离取极小值的区间，再用带区间保护的牛顿迭代求五次方程的根。
+    \param[in] pt 曲线段外给定的点
+    \param[in] coeffs 由 bezierCoeffs 计算的系数
+    \param[out] nearpt 曲线段上的最近点
+    \return 给定的点到最近点的距离
+*/
+static float nearestOnBezier(const Point2d& pt, const MgBezierCoeffs& coeffs, Point2d& nearpt);
+#endif
+
 //! 计算贝塞尔曲线段的绑定框
 static Box2d bezierBox1(const Point2d points[4]);
 
@@ -6,10 +6,24 @@
 #define TOUCHVG_PATH_H_
 
 #include "mgpnt.h"
+#ifndef SWIG
+#include <vector>
+#endif
 
 struct MgPathImpl;
 class Box2d;
 
+#ifndef SWIG
+//! 两个路径的交点，见 MgPath::crossWithPath
+struct MgPathCrossPoint {
+    Point2d pt;         //!< 交点坐标
+    int     segment1;   //!< 交点所在本路径段的起点序号，同 MgSegmentCallback 的 startIndex
+    int     segment2;   //!< 交点所在另一路径段的起点序号
+    float   t1;         //!< 交点在本路径段上的参数，0到1
+    float   t2;         //!< 交点在另一路径段上的参数，0到1
+};
+#endif
+
 //! 矢量路径节点类型
 /*! \see MgPath
 */
@@ -51,6 +65,9 @@ public:
 
     //! 赋值函数
     MgPath& copy(const MgPath& src);
+#ifndef SWIG
+    MgPath& operator=(const MgPath& src) { return copy(src); }
+#endif
     
     //! 追加路径
     MgPath& append(const MgPath& src);
@@ -103,7 +120,27 @@ public:
     bool isClosed() const;
     
     //! 返回路径长度
+    /*! 有 cacheLengths() 建立的弧长表时直接取总长，否则逐段累加
+    */
     float getLength() const;
+    
+    //! 建立弧长表(各段累计长度和曲线段的参数-弧长采样)，供多次弧长查询，修改路径后自动清除
+    /*! const 查询函数不建立弧长表，不修改路径，可在多个线程中同时调用。
+        没有弧长表时各查询逐段计算长度，只对所在的曲线段采样，只查询一两次时不必建立
+    */
+    void cacheLengths();
+    
+    //! 求路径上从起点沿路径给定弧长处的点，在弧长表中二分查找
+    /*!
+        \param dist 从起点沿路径的弧长，超出范围时取起点或终点
+        \param pt 输出路径上的点
+        \param tangent 不为NULL时输出该点的单位切矢量
+        \return 路径没有段时返回false
+    */
+    bool getPointAtLength(float dist, Point2d& pt, Vector2d* tangent = (Vector2d*)0) const;
+    
+    //! 沿路径按等弧长取 count 个点，包含起点和终点，返回点数
+    int getEvenPoints(int count, Point2d* pts) const;
 
 #ifndef SWIG
     //! 返回节点坐标数组
@@ -239,6 +276,19 @@ public:
     
     //! 求两个路径的交点
     bool crossWithPath(const MgPath& path, const Box2d& box, Point2d& ptCross) const;
+    
+#ifndef SWIG
+    //! 求两个路径的所有交点，按本路径的段序号和参数排序
+    /*! 支持多个子路径、折线和曲线段的任意组合。先按段的包络框扫描排除不相交的段对，
+        直线段间直接求交，含曲线段的则递归细分到平直后求交。重合的平行段不计交点。
+        \param path 另一路径
+        \param points 输出交点数组，先清空
+        \param box 不为NULL时只求此框内的交点
+        \return 交点个数
+    */
+    int crossWithPath(const MgPath& path, std::vector<MgPathCrossPoint>& points,
+                      const Box2d* box = (const Box2d*)0) const;
+#endif
 
 private:
     MgPathImpl*   m_data;
@@ -0,0 +1,62 @@
+﻿//! \file mgpathbool.h
+//! \brief 定义路径的布尔运算类 MgPathBoolean
+// Copyright (c) 2004-2015, https://github.com/rhcad/vgcore, BSD License
+
+#ifndef TOUCHVG_PATH_BOOLEAN_H_
+#define TOUCHVG_PATH_BOOLEAN_H_
+
+#include "mgpath.h"
+
+//! 路径的布尔运算类型
+/*! \see MgPathBoolean
+*/
+typedef enum {
+    kMgPathUnion,           //!< 并集
+    kMgPathIntersect,       //!< 交集
+    kMgPathDifference,      //!< 差集，第一组减去第二组
+    kMgPathXor              //!< 异或，只属于其中一组的区域
+} MgPathBoolOp;
+
+//! 路径的布尔运算类
+/*! 各路径的每个子路径视为闭合区域，按非零环绕规则填充，曲线段按容差离散为折线。\n
+    先用分块点中缓存找出附近的边，在交点和落在边上的顶点处切分各边，
+    再在各小段两侧取点，按射线法求出在两组路径中的内外情况，保留运算结果在两侧不同的小段，
+    并使结果区域位于其左侧，最后将各小段首尾相连得到结果多边形。\n
+    重合的边、顶点在边上的情况按容差合并处理，可一次添加上千个路径批量运算。
+    \ingroup GEOMAPI
+*/
+class MgPathBoolean
+{
+public:
+    //! 给定曲线离散的容差，为0则按所有路径范围自动确定
+    MgPathBoolean(float tol = 0);
+    ~MgPathBoolean();
+    
+    //! 清除所有路径
+    void clear();
+    
+    //! 添加运算对象，group 为0表示第一组，为1表示第二组，每组内的路径先求并集
+    void addPath(const MgPath& path, int group = 0);
+    
+    //! 执行布尔运算，结果为多个闭合折线子路径，区域位于各边左侧，返回结果是否不为空
+    bool execute(MgPathBoolOp op, MgPath& result) const;
+    
+    //! 求两个路径的布尔运算结果
+    static bool combine(const MgPath& path1, const MgPath& path2, MgPathBoolOp op,
+                        MgPath& result, float tol = 0);
+    
+    //! 求路径填充区域的面积，重叠部分只计一次
+    static float getArea(const MgPath& path, float tol = 0);
+    
+    //! 求闭合折线子路径的有向面积之和，逆时针为正，用于 execute 的结果
+    static float getPolygonArea(const MgPath& path);
+    
+private:
+    MgPathBoolean(const MgPathBoolean&);
+    void operator=(const MgPathBoolean&);
+    
+    struct Impl;
+    Impl*   im;
+};
+
+#endif // TOUCHVG_PATH_BOOLEAN_H_
@@ -0,0 +1,94 @@
+﻿//! \file mgsegcache.h
+//! \brief 定义图形子段的分块点中缓存 MgSegmentCache
+// Copyright (c) 2004-2015, https://github.com/rhcad/vgcore, BSD License
+
+#ifndef TOUCHVG_SEGMENT_CACHE_H_
+#define TOUCHVG_SEGMENT_CACHE_H_
+
+#include "mgbox.h"
+#include <vector>
+
+//! 图形子段的分块点中缓存
+/*! 将折线边或贝塞尔曲线段按每块 kBlockSize 段分块，各段的控制点和绑定框以分量数组(SoA)存放，
+    并记录每块的绑定框。各块的绑定框再逐层两两合并为层次包围盒(BVH)，在首次查询时生成。\n
+    点中测试和框选时由层次包围盒找出附近的块，再对块内各段批量计算，
+    块内循环无分支，便于编译器自动向量化(NEON/SSE)。\n
+    图形的点数较多时在点中测试中按需生成本缓存，图形改变后须释放重建。
+    \ingroup GEOMAPI
+    \see mgnear::linesHit, mgnear::cubicSplinesHit, mgnear::quadSplinesHit
+*/
+class MgSegmentCache
+{
+public:
+    enum {
+        kBlockSize = 16,        //!< 每块的段数
+        kMinSegments = 32       //!< 建议使用缓存的最少段数
+    };
+    
+    MgSegmentCache();
+    ~MgSegmentCache();
+    
+    //! 清除所有段
+    void clear();
+    
+    //! 返回段数
+    int getSegmentCount() const;
+    
+    //! 返回 setLines 的顶点数，其他情况为0
+    int getVertexCount() const;
+    
+    //! 返回 setLines 等设置的是否闭合
+    bool isClosed() const;
+    
+    //! 设置为折线或多边形的各边，用于 linesHit
+    void setLines(int n, const Point2d* points, bool closed);
+    
+    //! 设置为三次样条曲线的各段，段号同 mgnear::cubicSplinesHit
+    void setCubicSplines(int n, const Point2d* knots, const Vector2d* knotvs,
+                         bool closed, bool hermite);
+    
+    //! 设置为二次样条曲线的各段，段号同 mgnear::quadSplinesHit
+    void setQuadSplines(int n, const Point2d* knots, bool closed);
+    
+    //! 添加一条线段，segment 为该段在图形中的段号
+    void addLine(const Point2d& pt1, const Point2d& pt2, int segment);
+    
+    //! 添加一段三次贝塞尔曲线(4个点)，segment 为该段在图形中的段号
+    void addBezier(const Point2d* pts, int segment);
+    
+    //! 返回第 index 段在图形中的段号
+    int getSegmentID(int index) const;
+    
+    //! 得到第 index 段的控制点，线段为(起点,起点,终点,终点)
+    void getSegment(int index, Point2d pts[4]) const;
+    
+    //! 查找绑定框与给定矩形框相交的段，按段的序号升序输出，返回个数
+    int findSegments(const Box2d& rect, std::vector<int>& indices) const;
+    
+    //! 判断是否有段的绑定框与给定矩形框相交，同 mgnear::beziersIntersectBox
+    bool intersectBox(const Box2d& rect) const;
+    
+    //! 计算点到各段的最近距离，结果同 mgnear::cubicSplinesHit
+    /*!
+        \param[in] pt 图形外给定的点
+        \param[in] tol 距离公差，正数，只计算绑定框与点的公差框相交的段
+        \param[out] nearpt 图形上的最近点
+        \param[out] segment 最近点所在段的段号，负数表示失败
+        \return 给定的点到最近点的距离，失败时为极大数
+    */
+    float curvesHit(const Point2d& pt, float tol, Point2d& nearpt, int& segment) const;
+    
+    //! 计算点到折线或多边形的最近距离，须先调用 setLines，参数和结果同 mgnear::linesHit
+    float linesHit(const Point2d& pt, float tol, Point2d& nearpt, int& segment,
+                   bool* inside = (bool*)0, int* hitType = (int*)0,
+                   int flags = -1, int ignoreVertex = -1) const;
+    
+private:
+    MgSegmentCache(const MgSegmentCache&);
+    void operator=(const MgSegmentCache&);
+    
+    struct Impl;
+    Impl*   im;
+};
+
+#endif // TOUCHVG_SEGMENT_CACHE_H_
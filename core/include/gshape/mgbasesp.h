@@ -13,6 +13,7 @@
 #include "mglnrel.h"
 #include "mgnear.h"
 #include "mgcurv.h"
+#include "mgsegcache.h"
 
 struct MgStorage;
 struct MgShapeFactory;
@@ -233,6 +234,11 @@ public:
     //! 计算点到折线或多边形的最近距离
     static float linesHit(int n, const Point2d* points, bool closed,
                           const Point2d& pt, float tol, MgHitResult& res);
+#ifndef SWIG
+    //! 用分块缓存计算点到折线或多边形的最近距离，缓存须由 MgSegmentCache::setLines 生成
+    static float linesHit(const MgSegmentCache& cache,
+                          const Point2d& pt, float tol, MgHitResult& res);
+#endif
     
 protected:
     Box2d   _extent;
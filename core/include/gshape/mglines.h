@@ -8,6 +8,40 @@
 
 #include "mgbasesp.h"
 
+#ifndef SWIG
+//! 紧凑存储的坐标数组，见 MgBaseLines::compact
+/*! 各坐标按量化步长取整后，依次存为与前一点的整数差值，差值数据紧随本结构之后，
+    再每隔 kKeyStep 个点存一个相对于首点的32位量化坐标，供随机读取时从最近处开始累加
+ */
+struct MgPackedPoints {
+    static const int kKeyStep = 64;     //!< 关键点的间隔点数
+    
+    float   x0, y0;     //!< 首点坐标
+    float   step;       //!< 量化步长
+    int     count;      //!< 点数
+    int     bytes;      //!< 每个差值分量的字节数，为1、2或4
+    
+    //! 量化坐标数组，count 个点的 x,y 交替存放，超出32位整数范围时返回NULL
+    static MgPackedPoints* pack(int count, const float* xy, float step);
+    //! 复制出新的对象
+    MgPackedPoints* clone() const;
+    //! 解码到 count 个点的坐标数组
+    void unpack(float* xy) const;
+    //! 解码第 index 个点的坐标，从前面最近的关键点起累加差值，最多累加 kKeyStep-1 个
+    void unpackAt(int index, float* xy) const;
+    //! 返回占用的字节数
+    int memorySize() const { return (int)sizeof(MgPackedPoints) + deltaSize() + keyCount() * 2 * 4; }
+    //! 返回差值数据的字节数，按4字节对齐
+    int deltaSize() const { return (count * 2 * bytes + 3) / 4 * 4; }
+    //! 返回关键点数
+    int keyCount() const { return (count + kKeyStep - 1) / kKeyStep; }
+    //! 返回关键点的量化坐标，x,y 交替存放
+    const int* keys() const { return (const int*)((const char*)(this + 1) + deltaSize()); }
+    //! 释放对象并置为NULL
+    static void release(MgPackedPoints*& p);
+};
+#endif
+
 //! 折线基类
 /*! \ingroup CORE_SHAPE
  */
@@ -24,9 +58,15 @@ public:
     //! 返回终点
     Point2d endPoint() const;
     
-    //! 改变顶点数
+    //! 改变顶点数，容量不足时按1.5倍几何增长
     virtual bool resize(int count);
     
+    //! 预留至少能容纳 count 个顶点的容量，不改变顶点数，用于已知点数的命令
+    bool reserve(int count);
+    
+    //! 释放多余的容量，例如在绘图命令结束一笔时
+    void shrinkToFit();
+    
     //! 添加一个顶点
     virtual bool addPoint(const Point2d& pt);
     
@@ -41,10 +81,28 @@ public:
     
     //! 增量路径比较
     bool isIncrementFrom(const MgBaseLines& src) const;
+    
+    //! 转为紧凑存储，返回是否为紧凑存储
+    /*! 顶点按量化步长取整后，依次存为与前一点的8位、16位或32位整数差值(取能容纳的最小位数)，
+        节省内存时才转换，并释放浮点数组。之后用 MgLinesReader 读取各点，
+        其他 const 函数也只解码到局部缓冲，不修改图形，多个线程可同时读取。
+        getPoints() 则与 getSegmentCache() 一样按需解码到图形缓存的数组，修改顶点或恢复浮点存储时释放。
+        修改顶点时自动恢复为浮点存储，复制图形时直接复制紧凑数据。
+        本函数修改图形，应在图形由当前线程独占时(例如加入图形列表前)调用，见 MgCmdDrawFreeLines。
+        \param tol 量化步长(模型单位)，为0时取 minTol().equalPoint()，坐标误差不超过其一半
+     */
+    bool compact(float tol = 0);
+    
+    //! 返回是否为紧凑存储
+    bool isCompact() const { return !!_packed; }
 
 #ifndef SWIG
     virtual int getSubType() const { return isClosed() ? 1 : 0; }
-    virtual const Point2d* getPoints() const { return _points; }
+    //! 返回顶点数组，紧凑存储时按需解码并缓存，见 MgLinesReader
+    virtual const Point2d* getPoints() const { return _packed ? unpackedPoints() : _points; }
+    
+    //! 返回各边的分块缓存，按需生成，点数较少时为空
+    const MgSegmentCache* getSegmentCache() const;
 #endif
     
 protected:
@@ -60,16 +118,60 @@ protected:
     void _update();
     void _transform(const Matrix2d& mat);
     void _clear();
+    void _clearCachedData();
     float _hitTest(const Point2d& pt, float tol, MgHitResult& res) const;
     bool _hitTestBox(const Box2d& rect) const;
     bool _save(MgStorage* s) const;
     bool _load(MgShapeFactory* factory, MgStorage* s);
     
+    //! 恢复为浮点存储，修改 _points 前调用
+    void unpack() { if (_packed) unpackPoints(); }
+    //! 返回顶点数组，紧凑存储时解码到新分配的 buf 中，由调用者释放
+    const Point2d* readPoints(Point2d*& buf) const;
+    //! 返回切矢量数组，紧凑存储时解码到新分配的 buf 中，由调用者释放
+    virtual const Vector2d* readVectors(Vector2d*&) const { return (const Vector2d*)0; }
+    
+    virtual bool packPoints(float tol);         // 生成紧凑数据，成功时释放浮点数组
+    virtual void unpackPoints();                // 由紧凑数据恢复浮点数组，释放紧凑数据
+    virtual void freePacked();                  // 释放紧凑数据
+    void setCapacity(int count);                // 重新分配 count 个点的数组，保留已有的点
+    const Point2d* unpackedPoints() const;      // 紧凑存储时按需解码到 _unpacked
+    friend class MgLinesReader;
+    
 protected:
-    Point2d*    _points;
+    Point2d* _points;               // 紧凑存储时为NULL
     int      _maxCount;
     int      _count;
+    mutable MgSegmentCache* _cache;     // 各边的分块缓存，改变点后释放
+    MgPackedPoints*     _packed;    // 紧凑存储的顶点
+    mutable Point2d*    _unpacked;  // 紧凑存储时 getPoints() 按需解码的顶点
+};
+
+#ifndef SWIG
+//! 只读访问折线顶点，紧凑存储时解码到本对象的缓冲，析构时释放
+/*! 不修改图形，多个线程可同时读取同一图形，见 MgBaseLines::compact
+ */
+class MgLinesReader
+{
+public:
+    explicit MgLinesReader(const MgBaseLines& sp);
+    ~MgLinesReader();
+    
+    //! 返回各顶点
+    const Point2d* points() const { return _pts; }
+    //! 返回样条曲线的切矢量，没有切矢量时为NULL
+    const Vector2d* vectors() const { return _vecs; }
+    
+private:
+    const Point2d*  _pts;
+    const Vector2d* _vecs;
+    Point2d*        _buf;
+    Vector2d*       _vbuf;
+    
+    MgLinesReader(const MgLinesReader&);
+    void operator=(const MgLinesReader&);
 };
+#endif
 
 //! 折线图形类
 /*! \ingroup CORE_SHAPE
@@ -7,6 +7,7 @@
 #define TOUCHVG_PATH_SHAPE_H_
 
 #include "mgbasesp.h"
+#include "mgpathbool.h"
 
 //! 路径图形类
 /*! \ingroup CORE_SHAPE
@@ -26,19 +27,44 @@ public:
     int exportSVGPath(char* buf, int size) const;
     static int exportSVGPath(const MgPath& path, char* buf, int size);
     
+    //! 与另一路径进行布尔运算，结果替换本图形的路径
+    /*! 曲线段按容差展开为折线，结果为多边形路径
+        \param path 另一路径，各子路径视为闭合
+        \param op 布尔运算类型
+        \param tol 曲线展开容差，为0时按图形大小自动确定
+        \return 运算结果是否非空
+    */
+    bool combineWith(const MgPath& path, MgPathBoolOp op, float tol = 0);
+    
+    //! 返回路径所围区域的面积，自相交和重叠部分只计一次
+    float getArea(float tol = 0) const;
+    
+    //! 返回路径长度，已建立弧长表时直接取总长
+    float getLength() const { return _path.getLength(); }
+    
+    //! 求路径上从起点沿路径给定弧长处的点，首次查询时建立路径的弧长表
+    bool getPointAtLength(float dist, Point2d& pt, Vector2d* tangent = (Vector2d*)0) const;
+    
 #ifndef SWIG
     virtual bool isCurve() const;
 #endif
 
 protected:
     bool _isClosed() const;
+    void _clearCachedData();
     bool _hitTestBox(const Box2d& rect) const;
     void _output(MgPath& path) const { path.append(_path); }
     bool _save(MgStorage* s) const;
     bool _load(MgShapeFactory* factory, MgStorage* s);
     
+private:
+    void buildCache() const;
+    float hitTestByCache(const Point2d& pt, float tol, MgHitResult& res) const;
+    
 private:
     MgPath _path;
+    mutable MgSegmentCache* _cache;     // 各段的点中测试缓存
+    mutable MgSegmentCache* _edges;     // 各段端点构成的多边形，用于判断是否在内部
 };
 
 #endif // TOUCHVG_PATH_SHAPE_H_
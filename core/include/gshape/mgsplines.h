@@ -8,6 +8,8 @@
 
 #include "mglines.h"
 
+class MgCurveFitter;
+
 //! 二次样条曲线类
 /*! \ingroup CORE_SHAPE
  */
@@ -18,9 +20,13 @@ public:
     
     bool smooth(const Matrix2d& m2d, float tol);
     int smoothForPoints(int count, const Point2d* points, const Matrix2d& m2d, float tol);
+#ifndef SWIG
+    int smoothForFitter(const MgCurveFitter& fitter, const Matrix2d& d2m);
+#endif
     void clearVectors();
 #ifndef SWIG
-    const Vector2d* getVectors() const { return _knotvs; }
+    //! 返回切矢量数组，紧凑存储时按需解码并缓存，见 MgLinesReader
+    const Vector2d* getVectors() const { return _packedvs ? unpackedVectors() : _knotvs; }
     virtual bool isCurve() const { return true; }
     virtual bool resize(int count);
     virtual bool addPoint(const Point2d& pt);
@@ -33,6 +39,7 @@ protected:
     bool _equals(const MgSplines& src) const;
     void _transform(const Matrix2d& mat);
     void _clear();
+    void _clearCachedData();
     void _setPoint(int index, const Point2d& pt);
     bool _setHandlePoint(int index, const Point2d& pt, float tol);
     float _hitTest(const Point2d& pt, float tol, MgHitResult& res) const;
@@ -40,8 +47,17 @@ protected:
     void _output(MgPath& path) const;
     bool _save(MgStorage* s) const;
     bool _load(MgShapeFactory* factory, MgStorage* s);
+    const MgSegmentCache* getCurveCache() const;
+    virtual const Vector2d* readVectors(Vector2d*& buf) const;
+    virtual bool packPoints(float tol);
+    virtual void unpackPoints();
+    virtual void freePacked();
+    const Vector2d* unpackedVectors() const;    // 紧凑存储时按需解码到 _unpackedvs
     
-    Vector2d*   _knotvs;
+    Vector2d*           _knotvs;    // 紧凑存储时为NULL
+    mutable MgSegmentCache* _curves;    // 各曲线段的分块缓存，改变点后释放
+    MgPackedPoints*     _packedvs;  // 紧凑存储的切矢量
+    mutable Vector2d*   _unpackedvs;    // 紧凑存储时 getVectors() 按需解码的切矢量
 };
 
 #endif // TOUCHVG_SPLINES_SHAPE_H_
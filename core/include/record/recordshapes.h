@@ -12,6 +12,7 @@ class MgShapeDoc;
 class MgShapes;
 class MgShape;
 struct MgShapeFactory;
+struct MgStorage;
 
 //! Helper class for recording shapes.
 class MgRecordShapes
@@ -28,6 +29,7 @@ public:
                     MgShapes* dynShapes, const std::vector<MgShapes*>& extShapes);
     std::string getFileName(bool back, int index) const;
     std::string getPath() const;
+    std::string getJournalName() const;
 #endif
     bool isLoading() const;
     void setLoading(bool loading);
@@ -35,7 +37,19 @@ public:
     void restore(int index, int count, int tick, long curTick);
     void stopRecordIndex();
     
+    // Background writer: recordStep() only queues the snapshot and returns.
+    bool setAsync(bool async, int capacity = 16);
+    bool isAsync() const;
+    bool flush(int timeoutMs = -1);     // wait until all queued steps are written
+    int getQueueDepth() const;
+    int getMaxQueueDepth() const;
+    long getLastWriteLatency() const;   // milliseconds from recordStep to written
+    long getMaxWriteLatency() const;
+    long getWrittenCount() const;
+    
 #ifndef SWIG
+    void setUndoMemoryBudget(long bytes);   // keep recent steps as shared snapshots in memory
+    long getUndoMemoryBytes() const;
     bool canUndo() const;
     bool canRedo() const;
     bool undo(MgShapeFactory *factory, MgShapeDoc* doc, long* changeCount);
@@ -52,18 +66,39 @@ public:
     bool applyFirstFile(MgShapeFactory *factory, MgShapeDoc* doc, const char* filename);
     int applyRedoFile(MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns, int index);
     int applyUndoFile(MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns, int index, long curTick);
+    
+    // Prefetch: a worker thread decodes the following steps from a shallow copy of doc,
+    // then takePrefetched() hands over the frames whose tick is due, or only the next
+    // frame if maxTick < 0. Don't call applyRedoFile() while prefetching.
+    bool startPrefetch(MgShapeFactory *f, const MgShapeDoc* doc, int depth = 8);
+    void stopPrefetch();
+    bool isPrefetching() const;
+    int getPrefetchedCount() const;
+    int getPrefetchedTick() const;      // tick of the next ready frame, or -1
+#ifndef SWIG
+    int takePrefetched(int maxTick, MgShapeDoc** doc, MgShapes** dyns, int* tick = NULL);
+#endif
+    
+    // Checkpoints: the recorder saves the whole document after every 'frames'
+    // steps or 'bytes' of step records, so seek() only replays the steps after it.
+    void setCheckpointInterval(int frames, long bytes);
+    int seek(MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns, int index);
 #ifndef SWIG
     static bool loadFrameIndex(std::string path, std::vector<int>& arr);
 #endif
 
 private:
-    static int applyFile(int& tick, MgShapeFactory *f,
-                         MgShapeDoc* doc, MgShapes* dyns, const char* fn,
-                         long* changeCount = NULL, MgShape* lastShape = NULL);
+    bool saveStep(long tick, long changeCountOld, long changeCountNew, MgShapeDoc* doc,
+                  MgShapes* dynShapes, const std::vector<MgShapes*>& extShapes);
+    static int applyRecord(int& tick, MgShapeFactory *f,
+                           MgShapeDoc* doc, MgShapes* dyns, MgStorage* s,
+                           long* changeCount = NULL, const MgShapes* lastDyns = NULL);
     
 private:
     struct Impl;
     Impl* _im;
+    friend struct MgRecordWriter;
+    friend struct MgRecordPrefetcher;
 };
 
 #endif // TOUCHVG_RECORD_SHAPES_H_
@@ -0,0 +1,83 @@
+﻿//! \file mgshapequery.h
+//! \brief 定义图形批量几何查询类 MgShapeQuery
+// Copyright (c) 2004-2015, https://github.com/rhcad/vgcore, BSD License
+
+#ifndef TOUCHVG_SHAPE_QUERY_H_
+#define TOUCHVG_SHAPE_QUERY_H_
+
+#include "mgshapes.h"
+
+//! 图形批量几何查询类
+/*! 在线程池中并行计算多个图形的包络框、长度、面积和形心，并做框选相交测试，结果按图形顺序存为连续数组。\n
+    图形先在调用线程中收集，每个图形只由一个线程计算，计算期间不要在其他线程中修改这些图形。
+    工作线程只调用不修改图形的函数(包络框、输出到局部路径)；与矩形相交测试会建立图形的分块缓存，在调用线程中进行。
+    线程在首次并行查询时创建，可多次查询复用，本对象不能同时在多个线程中查询。
+    \ingroup CORE_SHAPE
+*/
+class MgShapeQuery
+{
+public:
+    //! 查询内容，可组合
+    enum {
+        kExtent     = 1,    //!< 包络框，见 getExtents
+        kLength     = 2,    //!< 路径长度，见 getLengths
+        kArea       = 4,    //!< 闭合子路径所围面积，见 getAreas
+        kCentroid   = 8,    //!< 形心，见 getCentroids
+        kHitBox     = 16,   //!< 与矩形相交测试，见 getHits
+        kAll        = 15    //!< 除 kHitBox 外的所有内容
+    };
+    
+    //! 给定线程数(含调用线程)构造，为0时取CPU核数，为1时只在调用线程中计算
+    MgShapeQuery(int threads = 0);
+    ~MgShapeQuery();
+    
+    //! 返回线程数，含调用线程
+    int getThreadCount() const;
+    
+    //! 查询图形列表中的图形，返回查询的图形个数
+    /*!
+        \param shapes 图形列表
+        \param flags 查询内容，由 kExtent 等值组合
+        \param filter 图形过滤函数，在调用线程中执行，为NULL则查询所有图形
+        \param data 传给过滤函数的参数
+        \param rect 含 kHitBox 时与各图形进行相交测试的模型坐标矩形
+    */
+    int query(const MgShapes* shapes, int flags, MgShapes::Filter filter = (MgShapes::Filter)0,
+              void* data = (void*)0, const Box2d* rect = (const Box2d*)0);
+    
+    //! 查询给定的图形数组，返回查询的图形个数
+    int query(int count, const MgShape* const* shapes, int flags, const Box2d* rect = (const Box2d*)0);
+    
+    //! 返回最近一次查询的图形个数
+    int getCount() const;
+    
+    //! 返回查询的图形
+    const MgShape* getShape(int index) const;
+    
+    //! 返回各图形的ID
+    const int* getIDs() const;
+    
+    //! 返回各图形的包络框，未查询此内容时返回NULL
+    const Box2d* getExtents() const;
+    
+    //! 返回各图形的路径长度，未查询此内容时返回NULL
+    const float* getLengths() const;
+    
+    //! 返回各图形闭合子路径所围面积(非负)，重叠部分重复计算，未闭合的图形为0
+    const float* getAreas() const;
+    
+    //! 返回各图形的形心，有面积时为区域形心，否则为路径按长度的重心
+    const Point2d* getCentroids() const;
+    
+    //! 返回各图形是否与矩形相交(非0表示相交)，未查询此内容时返回NULL
+    const char* getHits() const;
+    
+private:
+    MgShapeQuery(const MgShapeQuery&);
+    void operator=(const MgShapeQuery&);
+    
+    struct Impl;
+    Impl*   im;
+};
+
+#endif // TOUCHVG_SHAPE_QUERY_H_
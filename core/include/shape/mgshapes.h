@@ -6,6 +6,9 @@
 #define TOUCHVG_MGSHAPES_H_
 
 #include "mgshape.h"
+#ifndef SWIG
+#include <vector>
+#endif
 
 //! 图形列表类
 /*! \ingroup CORE_SHAPE
@@ -20,7 +23,7 @@ public:
     //! 复制出一个新图形列表对象
     MgShapes* cloneShapes() const { return (MgShapes*)clone(); }
     
-    //! 复制出一个新图形列表对象，并添加所有图形的引用
+    //! 复制出一个新图形列表对象，与原列表共享图形容器，任一方修改前才复制容器
     MgShapes* shallowCopy() const;
     
     //! 创建图形列表
@@ -80,6 +83,8 @@ public:
     bool addShapeDirect(MgShape* shape, bool force = true);
     
     //! 更新为新的图形，该图形从原来图形克隆得到. 原图形对象会被删除!
+    /*! shape 已是列表中的图形时只更新其包络框并返回true，批量修改期间也一样
+     */
     bool updateShape(MgShape* shape, bool force = true);
     
 #ifndef SWIG
@@ -105,6 +110,29 @@ public:
     
     //! 移除一个图形
     bool removeShape(int sid);
+    
+    //! 开始批量修改，可嵌套调用
+    /*! 批量修改期间移除和更新图形只修改ID索引，列表在结束批量或下次访问列表时一次性整理
+        \see endBatch
+     */
+    void beginBatch();
+    
+    //! 结束批量修改，最外层结束时返回批量期间增删改的图形数，否则返回0
+    int endBatch();
+    
+    //! 返回是否正在批量修改
+    bool isInBatch() const;
+    
+#ifndef SWIG
+    //! 得到改变记录的标识和序号，作为 getChangedIDs() 的记录点
+    void getChangeMark(long& lineage, long& seq) const;
+    
+    //! 得到记录点之后增删改的图形ID(按先后次序，可重复)，调整顺序记为0
+    /*! 浅拷贝的图形列表共享原列表在复制时的改变记录，可在其他线程中读取。
+        \return 记录点不属于本列表或改变记录已被截断时返回false，此时需要全部比较
+     */
+    bool getChangedIDs(long lineage, long seq, std::vector<int>& ids) const;
+#endif
 
     //! 将一个图形移到另一个图形列表
     bool moveShapeTo(int sid, MgShapes* dest);
@@ -48,6 +48,12 @@ public:
 
     //! 释放临时数据内存
     void clearCachedData();
+    
+    //! 对所有图层和当前图形列表开始批量修改，可嵌套调用
+    void beginBatch();
+    
+    //! 结束批量修改，最外层结束时返回增删改的图形数，否则返回0
+    int endBatch();
 
     //! 显示所有图形
     int draw(GiGraphics& gs) const;
@@ -0,0 +1,35 @@
+//! \file testfitcurves.h
+//! \brief Define the benchmark class of curve fitting: TestFitCurves.
+// Copyright (c) 2004-2015, https://github.com/rhcad/vgcore, BSD License
+
+#ifndef TOUCHVG_TESTFITCURVES_H
+#define TOUCHVG_TESTFITCURVES_H
+
+#include "mgpnt.h"
+
+//! The benchmark class comparing mgcurv::fitCurve3 and mgcurv::fitCurve3Fast.
+/*! \ingroup GEOMAPI
+ */
+struct TestFitCurves {
+    //! The result of one benchmark.
+    struct Result {
+        int     pointCount;     //!< number of digitized points
+        int     segCount;       //!< number of Bezier segments of fitCurve3
+        int     fastSegCount;   //!< number of Bezier segments of fitCurve3Fast
+        float   ms;             //!< milliseconds per fitCurve3 call
+        float   fastMs;         //!< milliseconds per fitCurve3Fast call
+        float   maxError;       //!< max distance from the points to the curves of fitCurve3
+        float   fastMaxError;   //!< max distance from the points to the curves of fitCurve3Fast
+    };
+    
+    //! Generate a freehand-like stroke with n points, about 1 unit between points.
+    static void makeStroke(int n, Point2d* pts, unsigned seed = 9999);
+    
+    //! Fit the same stroke with both implementations, tol is the squared tolerance as fitCurve.
+    static bool benchmark(int pointCount, int loops, float tol, Result& result);
+    
+    //! Max distance from the points to the Bezier segments (4 points each, skip invalid ones).
+    static float maxError(int count, const Point2d* pts, int segCount, const Point2d* segs);
+};
+
+#endif // TOUCHVG_TESTFITCURVES_H
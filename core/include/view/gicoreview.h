@@ -103,6 +103,7 @@ public:
     bool recordShapes(bool forUndo, long tick, long changeCount, long doc,
                       long shapes, const mgvector<long>* exts,
                       MgStringCallback* c = (MgStringCallback*)0);  //!< 录制图形，自动释放
+    bool flushRecord(bool forUndo, int timeoutMs = -1);             //!< 等待后台写完已提交的录制步骤
     bool undo(GiView* view);                                        //!< 撤销, 需要并发访问保护
     bool redo(GiView* view);                                        //!< 重做, 需要并发访问保护
     bool onPause(long curTick);                                     //!< 暂停
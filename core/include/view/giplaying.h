@@ -8,6 +8,7 @@
 struct MgCoreView;
 class MgShapeDoc;
 class MgShapes;
+class MgRecordShapes;
 
 //! 图形播放项
 /*!
@@ -37,6 +38,11 @@ public:
     MgShapes* getBackShapes(bool needClear);    //!< 得到修改图形用的动态图形列表
     void submitBackShapes();                    //!< 提交动态图形列表结果，需要并发保护
     
+    //! 提交播放器预取线程已解码好的到期帧，需要并发保护，返回 MgRecordShapes::DOC_CHANGED 等组合
+    /*! 播放器需已调用 startPrefetch()，各播放项的帧在各自的预取线程中并行解码
+     */
+    int submitPrefetched(MgRecordShapes* player, int tick);
+    
     void stop();                                //!< 标记需要停止
     bool isStopping() const;                    //!< 返回是否待停止
     
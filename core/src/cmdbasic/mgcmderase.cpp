@@ -6,9 +6,130 @@
 #include <functional>
 #include "mgaction.h"
 #include "mglocal.h"
+#include <map>
+
+//! 橡皮擦轨迹用的图形网格索引，按图形范围生成，之后只加入改变过的图形
+/*! 已删除的图形和改变前的范围仍留在网格中，查询后由调用者按现有图形过滤
+ */
+class MgEraseGrid
+{
+public:
+    MgEraseGrid(const MgShapes* shapes, float cellSize);
+    
+    //! 若图形列表自上次同步后的改变记录可用，就只加入改变过的图形，返回false表示需要重新生成
+    bool sync(const MgShapes* shapes, float cellSize);
+    
+    //! 得到范围与矩形所在网格相交的图形ID，已排序且无重复
+    void query(const Box2d& rect, std::vector<int>& ids) const;
+    
+private:
+    void add(const MgShape* shape);
+    
+private:
+    enum { kMaxCells = 64 };        // 图形占据的网格数超过此值就作为大图形单独存放
+    typedef std::pair<int, int> Cell;
+    typedef std::map<Cell, std::vector<int> > Cells;
+    
+    int cellIndex(float v) const { return (int)floorf(v / _cellSize); }
+    bool isLarge(const Box2d& rect) const {
+        return (rect.width() / _cellSize + 1) * (rect.height() / _cellSize + 1) > kMaxCells;
+    }
+    
+    Cells               _cells;
+    std::vector<int>    _large;
+    float               _cellSize;
+    long                _lineage;   // 已同步到的图形列表改变记录点
+    long                _seq;
+};
+
+MgEraseGrid::MgEraseGrid(const MgShapes* shapes, float cellSize) : _cellSize(cellSize)
+{
+    MgShapeIterator it(shapes);
+    
+    shapes->getChangeMark(_lineage, _seq);
+    while (const MgShape* shape = it.getNext()) {
+        add(shape);
+    }
+}
+
+void MgEraseGrid::add(const MgShape* shape)
+{
+    const Box2d rect(shape->shapec()->getExtent());
+    
+    if (isLarge(rect)) {
+        _large.push_back(shape->getID());
+        return;
+    }
+    const int x2 = cellIndex(rect.xmax), y2 = cellIndex(rect.ymax);
+    
+    for (int x = cellIndex(rect.xmin); x <= x2; x++) {
+        for (int y = cellIndex(rect.ymin); y <= y2; y++) {
+            _cells[Cell(x, y)].push_back(shape->getID());
+        }
+    }
+}
+
+bool MgEraseGrid::sync(const MgShapes* shapes, float cellSize)
+{
+    std::vector<int> ids;
+    
+    if (!mgEquals(cellSize, _cellSize) || !shapes->getChangedIDs(_lineage, _seq, ids)) {
+        return false;
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    for (std::vector<int>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+        const MgShape* shape = *it ? shapes->findShape(*it) : NULL;     // 调整顺序记为0
+        if (shape) {
+            add(shape);
+        }
+    }
+    shapes->getChangeMark(_lineage, _seq);
+    
+    return true;
+}
+
+void MgEraseGrid::query(const Box2d& rect, std::vector<int>& ids) const
+{
+    ids = _large;
+    
+    if (isLarge(rect)) {                // 快速划动时遍历已有网格
+        const Cell c1(cellIndex(rect.xmin), cellIndex(rect.ymin));
+        const Cell c2(cellIndex(rect.xmax), cellIndex(rect.ymax));
+        
+        for (Cells::const_iterator it = _cells.begin(); it != _cells.end(); ++it) {
+            if (it->first.first >= c1.first && it->first.first <= c2.first
+                && it->first.second >= c1.second && it->first.second <= c2.second) {
+                ids.insert(ids.end(), it->second.begin(), it->second.end());
+            }
+        }
+    } else {
+        const int x2 = cellIndex(rect.xmax), y2 = cellIndex(rect.ymax);
+        
+        for (int x = cellIndex(rect.xmin); x <= x2; x++) {
+            for (int y = cellIndex(rect.ymin); y <= y2; y++) {
+                Cells::const_iterator it = _cells.find(Cell(x, y));
+                if (it != _cells.end()) {
+                    ids.insert(ids.end(), it->second.begin(), it->second.end());
+                }
+            }
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+MgCmdErase::~MgCmdErase()
+{
+    delete m_grid;
+}
 
 bool MgCmdErase::cancel(const MgMotion* sender)
 {
+    if (m_stroke) {
+        m_delIds.clear();       // 放弃本次轨迹尚未提交的擦除
+    }
+    endStroke(sender);
     m_boxsel = false;
     bool ret = backStep(sender);
     ret = backStep(sender) || ret;
@@ -43,6 +164,10 @@ bool MgCmdErase::draw(const MgMotion* sender, GiGraphics* gs)
                           GiColor(0, 0, 255, 24));
         gs->drawRect(&ctxshap, Box2d(sender->startPtM, sender->pointM));
     }
+    if (m_stroke) {
+        GiContext ctxeraser(0, GiColor(0, 0, 255, 80), GiContext::kSolidLine, GiColor(0, 0, 255, 24));
+        gs->drawCircle(&ctxeraser, sender->pointM, getEraserRadius(sender));
+    }
     
     GiContext ctx(-4, GiColor(64, 64, 64, 128));
     
@@ -91,11 +216,153 @@ bool MgCmdErase::longPress(const MgMotion* sender)
 
 bool MgCmdErase::touchBegan(const MgMotion* sender)
 {
+    if (sender->view->getOptionBool("eraseStroke", false)) {
+        const float cellSize = 4 * getEraserRadius(sender);
+        
+        if (!m_grid || !m_grid->sync(sender->view->shapes(), cellSize)) {
+            delete m_grid;
+            m_grid = new MgEraseGrid(sender->view->shapes(), cellSize);
+        }
+        m_stroke = true;
+        m_delIds.clear();
+        return eraseAlongStroke(sender, sender->startPtM);
+    }
     m_boxsel = true;
     sender->view->redraw();
     return true;
 }
 
+float MgCmdErase::getEraserRadius(const MgMotion* sender)
+{
+    return sender->displayMmToModel("hitTestTol", 10.f) / 2;
+}
+
+// 两线段间的最短距离，相交时为0
+static float distanceOfLines(const Point2d& a, const Point2d& b, const Point2d& c, const Point2d& d)
+{
+    Point2d nearpt;
+    
+    if (mglnrel::cross2LineV(a, b, c, d))
+        return 0;
+    return mgMin(mgMin(mglnrel::ptToLine(a, b, c, nearpt), mglnrel::ptToLine(a, b, d, nearpt)),
+                 mgMin(mglnrel::ptToLine(c, d, a, nearpt), mglnrel::ptToLine(c, d, b, nearpt)));
+}
+
+//! 检查路径段是否与橡皮擦轨迹扫过的胶囊形区域(线段向两侧扩展半径)相交
+struct MgStrokeHitCallback : MgPath::MgSegmentCallback {
+    Point2d from, to;
+    float   r;
+    Box2d   box;        // 胶囊区域的范围
+    bool    hit;
+    
+    MgStrokeHitCallback(const Point2d& from, const Point2d& to, float r)
+        : from(from), to(to), r(r), box(from, to), hit(false) { box.inflate(r); }
+    
+    // 闭合路径在中止遍历后仍会处理闭合段，已击中时不再覆盖结果
+    virtual bool processLine(int, int&, const Point2d& startpt, const Point2d& endpt) {
+        hit = hit || distanceOfLines(startpt, endpt, from, to) <= r;
+        return !hit;
+    }
+    virtual bool processBezier(int, int&, const Point2d* pts) {
+        hit = hit || hitBezier(pts, 0);
+        return !hit;
+    }
+    
+    // 曲线在控制多边形内，远离胶囊区域的部分直接跳过，足够平直时用弦线代替
+    bool hitBezier(const Point2d* pts, int depth) const {
+        if (!Box2d(4, pts).isIntersect(box))
+            return false;
+        
+        Point2d nearpt, pts1[4], pts2[4];
+        const float dev = mgMax(mglnrel::ptToLine(pts[0], pts[3], pts[1], nearpt),
+                                mglnrel::ptToLine(pts[0], pts[3], pts[2], nearpt));
+        
+        if (dev < r * 0.1f || depth > 16)
+            return distanceOfLines(pts[0], pts[3], from, to) <= r + dev;
+        mgcurv::splitBezier(pts, 0.5f, pts1, pts2);
+        return hitBezier(pts1, depth + 1) || hitBezier(pts2, depth + 1);
+    }
+};
+
+// 按图形的路径段与轨迹线段的距离判断，快速划过时也不会漏掉图形
+static bool hitStroke(const MgBaseShape* shape, const Point2d& from, const Point2d& to, float r)
+{
+    MgPath path;
+    
+    shape->output(path);
+    if (path.getCount() == 0) {                         // 没有路径的图形只检查当前点
+        MgHitResult res;
+        return shape->hitTest(to, r, res) <= r;
+    }
+    
+    MgStrokeHitCallback c(from, to, r);
+    path.scanSegments(c);
+    return c.hit;
+}
+
+bool MgCmdErase::eraseAlongStroke(const MgMotion* sender, const Point2d& from)
+{
+    const float r = getEraserRadius(sender);
+    const MgShapes* s = sender->view->shapes();
+    Box2d rect(from, sender->pointM);
+    std::vector<int> ids;
+    
+    rect.inflate(r);
+    m_grid->query(rect, ids);
+    for (std::vector<int>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+        std::vector<int>::iterator pos = std::lower_bound(m_delIds.begin(), m_delIds.end(), *it);
+        if (pos != m_delIds.end() && *pos == *it)
+            continue;                                   // 本次轨迹已擦到
+        const MgShape* shape = s->findShape(*it);       // 网格中可能有已删除的图形
+        
+        if (shape && shape->shapec()->isVisible() && !shape->shapec()->isLocked()
+            && rect.isIntersect(shape->shapec()->getExtent())
+            && hitStroke(shape->shapec(), from, sender->pointM, r)) {
+            m_delIds.insert(pos, *it);                  // 保持有序，结束时一起删除
+        }
+    }
+    m_lastPt = sender->pointM;
+    sender->view->redraw();
+    
+    return true;
+}
+
+int MgCmdErase::removeShapes(const MgMotion* sender, const std::vector<int>& ids)
+{
+    const MgShapes* s = sender->view->shapes();
+    int count = 0;
+    
+    sender->view->beginShapesBatch();
+    for (std::vector<int>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+        const MgShape* shape = s->findShape(*it);
+        if (shape && sender->view->shapeWillDeleted(shape)) {
+            count += sender->view->removeShape(shape);
+        }
+    }
+    sender->view->endShapesBatch();
+    if (count > 0) {
+        sender->view->regenAll(true);   // 一批图形只提交一次
+    }
+    
+    return count;
+}
+
+// 一次轨迹擦到的图形在结束时一起删除，只提交一次，作为一个撤销步骤
+void MgCmdErase::endStroke(const MgMotion* sender)
+{
+    int count = m_stroke ? removeShapes(sender, m_delIds) : 0;
+    
+    if (count > 0) {
+        char buf[31];
+        MgLocalized::formatString(buf, sizeof(buf), sender->view, "@shape_n_deleted", count);
+        sender->view->showMessage(buf);
+    }
+    if (m_stroke) {
+        m_delIds.clear();
+    }
+    m_stroke = false;
+}
+
 bool MgCmdErase::isIntersectMode(const MgMotion*)
 {
     return true;
@@ -105,6 +372,10 @@ bool MgCmdErase::isIntersectMode(const MgMotion*)
 
 bool MgCmdErase::touchMoved(const MgMotion* sender)
 {
+    if (m_stroke) {
+        return eraseAlongStroke(sender, m_lastPt);
+    }
+    
     Box2d snap(sender->startPtM, sender->pointM);
     MgShapeIterator it(m_boxsel ? sender->view->shapes() : NULL);
     
@@ -123,6 +394,13 @@ bool MgCmdErase::touchMoved(const MgMotion* sender)
 
 bool MgCmdErase::touchEnded(const MgMotion* sender)
 {
+    if (m_stroke) {
+        eraseAlongStroke(sender, m_lastPt);
+        endStroke(sender);
+        sender->view->redraw();
+        return true;
+    }
+    
     MgShapes* s = sender->view->shapes();
     
     if (!m_delIds.empty()
@@ -130,9 +408,11 @@ bool MgCmdErase::touchEnded(const MgMotion* sender)
         int count = 0;
         std::vector<int>::iterator it = m_delIds.begin();
         
+        sender->view->beginShapesBatch();
         for (; it != m_delIds.end(); ++it) {
             count += sender->view->removeShape(s->findShape(*it));
         }
+        sender->view->endShapesBatch();
         if (count > 0) {
             sender->view->regenAll(true);
             char buf[31];
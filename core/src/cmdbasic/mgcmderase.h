@@ -8,8 +8,12 @@
 #include "mgcmd.h"
 #include <vector>
 
+class MgEraseGrid;
+
 //! 橡皮擦命令类
-/*! \ingroup CORE_COMMAND
+/*! 默认为框选擦除；视图选项 eraseStroke 为 true 时按手指划过的轨迹擦除图形，
+    划过的图形在抬起手指时一起删除，每次轨迹为一个撤销步骤。
+    \ingroup CORE_COMMAND
 */
 class MgCmdErase : public MgCommand
 {
@@ -18,7 +22,8 @@ public:
     static MgCommand* Create() { return new MgCmdErase; }
     
 private:
-    MgCmdErase() : MgCommand(Name()) {}
+    MgCmdErase() : MgCommand(Name()), m_grid(NULL), m_boxsel(false), m_stroke(false) {}
+    virtual ~MgCmdErase();
     virtual void release() { delete this; }
     virtual bool cancel(const MgMotion* sender);
     virtual bool initialize(const MgMotion* sender, MgStorage* s);
@@ -34,9 +39,16 @@ private:
     int getStep() { return 0; }
     const MgShape* hitTest(const MgMotion* sender);
     bool isIntersectMode(const MgMotion* sender);
+    float getEraserRadius(const MgMotion* sender);
+    bool eraseAlongStroke(const MgMotion* sender, const Point2d& from);
+    int removeShapes(const MgMotion* sender, const std::vector<int>& ids);
+    void endStroke(const MgMotion* sender);
     
-    std::vector<int>     m_delIds;
+    std::vector<int>        m_delIds;   // 待删除的图形，轨迹擦除时按ID排序
+    MgEraseGrid*            m_grid;     // 轨迹擦除用的图形网格索引，跨轨迹保留并增量同步
+    Point2d                 m_lastPt;   // 轨迹擦除的上一点
     bool                    m_boxsel;
+    bool                    m_stroke;   // 是否正在按轨迹擦除
 };
 
 #endif // TOUCHVG_CMD_ERASE_H_
@@ -26,6 +26,7 @@ bool MgCmdDrawFreeLines::draw(const MgMotion* sender, GiGraphics* gs)
 bool MgCmdDrawFreeLines::touchBegan(const MgMotion* sender)
 {
     ((MgBaseLines*)dynshape()->shape())->resize(2);
+    ((MgBaseLines*)dynshape()->shape())->reserve(512);    // 一笔通常的采样点数，避免拖动中重新分配
     m_step = 1;
     dynshape()->shape()->setPoint(0, sender->startPtM);
     dynshape()->shape()->setPoint(1, sender->pointM);
@@ -68,11 +69,15 @@ bool MgCmdDrawFreeLines::touchMoved(const MgMotion* sender)
 bool MgCmdDrawFreeLines::touchEnded(const MgMotion* sender)
 {
     if (m_step > 1) {
+        if (sender->view->getOptionBool("compactStrokes", false)) {
+            ((MgBaseLines*)dynshape()->shape())->compact();    // 尚未共享，由本线程独占
+        }
         addShape(sender);
     } else {
         click(sender);  // add a point
     }
     m_step = 0;
+    ((MgBaseLines*)dynshape()->shape())->shrinkToFit();
 
     return MgCommandDraw::touchEnded(sender);
 }
@@ -6,7 +6,7 @@
 #include "mgbasicsps.h"
 
 MgCmdDrawSplines::MgCmdDrawSplines(const char* name, bool freehand)
-    : MgCommandDraw(name), m_freehand(freehand)
+    : MgCommandDraw(name), m_freehand(freehand), m_fitting(false)
 {
 }
 
@@ -17,7 +17,11 @@ bool MgCmdDrawSplines::initialize(const MgMotion* sender, MgStorage* s)
 
 bool MgCmdDrawSplines::backStep(const MgMotion* sender)
 {
-    if (m_step > 1) {                   // freehand: 去掉倒数第二个点，倒数第一点是临时动态点
+    if (m_step > 1 && m_fitting) {      // 拟合中: 去掉最后的数据点，只重新拟合末尾部分
+        m_fitter.removeLastPoint();
+        smoothFitted(sender);
+    }
+    else if (m_step > 1) {              // freehand: 去掉倒数第二个点，倒数第一点是临时动态点
         ((MgBaseLines*)dynshape()->shape())->removePoint(m_freehand ? m_step - 1 : m_step);
         dynshape()->shape()->update();
     }
@@ -62,6 +66,16 @@ bool MgCmdDrawSplines::touchBegan(const MgMotion* sender)
             dynshape()->shape()->setPoint(1, pnt);
         dynshape()->shape()->update();
         
+        m_fitting = m_freehand && sender->view->getOptionBool("fitSplineWhileDrawing", false);   // 默认仍逐点记录，文档格式不变
+        if (m_fitting) {
+            float tol = sender->view->getOptionFloat("fitSplineTolerance", 2.f);  // 像素
+            m_fitter.reset(tol * tol);
+            m_fitter.addPoint(pnt * sender->view->xform()->modelToDisplay());
+        }
+        else if (m_freehand) {
+            lines->reserve(512);    // 一笔通常的采样点数，避免拖动中重新分配
+        }
+        
         return MgCommandDraw::touchBegan(sender);
     }
 }
@@ -78,7 +92,12 @@ bool MgCmdDrawSplines::touchMoved(const MgMotion* sender)
     
     if (m_freehand) {
         if (canAddPoint(sender, false)) {
-            lines->addPoint(pnt);
+            if (m_fitting) {
+                m_fitter.addPoint(pnt * sender->view->xform()->modelToDisplay());
+            }
+            if (!m_fitting || !smoothFitted(sender)) {
+                lines->addPoint(pnt);
+            }
             m_step++;
         }
     } else {
@@ -101,23 +120,22 @@ bool MgCmdDrawSplines::touchEnded(const MgMotion* sender)
     
     if (m_freehand) {
         Tol tol(sender->displayMmToModel(1.f));
+        if (m_fitting) {
+            m_fitter.finish();
+            smoothFitted(sender);
+            m_fitting = false;
+        }
         if (m_step > 0 && !dynshape()->shape()->getExtent().isEmpty(tol, false)) {
-            MgShape* newsp = addShape(sender);
-            if (newsp) {/*
-                m_step = 0;
-                sender->view->regenAppend(0);
-                newsp = newsp->cloneShape();
-                lines = (MgSplines*)newsp->shape();
-                lines->smooth(sender->view->xform()->modelToDisplay(),
-                              sender->view->xform()->getWorldToDisplayY() * 0.5f);
-                sender->view->shapes()->updateShape(newsp);
-                sender->view->regenAppend(newsp->getID())*/
+            if (sender->view->getOptionBool("compactStrokes", false)) {
+                lines->compact();       // 尚未共享，由本线程独占
             }
+            addShape(sender);
         }
         else {
             click(sender);  // add a point
         }
         m_step = 0;
+        lines->shrinkToFit();
     }
     else {
         float dist = lines->endPoint().distanceTo(dynshape()->getPoint(0));
@@ -143,6 +161,7 @@ bool MgCmdDrawSplines::cancel(const MgMotion* sender)
         lines->removePoint(m_step--);
         addShape(sender);
     }
+    m_fitting = false;
     return MgCommandDraw::cancel(sender);
 }
 
@@ -161,6 +180,12 @@ bool MgCmdDrawSplines::canAddPoint(const MgMotion* sender, bool ended)
     return true;
 }
 
+bool MgCmdDrawSplines::smoothFitted(const MgMotion* sender)
+{
+    MgSplines* lines = (MgSplines*)dynshape()->shape();
+    return lines->smoothForFitter(m_fitter, sender->view->xform()->displayToModel()) > 0;
+}
+
 bool MgCmdDrawSplines::click(const MgMotion* sender)
 {
     if (m_freehand) {
@@ -117,6 +117,12 @@ private:
             it->first->onGatherSnapIgnoredID(sender, sp, ids, i, n);
         }
     }
+    virtual void onShapesBatchChanged(const MgMotion* sender, int added, int changed,
+                                      int deleted, const int* ids) {
+        for (Iterator it = _arr.begin(); it != _arr.end(); ++it) {
+            it->first->onShapesBatchChanged(sender, added, changed, deleted, ids);
+        }
+    }
 
     virtual void onSelectionChanged(const MgMotion* sender) {
         for (Iterator it = _arr.begin(); it != _arr.end(); ++it) {
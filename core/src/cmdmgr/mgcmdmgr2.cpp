@@ -87,9 +87,11 @@ void MgCmdManagerImpl::eraseWnd(const MgMotion* sender)
         std::vector<int>::iterator i = delIds.begin();
         int n = 0;
         
+        sender->view->beginShapesBatch();
         for (; i != delIds.end(); ++i) {
             n += sender->view->removeShape(s->findShape(*i));
         }
+        sender->view->endShapesBatch();
         if (n > 0) {
             sender->view->regenAll(true);
             char buf[31];
@@ -97,6 +97,7 @@ MgCmdSelect::MgCmdSelect() : MgCommand(Name())
 {
     m_editMode = false;
     m_shapeEdited = false;
+    m_xfDrag = false;
 }
 
 bool MgCmdSelect::cancel(const MgMotion* sender)
@@ -133,6 +134,7 @@ bool MgCmdSelect::initializeWithSelection(const MgMotion* sender, MgStorage* s,
     m_editMode = false;
     m_showSel = true;
     m_rotateAngle = 0.f;
+    m_xfDrag = false;
     
     m_id = getLockSelShape(sender, 0);
     m_handleIndex = getLockSelHandle(sender, m_handleIndex);
@@ -197,6 +199,11 @@ bool MgCmdSelect::backStep(const MgMotion* sender)
         sender->view->redraw();
         return true;
     }
+    if (m_xfDrag) {                                 // 正在以变换矩阵拖动
+        m_xfDrag = false;
+        sender->view->redraw();
+        return true;
+    }
     if (!m_selIds.empty()) {                        // 图形整体选中状态
         m_id = 0;
         m_hit.segment = -1;
@@ -234,7 +241,7 @@ bool MgCmdSelect::draw(const MgMotion* sender, GiGraphics* gs)
         selectionChanged(sender->view);
     }
     
-    if (!m_showSel || (!m_clones.empty() && !isCloneDrag(sender))) {
+    if (!m_showSel || ((!m_clones.empty() || m_xfDrag) && !isCloneDrag(sender))) {
         if (m_showSel && !boxrorate && (flags & kMgSelDrawDragLine)) { // 拖动提示的参考线
             GiContext ctxshap(-1.05f, GiColor(0, 0, 255, 32), GiContext::kDotLine);
             gs->drawLine(&ctxshap, m_ptStart, m_ptSnap);
@@ -244,8 +251,16 @@ bool MgCmdSelect::draw(const MgMotion* sender, GiGraphics* gs)
         drawAngleText(sender, gs, fabsf(m_rotateAngle));
     }
     
+    // 拖动大量图形时，按变换矩阵显示原图形
+    if (m_xfDrag) {
+        GiSaveModelTransform xf(&gs->xf(), m_dragXf);
+        for (it = shapes.begin(); it != shapes.end(); ++it) {
+            if (canMoveByTransform(sender->view, *it))
+                (*it)->draw(2, *gs, NULL, -1);
+        }
+    }
     // 外部动态改变图形属性时，或拖动时
-    if (!m_showSel || !m_clones.empty()) {
+    else if (!m_showSel || !m_clones.empty()) {
         for (it = shapes.begin(); it != shapes.end(); ++it) {
             (*it)->draw(m_showSel ? 2 : 0, *gs, NULL, -1);          // 原样显示
         }
@@ -286,11 +301,14 @@ bool MgCmdSelect::draw(const MgMotion* sender, GiGraphics* gs)
         Box2d selbox(getBoundingBox(sender));
         bool xform = !!(flags & kMgSelDrawXformBox);
         
+        if (m_xfDrag) {
+            selbox *= m_dragXf;
+        }
         if (!selbox.isEmpty() && (flags & kMgSelDrawSelBorder)) {
             GiContext ctxshap(0, GiColor(0, 0, 255, 48), GiContext::kDashLine);
             gs->drawRect(&ctxshap, selbox);
         }
-        if (m_clones.empty() && !shapes.empty()) {
+        if (m_clones.empty() && !m_xfDrag && !shapes.empty()) {
             for (int i = xform && canTransform(shapes.front(), sender) ? 7 : -1; i >= 0; i--) {
                 mgnear::getRectHandle(selbox, i, pnt);
                 gs->drawHandle(pnt, 0);
@@ -636,8 +654,13 @@ bool MgCmdSelect::touchBegan(const MgMotion* sender)
         }
     }
     
-    if (!sender->view->isReadOnly())
-        cloneShapes(sender->view);
+    m_xfDrag = false;
+    m_dragXf = Matrix2d::kIdentity();
+    if (!sender->view->isReadOnly()) {
+        m_xfDrag = canDragByTransform(sender);  // 图形太多时不复制，仅记录变换矩阵
+        if (!m_xfDrag)
+            cloneShapes(sender->view);
+    }
     MgShape* shape = m_clones.empty() ? NULL : m_clones.front();
     
     if (!m_showSel) {
@@ -663,7 +686,7 @@ bool MgCmdSelect::touchBegan(const MgMotion* sender)
         m_handleIndex = hitTestHandles(shape, m_hit.nearpt, sender);
     }
     
-    if (m_clones.empty() && sender->view->getOptionBool("canBoxSel", true)) {
+    if (m_clones.empty() && !m_xfDrag && sender->view->getOptionBool("canBoxSel", true)) {
         m_boxsel = true;
     }
     m_boxHandle = 99;
@@ -878,6 +901,10 @@ bool MgCmdSelect::touchMoved(const MgMotion* sender)
     }
     m_rotateAngle = 0.f;
     
+    if (m_xfDrag) {
+        return dragByTransform(sender);
+    }
+    
     Vector2d minsnap(1e8f, 1e8f);
     int snapindex = -1;
     
@@ -1102,8 +1129,61 @@ void MgCmdSelect::cloneShapes(MgView* view)
     }
 }
 
+bool MgCmdSelect::canDragByTransform(const MgMotion* sender)
+{
+    int minCount = sender->view->getOptionInt("xfDragMinCount", 100);
+    Matrix2d mat;
+    
+    return (minCount > 1 && (int)m_selIds.size() >= minCount
+            && !isEditMode(sender->view) && m_rotateHandle == 0
+            && !isDragRectCorner(sender, mat));     // 拖动变形框的控制点时仍复制图形，由各图形处理
+}
+
+bool MgCmdSelect::canMoveByTransform(MgView* view, const MgShape* shape)
+{
+    return (shape && !shape->shapec()->isLocked()
+            && view->shapeCanTransform(shape)
+            && view->shapeCanMovedHandle(shape, -1));
+}
+
+bool MgCmdSelect::dragByTransform(const MgMotion* sender)
+{
+    std::vector<int> ignoreids(m_selIds);   // 不捕捉到正在拖动的图形上
+    ignoreids.push_back(0);
+    
+    MgSnap* snap = sender->cmds()->getSnap();
+    m_ptSnap = snap->snapPoint(sender, sender->pointM, MgShape::Null(), -1, -1,
+                               &ignoreids.front());
+    m_dragXf = Matrix2d::translation(m_ptSnap - m_ptStart);
+    
+    sender->view->redraw();
+    sender->view->dynamicChanged();
+    
+    return true;
+}
+
+void MgCmdSelect::cloneTransformedShapes(MgView* view)
+{
+    cloneShapes(view);
+    for (size_t i = 0; i < m_clones.size(); i++) {
+        const MgShape* basesp = view->shapes()->findShape(m_clones[i]->getID());
+        if (canMoveByTransform(view, basesp)) {
+            m_clones[i]->shape()->transform(m_dragXf);
+            m_clones[i]->shape()->update();
+        }
+    }
+}
+
 bool MgCmdSelect::applyCloneShapes(MgView* view, bool apply, bool addNewShapes)
 {
+    if (m_xfDrag) {                     // 拖动结束时才生成变换后的图形
+        m_xfDrag = false;
+        if (apply && !m_dragXf.isIdentity()) {
+            cloneTransformedShapes(view);
+        }
+        m_dragXf = Matrix2d::kIdentity();
+    }
+    
     bool changed = false;
     const bool cloned = !m_clones.empty();
     size_t i;
@@ -1130,6 +1210,7 @@ bool MgCmdSelect::applyCloneShapes(MgView* view, bool apply, bool addNewShapes)
             m_selIds.clear();
             m_id = 0;
         }
+        view->beginShapesBatch();
         for (i = 0; i < m_clones.size(); i++) {
             const MgShape* oldsp = view->shapes()->findShape(m_clones[i]->getID());
             
@@ -1165,6 +1246,7 @@ bool MgCmdSelect::applyCloneShapes(MgView* view, bool apply, bool addNewShapes)
                 }
             }
         }
+        view->endShapesBatch();
         m_clones.clear();
     }
     if (changed) {
@@ -1272,6 +1354,7 @@ bool MgCmdSelect::deleteSelection(const MgMotion* sender)
     if (shape && sender->view->shapeWillDeleted(shape)) {
         applyCloneShapes(sender->view, false);
 
+        sender->view->beginShapesBatch();
         for (sel_iterator it = m_selIds.begin(); it != m_selIds.end(); ++it) {
             shape = sender->view->shapes()->findShape(*it);
             if (shape && !shape->shapec()->isLocked()
@@ -1279,6 +1362,7 @@ bool MgCmdSelect::deleteSelection(const MgMotion* sender)
                 count += sender->view->removeShape(shape);
             }
         }
+        sender->view->endShapesBatch();
         
         m_selIds.clear();
         m_id = 0;
@@ -1658,6 +1742,8 @@ bool MgCmdSelect::twoFingersMove(const MgMotion* sender)
             || !isZoomShapeEnabled(sender)) {
             return false;
         }
+        m_xfDrag = false;                       // 双指变形总是复制图形，不沿用单指拖动的变换矩阵
+        m_dragXf = Matrix2d::kIdentity();
         cloneShapes(sender->view);
         return m_clones.size() == m_selIds.size() && !mgIsZero(sender->distanceM());
     }
@@ -86,6 +86,10 @@ private:
     bool isDragRectCorner(const MgMotion* sender, Matrix2d& mat);
     bool isCloneDrag(const MgMotion* sender);
     void cloneShapes(MgView* view);
+    bool canDragByTransform(const MgMotion* sender);
+    bool canMoveByTransform(MgView* view, const MgShape* shape);
+    bool dragByTransform(const MgMotion* sender);
+    void cloneTransformedShapes(MgView* view);
     bool applyCloneShapes(MgView* view, bool apply, bool addNewShapes = false);
     bool canTransform(const MgShape* shape, const MgMotion* sender);
     bool canRotate(const MgShape* shape, const MgMotion* sender);
@@ -94,6 +98,7 @@ private:
 private:
     std::vector<int>        m_selIds;           // 选中的图形的ID
     std::vector<MgShape*>   m_clones;           // 选中图形的复制对象
+    Matrix2d                m_dragXf;           // 拖动大量图形时的整体变换矩阵
     int                     m_id;               // 选中图形的ID
     MgHitResult             m_hit;              // 点中结果
     Point2d                 m_ptSnap;           // 捕捉点
@@ -107,6 +112,7 @@ private:
     bool                    m_showSel;          // 是否亮显选中的图形
     bool                    m_boxsel;           // 是否开始框选
     bool                    m_dragging;         // 是否正在拖动
+    bool                    m_xfDrag;           // 是否以变换矩阵代替复制图形来拖动
     bool                    m_canRotateHandle;  // 是否允许绕控制点旋转
     bool                    m_shapeEdited;      // 图形可自定义编辑
 };
@@ -158,8 +158,18 @@ static bool snapPerp(const MgMotion* sender, const Point2d& orgpt, const Tol& to
         int n = s->getPointCount();
         Point2d perp1, perp2;
         const Point2d start(shape->getPoint(0));
+        const MgSegmentCache* cache = (!perpOut && s->isKindOf(MgBaseLines::Type())
+                                       ? ((const MgBaseLines*)s)->getSegmentCache() : NULL);
+        std::vector<int> near;
         
-        for (int i = 0, edges = n - (s->isClosed() ? 0 : 1); i < edges; i++) {
+        if (cache) {    // 垂足在边上，只需检查起点或当前点附近的边
+            Box2d rect(orgpt, 4 * arr0.maxdist, 4 * arr0.maxdist);
+            rect.unionWith(Box2d(start, 2 * arr0.maxdist, 2 * arr0.maxdist));
+            cache->findSegments(rect, near);
+        }
+        
+        for (int k = 0, edges = cache ? (int)near.size() : n - (s->isClosed() ? 0 : 1); k < edges; k++) {
+            const int i = cache ? near[k] : k;
             Point2d pt1(s->getHandlePoint(i));
             Point2d pt2(s->getHandlePoint((i + 1) % n));
             float d2 = mglnrel::ptToBeeline2(pt1, pt2, orgpt, perp2);
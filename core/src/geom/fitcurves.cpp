@@ -45,7 +45,10 @@ typedef struct _PtArr {
 typedef void        (*FitCubicCallback)(void* data, const Point2d curve[4]);
 void                FitCurve(FitCubicCallback fc, void* data, const Point2d *d, int nPts, float error);
 void      FitCurve2(FitCubicCallback fc, void* data, PtCallback d, void* data2, int nPts, float error);
-static  void        FitCurve_(FitCubicCallback fc, void* data, const PtArr &d, int nPts, float error);
+void      FitCurveFrom(FitCubicCallback fc, void* data, const Point2d *d, int nPts, float error,
+                       const Vector2d& startTangent);
+static  void        FitCurve_(FitCubicCallback fc, void* data, const PtArr &d, int nPts, float error,
+                              const point_t* startTangent = (const point_t*)0);
 static  void        FitCubic(FitCubicCallback fc, void* data, const PtArr &d, int first, int &last,
                              const point_t& tHat1, const point_t& tHat2, double error);
 static  double      *Reparameterize(const PtArr &d, int first, int last, double *u,
@@ -81,7 +84,21 @@ void FitCurve2(FitCubicCallback fc, void* data, PtCallback d, void* data2, int n
     FitCurve_(fc, data, arr, nPts, error);
 }
 
-static void FitCurve_(FitCubicCallback fc, void* data, const PtArr &d, int nPts, float error)
+/*
+ *  FitCurveFrom :
+ *      Fit the points with a given unit tangent at the first point,
+ *      so that the curves join the previous fitted curve smoothly.
+ */
+void FitCurveFrom(FitCubicCallback fc, void* data, const Point2d *d, int nPts, float error,
+                  const Vector2d& startTangent)
+{
+    PtArr arr(d);
+    point_t tHat1(startTangent.x, startTangent.y);
+    FitCurve_(fc, data, arr, nPts, error, startTangent.isZeroVector() ? (const point_t*)0 : &tHat1);
+}
+
+static void FitCurve_(FitCubicCallback fc, void* data, const PtArr &d, int nPts, float error,
+                      const point_t* startTangent)
 {
     point_t     tHat1, tHat2;   // Unit tangent vectors at endpoints
     int         first = 0;
@@ -89,7 +106,7 @@ static void FitCurve_(FitCubicCallback fc, void* data, const PtArr &d, int nPts,
     int         oldlast;
     const Point2d ptbuf[4] = { Point2d::kInvalid() };
     
-    tHat1 = ComputeLeftTangent(d, first);
+    tHat1 = startTangent ? *startTangent : ComputeLeftTangent(d, first);
     while (tHat1.isDegenerate() && first < last)
         tHat1 = ComputeLeftTangent(d, ++first);
     
@@ -0,0 +1,478 @@
+/*
+    Single-precision version of FitCurves.cpp (Philip J. Schneider, "An Algorithm for
+    Automatically Fitting Digitized Curves", Graphics Gems, Academic Press, 1990).
+
+    The digitized points are copied once into float arrays (x[], y[]), so the inner loops
+    neither call back nor convert to double. Chord-length parameters, Newton-Raphson
+    reparameterization, the least-squares sums and the squared errors are evaluated
+    four points at a time with SSE or NEON when available, with the Bezier curve in
+    power-basis form relative to its first point.
+    The tolerance semantics are the same as FitCurve() in fitcurves.cpp.
+
+    TouchVG modifications Copyright (c) 2014 Zhang Yungui
+ */
+
+#include "mgpnt.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+typedef float32x4_t vf4;
+static inline vf4 f4load(const float* p) { return vld1q_f32(p); }
+static inline void f4store(float* p, vf4 a) { vst1q_f32(p, a); }
+static inline vf4 f4set(float f) { return vdupq_n_f32(f); }
+static inline vf4 f4add(vf4 a, vf4 b) { return vaddq_f32(a, b); }
+static inline vf4 f4sub(vf4 a, vf4 b) { return vsubq_f32(a, b); }
+static inline vf4 f4mul(vf4 a, vf4 b) { return vmulq_f32(a, b); }
+static inline vf4 f4div(vf4 a, vf4 b) {
+#if defined(__aarch64__)
+    return vdivq_f32(a, b);
+#else
+    vf4 r = vrecpeq_f32(b);                 // two Newton steps of the reciprocal estimate
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    return vmulq_f32(a, r);
+#endif
+}
+static inline vf4 f4selzero(vf4 test, vf4 ifzero, vf4 other) {  // test == 0 ? ifzero : other
+    return vbslq_f32(vceqq_f32(test, vdupq_n_f32(0.f)), ifzero, other);
+}
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+typedef __m128 vf4;
+static inline vf4 f4load(const float* p) { return _mm_loadu_ps(p); }
+static inline void f4store(float* p, vf4 a) { _mm_storeu_ps(p, a); }
+static inline vf4 f4set(float f) { return _mm_set1_ps(f); }
+static inline vf4 f4add(vf4 a, vf4 b) { return _mm_add_ps(a, b); }
+static inline vf4 f4sub(vf4 a, vf4 b) { return _mm_sub_ps(a, b); }
+static inline vf4 f4mul(vf4 a, vf4 b) { return _mm_mul_ps(a, b); }
+static inline vf4 f4div(vf4 a, vf4 b) { return _mm_div_ps(a, b); }
+static inline vf4 f4selzero(vf4 test, vf4 ifzero, vf4 other) {
+    vf4 mask = _mm_cmpeq_ps(test, _mm_setzero_ps());
+    return _mm_or_ps(_mm_and_ps(mask, ifzero), _mm_andnot_ps(mask, other));
+}
+#else
+struct vf4 { float v[4]; };
+static inline vf4 f4load(const float* p) { vf4 r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+static inline void f4store(float* p, vf4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+static inline vf4 f4set(float f) { vf4 r; for (int i = 0; i < 4; i++) r.v[i] = f; return r; }
+static inline vf4 f4add(vf4 a, vf4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+static inline vf4 f4sub(vf4 a, vf4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+static inline vf4 f4mul(vf4 a, vf4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+static inline vf4 f4div(vf4 a, vf4 b) { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+static inline vf4 f4selzero(vf4 test, vf4 ifzero, vf4 other) {
+    for (int i = 0; i < 4; i++) if (test.v[i] == 0.f) other.v[i] = ifzero.v[i];
+    return other;
+}
+#endif
+
+static inline float f4sum(vf4 a) {
+    float v[4];
+    f4store(v, a);
+    return (v[0] + v[1]) + (v[2] + v[3]);
+}
+
+typedef void (*FitCubicCallback)(void* data, const Point2d curve[4]);
+typedef Point2d (*PtCallback)(void* data, int i);
+
+//! The digitized points in float arrays and the scratch buffers shared by all segments.
+/*! Each array has 3 padding elements, so a block of 4 may start at any valid index.
+ */
+struct FitContextF {
+    FitCubicCallback fc;
+    void*   data;
+    float*  x;          // x coordinates of digitized points
+    float*  y;          // y coordinates of digitized points
+    float*  u;          // parameter values of the current region
+    float*  uPrime;     // improved parameter values
+    float*  dist;       // squared distances of points to the fitted curve
+    float*  buf;
+
+    FitContextF(FitCubicCallback fc, void* data, int n) : fc(fc), data(data) {
+        int size = n + 3;
+        buf = new float[size * 5];
+        for (int i = 0; i < size * 5; i++)
+            buf[i] = 0.f;
+        x = buf;
+        y = x + size;
+        u = y + size;
+        uPrime = u + size;
+        dist = uPrime + size;
+    }
+    ~FitContextF() { delete[] buf; }
+
+    Point2d pt(int i) const { return Point2d(x[i], y[i]); }
+    bool isDegenerate(int i) const { return isnan(x[i]) || isnan(y[i]); }
+};
+
+//! The power-basis form of a Bezier curve relative to its first point: Q(t) = ((c3 t + c2) t + c1) t
+struct BezierPowF {
+    Vector2d c1, c2, c3;
+
+    BezierPowF(const Point2d* bez) {
+        c1 = (bez[1] - bez[0]) * 3.f;
+        c2 = (bez[2] - bez[1] * 2.f + bez[0].asVector()) * 3.f;
+        c3 = bez[3] - bez[0] + (bez[1] - bez[2]) * 3.f;
+    }
+};
+
+void FitCurveF(FitCubicCallback fc, void* data, const Point2d *d, int nPts, float error);
+void FitCurve2F(FitCubicCallback fc, void* data, PtCallback d, void* data2, int nPts, float error);
+void FitCurveFromF(FitCubicCallback fc, void* data, const Point2d *d, int nPts, float error,
+                   const Vector2d& startTangent);
+static void FitCurveF_(FitContextF& c, int nPts, float error, const Vector2d* startTangent);
+static void FitCubicF(FitContextF& c, int first, int &last,
+                      const Vector2d& tHat1, const Vector2d& tHat2, float error);
+static void ChordLengthParameterizeF(FitContextF& c, int first, int &last);
+static void GenerateBezierF(const FitContextF& c, int first, int last, const float *u,
+                            const Vector2d& tHat1, const Vector2d& tHat2, Point2d *bezCurve);
+static void ReparameterizeF(const FitContextF& c, int first, int last,
+                            const float *u, float *uPrime, const Point2d *bezCurve);
+static float ComputeMaxErrorF(const FitContextF& c, int first, int last,
+                              const Point2d *bezCurve, const float *u, int &splitPoint);
+
+static Vector2d NormalizedF(float x, float y)
+{
+    float len = sqrtf(x * x + y * y);
+    return len != 0.f ? Vector2d(x / len, y / len) : Vector2d(x, y);
+}
+
+static Vector2d ComputeLeftTangentF(const FitContextF& c, int end) {
+    return NormalizedF(c.x[end+1] - c.x[end], c.y[end+1] - c.y[end]);
+}
+
+static Vector2d ComputeRightTangentF(const FitContextF& c, int end) {
+    return NormalizedF(c.x[end-1] - c.x[end], c.y[end-1] - c.y[end]);
+}
+
+static Vector2d ComputeCenterTangentF(const FitContextF& c, int center) {
+    return NormalizedF(c.x[center-1] - c.x[center+1], c.y[center-1] - c.y[center+1]);
+}
+
+/*
+ *  FitCurveF :
+ *      Fit cubic Bezier curves to a set of digitized points in single precision.
+ *  error: tolerance (squared distance between points and fitted curve)
+ */
+void FitCurveF(FitCubicCallback fc, void* data, const Point2d *d, int nPts, float error)
+{
+    if (nPts < 2)
+        return;
+    FitContextF c(fc, data, nPts);
+    for (int i = 0; i < nPts; i++) {
+        c.x[i] = d[i].x;
+        c.y[i] = d[i].y;
+    }
+    FitCurveF_(c, nPts, error, (const Vector2d*)0);
+}
+
+void FitCurve2F(FitCubicCallback fc, void* data, PtCallback d, void* data2, int nPts, float error)
+{
+    if (nPts < 2)
+        return;
+    FitContextF c(fc, data, nPts);
+    for (int i = 0; i < nPts; i++) {
+        Point2d pt(d(data2, i));
+        c.x[i] = pt.x;
+        c.y[i] = pt.y;
+    }
+    FitCurveF_(c, nPts, error, (const Vector2d*)0);
+}
+
+void FitCurveFromF(FitCubicCallback fc, void* data, const Point2d *d, int nPts, float error,
+                   const Vector2d& startTangent)
+{
+    if (nPts < 2)
+        return;
+    FitContextF c(fc, data, nPts);
+    for (int i = 0; i < nPts; i++) {
+        c.x[i] = d[i].x;
+        c.y[i] = d[i].y;
+    }
+    FitCurveF_(c, nPts, error, startTangent.isZeroVector() ? (const Vector2d*)0 : &startTangent);
+}
+
+static void FitCurveF_(FitContextF& c, int nPts, float error, const Vector2d* startTangent)
+{
+    Vector2d    tHat1, tHat2;
+    int         first = 0;
+    int         last = nPts - 1;
+    int         oldlast;
+    const Point2d ptbuf[4] = { Point2d::kInvalid() };
+
+    tHat1 = startTangent ? *startTangent : ComputeLeftTangentF(c, first);
+    while (tHat1.isDegenerate() && first < last)
+        tHat1 = ComputeLeftTangentF(c, ++first);
+
+    tHat2 = ComputeRightTangentF(c, last);
+    while (tHat2.isDegenerate() && last > first)
+        tHat2 = ComputeRightTangentF(c, --last);
+
+    if (first < last) {
+        oldlast = last;
+        FitCubicF(c, first, last, tHat1, tHat2, mgMax(error, 1.1f));
+        while (last < oldlast) {
+            for (first = last + 1; first < oldlast; first++) {
+                tHat1 = ComputeLeftTangentF(c, first);
+                if (!tHat1.isDegenerate())
+                    break;
+            }
+            last = oldlast;
+            if (first < last) {
+                (*c.fc)(c.data, ptbuf);
+                FitCubicF(c, first, last, tHat1, tHat2, mgMax(error, 1.1f));
+            }
+        }
+    }
+}
+
+/*
+ *  FitCubicF :
+ *      Fit a Bezier curve to a (sub)set of digitized points.
+ *      c.u and c.uPrime are reused by the recursive calls, which start after
+ *      the parameters of this region are no longer needed.
+ */
+static void FitCubicF(FitContextF& c, int first, int &last,
+                      const Vector2d& tHat1, const Vector2d& tHat2, float error)
+{
+    Point2d     bezCurve[4];
+    float       *u = c.u;
+    float       *uPrime = c.uPrime;
+    float       maxError;
+    int         splitPoint;
+    float       iterationError = error * error;
+    const int   maxIterations = 5;
+    Vector2d    tHatCenter;
+
+    // Use heuristic if region only has two points in it
+    if (last - first == 1) {
+        float dist = c.pt(last).distanceTo(c.pt(first)) / 3.f;
+
+        bezCurve[0] = c.pt(first);
+        bezCurve[3] = c.pt(last);
+        bezCurve[1] = bezCurve[0] + tHat1 * dist;
+        bezCurve[2] = bezCurve[3] + tHat2 * dist;
+        (*c.fc)(c.data, bezCurve);
+        return;
+    }
+
+    // Parameterize points, and attempt to fit curve
+    ChordLengthParameterizeF(c, first, last);
+    GenerateBezierF(c, first, last, u, tHat1, tHat2, bezCurve);
+
+    maxError = ComputeMaxErrorF(c, first, last, bezCurve, u, splitPoint);
+    if (maxError < error) {
+        (*c.fc)(c.data, bezCurve);
+        return;
+    }
+
+    // If error not too large, try some reparameterization and iteration
+    if (maxError < iterationError) {
+        for (int i = 0; i < maxIterations; i++) {
+            ReparameterizeF(c, first, last, u, uPrime, bezCurve);
+            GenerateBezierF(c, first, last, uPrime, tHat1, tHat2, bezCurve);
+            maxError = ComputeMaxErrorF(c, first, last, bezCurve, uPrime, splitPoint);
+            if (maxError < error) {
+                (*c.fc)(c.data, bezCurve);
+                return;
+            }
+            mgSwap(u, uPrime);
+        }
+    }
+
+    // Fitting failed -- split at max error point and fit recursively
+    tHatCenter = ComputeCenterTangentF(c, splitPoint);
+    FitCubicF(c, first, splitPoint, tHat1, tHatCenter, error);
+    FitCubicF(c, splitPoint, last, -tHatCenter, tHat2, error);
+}
+
+/*
+ *  ChordLengthParameterizeF :
+ *      Assign parameter values to c.u using relative distances between points.
+ */
+static void ChordLengthParameterizeF(FitContextF& c, int first, int &last)
+{
+    float *u = c.u;
+    int i;
+
+    u[0] = 0.f;
+    for (i = first + 1; i <= last; i++) {
+        if (c.isDegenerate(i)) {
+            last = i - 1;
+            break;
+        }
+        float dx = c.x[i] - c.x[i-1];
+        float dy = c.y[i] - c.y[i-1];
+        u[i-first] = u[i-first-1] + sqrtf(dx * dx + dy * dy);
+    }
+
+    const int n = last - first + 1;
+    const float total = u[n - 1];
+    const vf4 vtotal = f4set(total);
+
+    for (i = 0; i + 4 <= n; i += 4)
+        f4store(u + i, f4div(f4load(u + i), vtotal));
+    for (; i < n; i++)
+        u[i] = u[i] / total;
+    u[0] = 0.f;
+}
+
+/*
+ *  GenerateBezierF :
+ *      Use least-squares method to find Bezier control points for region.
+ *      The sums of the normal equations are accumulated four points at a time,
+ *      relative to the first point of the region.
+ */
+static void GenerateBezierF(const FitContextF& c, int first, int last, const float *u,
+                            const Vector2d& tHat1, const Vector2d& tHat2, Point2d *bezCurve)
+{
+    const int   nPts = last - first + 1;
+    const float *x = c.x + first;
+    const float *y = c.y + first;
+    const float x0 = x[0], y0 = y[0];
+    const float dx = x[nPts-1] - x0, dy = y[nPts-1] - y0;
+    float       s11, s12, s22, sx1, sx2;    // Sums of B1*B1, B1*B2, B2*B2, B1*(t1.tmp), B2*(t2.tmp)
+    int         i = 0;
+
+    {
+        const vf4 one = f4set(1.f), three = f4set(3.f);
+        const vf4 vx0 = f4set(x0), vy0 = f4set(y0), vdx = f4set(dx), vdy = f4set(dy);
+        const vf4 t1x = f4set(tHat1.x), t1y = f4set(tHat1.y);
+        const vf4 t2x = f4set(tHat2.x), t2y = f4set(tHat2.y);
+        vf4 a11 = f4set(0.f), a12 = a11, a22 = a11, ax1 = a11, ax2 = a11;
+
+        for (; i + 4 <= nPts; i += 4) {
+            vf4 uu = f4load(u + i);
+            vf4 t = f4sub(one, uu);
+            vf4 uu3 = f4mul(three, uu);
+            vf4 b1 = f4mul(uu3, f4mul(t, t));                       // 3u(1-u)^2
+            vf4 b2 = f4mul(uu3, f4mul(uu, t));                      // 3u^2(1-u)
+            vf4 b23 = f4add(b2, f4mul(uu, f4mul(uu, uu)));          // B2 + B3
+            vf4 tx = f4sub(f4sub(f4load(x + i), vx0), f4mul(vdx, b23));
+            vf4 ty = f4sub(f4sub(f4load(y + i), vy0), f4mul(vdy, b23));
+
+            a11 = f4add(a11, f4mul(b1, b1));
+            a12 = f4add(a12, f4mul(b1, b2));
+            a22 = f4add(a22, f4mul(b2, b2));
+            ax1 = f4add(ax1, f4mul(b1, f4add(f4mul(t1x, tx), f4mul(t1y, ty))));
+            ax2 = f4add(ax2, f4mul(b2, f4add(f4mul(t2x, tx), f4mul(t2y, ty))));
+        }
+        s11 = f4sum(a11);
+        s12 = f4sum(a12);
+        s22 = f4sum(a22);
+        sx1 = f4sum(ax1);
+        sx2 = f4sum(ax2);
+    }
+    for (; i < nPts; i++) {
+        float uu = u[i], t = 1.f - uu;
+        float b1 = 3.f * uu * t * t;
+        float b2 = 3.f * uu * uu * t;
+        float b23 = b2 + uu * uu * uu;
+        float tx = x[i] - x0 - dx * b23;
+        float ty = y[i] - y0 - dy * b23;
+
+        s11 += b1 * b1;
+        s12 += b1 * b2;
+        s22 += b2 * b2;
+        sx1 += b1 * (tHat1.x * tx + tHat1.y * ty);
+        sx2 += b2 * (tHat2.x * tx + tHat2.y * ty);
+    }
+
+    const float C00 = s11, C01 = s12 * tHat1.dotProduct(tHat2), C11 = s22;
+    const float det_C0_C1 = C00 * C11 - C01 * C01;
+    const float det_C0_X  = C00 * sx2 - C01 * sx1;
+    const float det_X_C1  = sx1 * C11 - sx2 * C01;
+    const float alpha_l = (det_C0_C1 == 0) ? 0.f : det_X_C1 / det_C0_C1;
+    const float alpha_r = (det_C0_C1 == 0) ? 0.f : det_C0_X / det_C0_C1;
+
+    const float segLength = sqrtf(dx * dx + dy * dy);
+    const float epsilon = 1.0e-6f * segLength;
+
+    bezCurve[0].set(x0, y0);
+    bezCurve[3].set(x0 + dx, y0 + dy);
+    if (alpha_l < epsilon || alpha_r < epsilon) {
+        // fall back on standard (probably inaccurate) formula, and subdivide further if needed.
+        float dist = segLength / 3.f;
+        bezCurve[1] = bezCurve[0] + tHat1 * dist;
+        bezCurve[2] = bezCurve[3] + tHat2 * dist;
+    } else {
+        bezCurve[1] = bezCurve[0] + tHat1 * alpha_l;
+        bezCurve[2] = bezCurve[3] + tHat2 * alpha_r;
+    }
+}
+
+/*
+ *  ReparameterizeF :
+ *      One Newton-Raphson step of every point toward its nearest point on the curve.
+ *      The padding of the arrays lets the last block run past 'last'.
+ */
+static void ReparameterizeF(const FitContextF& c, int first, int last,
+                            const float *u, float *uPrime, const Point2d *bezCurve)
+{
+    const int   nPts = last - first + 1;
+    const float *x = c.x + first;
+    const float *y = c.y + first;
+    const BezierPowF Q(bezCurve);
+    const vf4 x0 = f4set(bezCurve[0].x), y0 = f4set(bezCurve[0].y);
+    const vf4 c1x = f4set(Q.c1.x), c1y = f4set(Q.c1.y);
+    const vf4 c2x = f4set(Q.c2.x), c2y = f4set(Q.c2.y);
+    const vf4 c3x = f4set(Q.c3.x), c3y = f4set(Q.c3.y);
+    const vf4 d2x = f4set(Q.c2.x * 2.f), d2y = f4set(Q.c2.y * 2.f);      // Q'(t) = (3 c3 t + 2 c2) t + c1
+    const vf4 d3x = f4set(Q.c3.x * 3.f), d3y = f4set(Q.c3.y * 3.f);
+    const vf4 e3x = f4set(Q.c3.x * 6.f), e3y = f4set(Q.c3.y * 6.f);      // Q''(t) = 6 c3 t + 2 c2
+
+    for (int i = 0; i < nPts; i += 4) {
+        vf4 t = f4load(u + i);
+        vf4 ex = f4sub(f4mul(f4add(f4mul(f4add(f4mul(c3x, t), c2x), t), c1x), t),
+                       f4sub(f4load(x + i), x0));                       // Q(t) - P
+        vf4 ey = f4sub(f4mul(f4add(f4mul(f4add(f4mul(c3y, t), c2y), t), c1y), t),
+                       f4sub(f4load(y + i), y0));
+        vf4 q1x = f4add(f4mul(f4add(f4mul(d3x, t), d2x), t), c1x);
+        vf4 q1y = f4add(f4mul(f4add(f4mul(d3y, t), d2y), t), c1y);
+        vf4 q2x = f4add(f4mul(e3x, t), d2x);
+        vf4 q2y = f4add(f4mul(e3y, t), d2y);
+        vf4 num = f4add(f4mul(ex, q1x), f4mul(ey, q1y));
+        vf4 den = f4add(f4add(f4mul(q1x, q1x), f4mul(q1y, q1y)),
+                        f4add(f4mul(ex, q2x), f4mul(ey, q2y)));
+
+        f4store(uPrime + i, f4selzero(den, t, f4sub(t, f4div(num, den))));
+    }
+}
+
+/*
+ *  ComputeMaxErrorF :
+ *      Find the maximum squared distance of digitized points to fitted curve.
+ *      The distances are evaluated in blocks into c.dist, then scanned for the maximum.
+ */
+static float ComputeMaxErrorF(const FitContextF& c, int first, int last,
+                              const Point2d *bezCurve, const float *u, int &splitPoint)
+{
+    const int   nPts = last - first + 1;
+    const float *x = c.x + first;
+    const float *y = c.y + first;
+    float       *dist = c.dist;
+    const BezierPowF Q(bezCurve);
+    const vf4 x0 = f4set(bezCurve[0].x), y0 = f4set(bezCurve[0].y);
+    const vf4 c1x = f4set(Q.c1.x), c1y = f4set(Q.c1.y);
+    const vf4 c2x = f4set(Q.c2.x), c2y = f4set(Q.c2.y);
+    const vf4 c3x = f4set(Q.c3.x), c3y = f4set(Q.c3.y);
+    float       maxDist = 0.f;
+    int         i;
+
+    for (i = 0; i < nPts; i += 4) {
+        vf4 t = f4load(u + i);
+        vf4 vx = f4sub(f4mul(f4add(f4mul(f4add(f4mul(c3x, t), c2x), t), c1x), t),
+                       f4sub(f4load(x + i), x0));
+        vf4 vy = f4sub(f4mul(f4add(f4mul(f4add(f4mul(c3y, t), c2y), t), c1y), t),
+                       f4sub(f4load(y + i), y0));
+        f4store(dist + i, f4add(f4mul(vx, vx), f4mul(vy, vy)));
+    }
+
+    splitPoint = (last - first + 1) / 2;
+    for (i = 1; i < nPts - 1; i++) {
+        if (dist[i] >= maxDist) {
+            maxDist = dist[i];
+            splitPoint = first + i;
+        }
+    }
+    return maxDist;
+}
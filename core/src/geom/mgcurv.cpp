@@ -733,6 +733,47 @@ bool mgcurv::triEquations(
     return true;
 }
 
+bool mgcurv::cyclicTriEquations(
+    int n, float *a, float *b, float *c, Vector2d *vs)
+{
+    if (!a || !b || !c || !vs || n < 3)
+        return false;
+    
+    float alpha = c[n-1];                   // 左下角元素
+    float beta = a[n-1];                    // 右上角元素
+    float gamma = -b[0];
+    float* b2 = new float[n];
+    Vector2d* z = new Vector2d[n];
+    bool ret;
+    int i;
+    
+    // A = T + u*v'，u = (gamma, 0, ..., alpha)，v = (1, 0, ..., beta/gamma)
+    b[0] -= gamma;
+    b[n-1] -= alpha * beta / gamma;
+    for (i = 0; i < n; i++) {
+        b2[i] = b[i];
+        z[i].set(0.f, 0.f);
+    }
+    z[0].x = gamma;
+    z[n-1].x = alpha;
+    
+    ret = triEquations(n, a, b, c, vs) && triEquations(n, a, b2, c, z);
+    if (ret) {                              // x = y - z * (v'y) / (1 + v'z)
+        float w = 1.f + z[0].x + beta * z[n-1].x / gamma;
+        ret = !mgIsZero(w);
+        if (ret) {
+            Vector2d fact((vs[0] + vs[n-1] * (beta / gamma)) / w);
+            for (i = 0; i < n; i++) {
+                vs[i] -= fact * z[i].x;
+            }
+        }
+    }
+    delete[] z;
+    delete[] b2;
+    
+    return ret;
+}
+
 bool mgcurv::gaussJordan(int n, float *mat, Vector2d *vs)
 {
     int i, j, k, m;
@@ -790,33 +831,22 @@ bool mgcurv::gaussJordan(int n, float *mat, Vector2d *vs)
 }
 
 static bool CalcCubicClosed(
-    int n, float* a, Vector2d* vecs, const Point2d* knots)
+    int n, float* a, float* b, float* c, Vector2d* vecs, const Point2d* knots)
 {
     int i, n1 = n - 1;
-
-    for (i = n*n - 1; i >= 0; i--)
-        a[i] = 0.f;
-    
-    a[n1] = 1.0;
-    a[0]  = 4.0;
-    a[1]  = 1.0;
-    a[n1*n+n1 - 1] = 1.0;
-    a[n1*n+n1]   = 4.0;
-    a[n1*n+0]    = 1.0;
-    vecs[0].x  = 3 * (knots[1].x-knots[n1].x);
-    vecs[0].y  = 3 * (knots[1].y-knots[n1].y);
-    vecs[n1].x = 3 * (knots[0].x-knots[n1 - 1].x);
-    vecs[n1].y = 3 * (knots[0].y-knots[n1 - 1].y);
-    
-    for (i = 1; i < n1; i++) {
-        a[i*n+i-1] = 1.0;
-        a[i*n+i]   = 4.0;
-        a[i*n+i+1] = 1.0;
-        vecs[i].x = 3 * (knots[i+1].x-knots[i-1].x);
-        vecs[i].y = 3 * (knots[i+1].y-knots[i-1].y);
+    
+    for (i = 0; i < n; i++) {
+        a[i] = 1.0;
+        b[i] = 4.0;
+        c[i] = 1.0;
+        vecs[i].x = 3 * (knots[(i+1) % n].x-knots[(i+n1) % n].x);
+        vecs[i].y = 3 * (knots[(i+1) % n].y-knots[(i+n1) % n].y);
     }
     
-    return mgcurv::gaussJordan(n, a, vecs);
+    if (n < 3) {                            // 两点时角元素与对角线重合
+        return mgcurv::triEquations(n, a, b, c, vecs);
+    }
+    return mgcurv::cyclicTriEquations(n, a, b, c, vecs);
 }
 
 static bool CalcCubicUnclosed(
@@ -879,9 +909,9 @@ bool mgcurv::cubicSplines(
     if (!knots || !knotvs || n < 2)
         return false;
     
-    if ((flag & cubicLoop) && n <= 512) {
-        float* a = new float[n * n];
-        ret = a && CalcCubicClosed(n, a, knotvs, knots);
+    if (flag & cubicLoop) {
+        float* a = new float[n * 3];
+        ret = a && CalcCubicClosed(n, a, a+n, a+2*n, knotvs, knots);
         delete[] a;
     }
     else {
@@ -972,6 +1002,7 @@ struct FitCurveHelper {
 
 extern void FitCurve(mgcurv::FitCubicCallback, void*, const Point2d *, int, float);
 extern void FitCurve2(mgcurv::FitCubicCallback, void*, mgcurv::PtCallback, void*, int, float);
+extern void FitCurveF(mgcurv::FitCubicCallback, void*, const Point2d *, int, float);
 
 int mgcurv::fitCurve(int knotCount, Point2d* knots, Vector2d* knotvs,
                      int count, const Point2d* pts, float tol)
@@ -987,6 +1018,20 @@ int mgcurv::fitCurve(int knotCount, Point2d* knots, Vector2d* knotvs,
     return helper.index;
 }
 
+int mgcurv::fitCurveFast(int knotCount, Point2d* knots, Vector2d* knotvs,
+                         int count, const Point2d* pts, float tol)
+{
+    FitCurveHelper helper;
+    
+    helper.index = 0;
+    helper.knotCount = knotCount;
+    helper.knots = knots;
+    helper.knotvs = knotvs;
+    
+    FitCurveF(&FitCurveHelper::append, &helper, pts, count, tol);
+    return helper.index;
+}
+
 int mgcurv::fitCurve2(int knotCount, Point2d* knots, int count, PtCallback pts, void* data, float tol)
 {
     FitCurveHelper helper;
@@ -1009,3 +1054,8 @@ void mgcurv::fitCurve4(FitCubicCallback fc, void* data, PtCallback pts, void* da
 {
     FitCurve2(fc, data, pts, data2, n, tol);
 }
+
+void mgcurv::fitCurve3Fast(FitCubicCallback fc, void* data, const Point2d *pts, int n, float tol)
+{
+    FitCurveF(fc, data, pts, n, tol);
+}
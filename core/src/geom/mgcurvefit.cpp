@@ -0,0 +1,118 @@
+// mgcurvefit.cpp: 实现手绘线的增量曲线拟合类 MgCurveFitter
+// Copyright (c) 2004-2015, https://github.com/rhcad/vgcore, BSD License
+
+#include "mgcurvefit.h"
+#include "mgcurv.h"
+
+extern void FitCurveFromF(mgcurv::FitCubicCallback, void*, const Point2d *, int, float, const Vector2d&);
+
+MgCurveFitter::MgCurveFitter() : _tol(1.f), _maxTail(64)
+{
+}
+
+void MgCurveFitter::reset(float tol, int maxTail)
+{
+    _points.clear();
+    _frozen.clear();
+    _tail.clear();
+    _tangent = Vector2d();
+    _tol = tol;
+    _maxTail = maxTail > 8 ? maxTail : 8;
+}
+
+bool MgCurveFitter::addPoint(const Point2d& pt)
+{
+    if (!_points.empty() && _points.back() == pt) {
+        return false;
+    }
+    _points.push_back(pt);
+    fitTail();
+    
+    if ((int)_points.size() >= _maxTail) {      // 末尾的点太多时全部固定，使每点的计算量有上限
+        freeze(getSegmentCount() - getFrozenCount());
+    } else if (_tail.size() > 4) {              // 除最后一段外的各段不再变化
+        freeze((int)_tail.size() / 4 - 1);
+    }
+    return !_tail.empty() || _points.size() == 1;
+}
+
+bool MgCurveFitter::removeLastPoint()
+{
+    if (_points.size() < 2) {
+        return false;
+    }
+    _points.pop_back();
+    fitTail();
+    return true;
+}
+
+void MgCurveFitter::finish()
+{
+    freeze((int)_tail.size() / 4);
+}
+
+const Point2d* MgCurveFitter::getSegment(int index) const
+{
+    int n = getFrozenCount();
+    
+    if (index < 0 || index >= getSegmentCount())
+        return (const Point2d*)0;
+    return index < n ? &_frozen[index * 4] : &_tail[(index - n) * 4];
+}
+
+int MgCurveFitter::getKnots(int knotCount, Point2d* knots, Vector2d* knotvs) const
+{
+    int count = 0;
+    
+    for (int i = 0, n = getSegmentCount(); i < n; i++) {
+        const Point2d* curve = getSegment(i);
+        
+        if (count > 0 && knots[count - 1] == curve[0]) {
+            if (count < knotCount) {
+                knots[count] = curve[3];
+                knotvs[count++] = curve[3] - curve[2];
+            }
+        } else if (count + 1 < knotCount) {
+            knots[count] = curve[0];
+            knots[count + 1] = curve[3];
+            knotvs[count] = curve[1] - curve[0];
+            knotvs[count + 1] = curve[3] - curve[2];
+            count += 2;
+        }
+    }
+    return count;
+}
+
+void MgCurveFitter::appendCurve(void* data, const Point2d curve[4])
+{
+    MgCurveFitter* p = (MgCurveFitter*)data;
+    
+    if (!curve[0].isDegenerate()) {             // 忽略退化点处的分隔标记
+        p->_tail.insert(p->_tail.end(), curve, curve + 4);
+    }
+}
+
+void MgCurveFitter::fitTail()
+{
+    _tail.clear();
+    if (_points.size() > 1) {
+        FitCurveFromF(appendCurve, this, &_points.front(), (int)_points.size(), _tol, _tangent);
+    }
+}
+
+void MgCurveFitter::freeze(int count)
+{
+    if (count <= 0 || _tail.empty())
+        return;
+    
+    const Point2d* last = &_tail[(count - 1) * 4];
+    size_t start = 0;
+    
+    while (start + 1 < _points.size() && _points[start] != last[3]) {
+        start++;
+    }
+    _tangent = (last[3] - last[2]).unitVector();
+    _frozen.insert(_frozen.end(), _tail.begin(), _tail.begin() + count * 4);
+    _tail.erase(_tail.begin(), _tail.begin() + count * 4);
+    _points.erase(_points.begin(), _points.begin() + start);    // 新的末尾从固定段的终点开始
+}
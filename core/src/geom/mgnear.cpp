@@ -5,6 +5,17 @@
 #include "mgcurv.h"
 #include "mglnrel.h"
 
+// 曲线段的绑定框与公差框相交，且比当前最近距离近，才需要精确计算最近点
+static inline bool isNearerBox(const Box2d& box, const Box2d& rect,
+                               const Point2d& pt, float distMin)
+{
+    if (!rect.isIntersect(box))
+        return false;
+    const float dx = pt.x < box.xmin ? box.xmin - pt.x : (pt.x > box.xmax ? pt.x - box.xmax : 0.f);
+    const float dy = pt.y < box.ymin ? box.ymin - pt.y : (pt.y > box.ymax ? pt.y - box.ymax : 0.f);
+    return dx * dx + dy * dy < distMin * distMin;
+}
+
 Box2d mgnear::bezierBox1(const Point2d points[4])
 {
     return bezierBox4(points[0], points[1], points[2], points[3]);
@@ -97,7 +108,7 @@ float mgnear::cubicSplinesHit(
         
         for (int i = 0; i + 1 < n2; i++) {
             mgcurv::cubicSplineToBezier(n, knots, knotvs, i, pts, hermite);
-            if (rect.isIntersect(bezierBox1(pts))) {
+            if (isNearerBox(bezierBox1(pts), rect, pt, distMin)) {
                 dist = mgnear::nearestOnBezier(pt, pts, ptTemp);
                 if (dist < distMin) {
                     distMin = dist;
@@ -108,7 +119,7 @@ float mgnear::cubicSplinesHit(
         }
     } else {
         for (int i = 0; i + 3 < n; i += 3) {
-            if (rect.isIntersect(bezierBox1(knots + i))) {
+            if (isNearerBox(bezierBox1(knots + i), rect, pt, distMin)) {
                 dist = mgnear::nearestOnBezier(pt, knots + i, ptTemp);
                 if (dist < distMin) {
                     distMin = dist;
@@ -142,7 +153,7 @@ float mgnear::quadSplinesHit(int n, const Point2d* knots, bool closed,
             pts[2] = knots[i+2];
         
         mgcurv::quadBezierToCubic(pts, pts + 3);
-        if (rect.isIntersect(bezierBox1(pts + 3))) {
+        if (isNearerBox(bezierBox1(pts + 3), rect, pt, distMin)) {
             dist = mgnear::nearestOnBezier(pt, pts + 3, ptTemp);
             if (dist < distMin) {
                 distMin = dist;
@@ -405,15 +416,25 @@ static float computeCubicBaseValue(float t, float a, float b, float c, float d)
     return v2*v*a + 3*v2*t*b + 3*v*t2*c + t2*t*d;
 }
 
-// compute the value for the first derivative of the cubic bezier function at time=t
+// compute the roots of the first derivative of the cubic bezier function: A t^2 + B t + C = 0
+// The quadratic degenerates to a linear equation for curves elevated from quadratic ones.
 static Point2d computeCubicFirstDerivativeRoots(float a, float b, float c, float d) {
     Point2d ret (-1, -1);
-    float tl = -a+2*b-c;
-    float tr = -sqrtf(-a*(c-d) + b*b - b*(c+d) +c*c);
-    float dn = -a+3*b-3*c+d;
-    if (dn != 0) {
-        ret.x = (tl+tr)/dn;
-        ret.y = (tl-tr)/dn;
+    const float A = -a+3*b-3*c+d;
+    const float B = 2*(a-2*b+c);
+    const float C = b-a;
+    
+    if (fabsf(A) <= 1e-6f * (fabsf(B) + fabsf(C))) {
+        if (B != 0)
+            ret.x = -C/B;
+    } else {
+        const float disc = B*B - 4*A*C;
+        if (disc >= 0) {
+            const float q = -0.5f * (B + (B < 0 ? -sqrtf(disc) : sqrtf(disc)));
+            ret.x = q/A;
+            if (q != 0)
+                ret.y = C/q;
+        }
     }
     return ret;
 }
@@ -5,6 +5,7 @@
 #include "mgcurv.h"
 #include <vector>
 #include <list>
+#include <algorithm>
 
 // 返回STL数组(vector)变量的元素个数
 template<class T> inline static int getSize(T& arr)
@@ -12,6 +13,27 @@ template<class T> inline static int getSize(T& arr)
     return static_cast<int>(arr.size());
 }
 
+//! MgPath的弧长表，记录各段的累计长度和曲线段的参数-弧长采样
+struct MgPathLengths
+{
+    static const int kSamples = 16;         //!< 每个曲线段的参数等分数
+    
+    struct Seg {
+        Point2d     pts[4];                 //!< 控制点，直线段只用首末点
+        float       start;                  //!< 段起点处的累计长度
+        float       length;                 //!< 段长度
+        int         index;                  //!< 段起点序号
+        int         sample;                 //!< 曲线段在 samples 中的起始位置，直线段或未采样时为-1
+        bool        curve;                  //!< 是否为曲线段
+        
+        bool operator<(const Seg& s) const { return index < s.index; }
+    };
+    
+    std::vector<Seg>        segs;           //!< 按段起点序号排序的路径段
+    std::vector<float>      samples;        //!< 曲线段各等分参数处的段内弧长，每段 kSamples+1 个
+    float                   length;         //!< 路径总长度
+};
+
 //! MgPath的内部数据类
 struct MgPathImpl
 {
@@ -19,6 +41,17 @@ public:
     std::vector<Point2d>    points;         //!< 每个节点的坐标
     std::vector<char>       types;          //!< 每个节点的类型, kMgLineTo 等
     int                     beginIndex;     //!< 新图形的起始节点(即MOVETO节点)的序号
+    MgPathLengths*          lengths;        //!< cacheLengths() 建立的弧长表，修改路径后清除
+    
+    MgPathImpl() : lengths((MgPathLengths*)0) {}
+    ~MgPathImpl() { delete lengths; }
+    
+    void clearLengths() {
+        if (lengths) {
+            delete lengths;
+            lengths = (MgPathLengths*)0;
+        }
+    }
 };
 
 MgPath::MgPath()
@@ -100,6 +133,7 @@ MgPath& MgPath::copy(const MgPath& src)
 
 MgPath& MgPath::append(const MgPath& src)
 {
+    m_data->clearLengths();
     if (this != &src && src.getCount() > 1 && getCount() > 1) {
         size_t i = 0;
         
@@ -108,7 +142,7 @@ MgPath& MgPath::append(const MgPath& src)
             && getEndPoint() == src.getPoint(0)) {
             i++;    // skip moveto
         }
-        for (; i < m_data->types.size(); i++) {
+        for (; i < src.m_data->types.size(); i++) {
             m_data->points.push_back(src.m_data->points[i]);
             m_data->types.push_back(src.m_data->types[i]);
         }
@@ -118,6 +152,7 @@ MgPath& MgPath::append(const MgPath& src)
 
 MgPath& MgPath::reverse()
 {
+    m_data->clearLengths();
     if (getSubPathCount() > 1) {
         MgPath subpath;
         std::list<MgPath> paths;
@@ -152,6 +187,7 @@ MgPath& MgPath::reverse()
 
 void MgPath::setPath(int count, const Point2d* points, const char* types)
 {
+    m_data->clearLengths();
     if (getCount() != count) {
         clear();
         if (count > 0 && points && types) {
@@ -172,6 +208,7 @@ void MgPath::setPath(int count, const Point2d* points, const char* types)
 
 void MgPath::setPath(int count, const Point2d* points, const int* types)
 {
+    m_data->clearLengths();
     if (getCount() != count) {
         clear();
         if (count > 0 && points && types) {
@@ -251,6 +288,7 @@ Point2d MgPath::getPoint(int index) const
 
 void MgPath::setPoint(int index, const Point2d& pt)
 {
+    m_data->clearLengths();
     if (index >= 0 && index < getCount())
         m_data->points[index] = pt;
 }
@@ -299,6 +337,7 @@ bool MgPath::isClosed() const
 
 void MgPath::clear()
 {
+    m_data->clearLengths();
     m_data->points.clear();
     m_data->types.clear();
     m_data->beginIndex = -1;
@@ -306,6 +345,7 @@ void MgPath::clear()
 
 void MgPath::transform(const Matrix2d& mat)
 {
+    m_data->clearLengths();
     for (unsigned i = 0; i < m_data->points.size(); i++) {
         m_data->points[i] *= mat;
     }
@@ -318,6 +358,7 @@ void MgPath::startFigure()
 
 bool MgPath::moveTo(const Point2d& point, bool rel)
 {
+    m_data->clearLengths();
     if (!m_data->types.empty() && m_data->types.back() == kMgMoveTo) {
         m_data->points.pop_back();
         m_data->types.pop_back();
@@ -331,6 +372,7 @@ bool MgPath::moveTo(const Point2d& point, bool rel)
 
 bool MgPath::lineTo(const Point2d& point, bool rel)
 {
+    m_data->clearLengths();
     bool ret = (m_data->beginIndex >= 0);
     if (ret) {
         m_data->points.push_back(rel ? point + getEndPoint() : point);
@@ -342,6 +384,7 @@ bool MgPath::lineTo(const Point2d& point, bool rel)
 
 bool MgPath::horzTo(float x, bool rel)
 {
+    m_data->clearLengths();
     Point2d pt(getEndPoint());
     bool ret = (m_data->beginIndex >= 0);
     
@@ -356,6 +399,7 @@ bool MgPath::horzTo(float x, bool rel)
 
 bool MgPath::vertTo(float y, bool rel)
 {
+    m_data->clearLengths();
     Point2d pt(getEndPoint());
     bool ret = (m_data->beginIndex >= 0);
     
@@ -370,6 +414,7 @@ bool MgPath::vertTo(float y, bool rel)
 
 bool MgPath::linesTo(int count, const Point2d* points, bool rel)
 {
+    m_data->clearLengths();
     bool ret = (m_data->beginIndex >= 0 && count > 0 && points);
     Point2d lastpt(getEndPoint());
     
@@ -385,6 +430,7 @@ bool MgPath::linesTo(int count, const Point2d* points, bool rel)
 
 bool MgPath::beziersTo(int count, const Point2d* points, bool reverse, bool rel)
 {
+    m_data->clearLengths();
     bool ret = (m_data->beginIndex >= 0 && count > 0 && points
         && (count % 3) == 0);
     Point2d lastpt(getEndPoint());
@@ -407,6 +453,7 @@ bool MgPath::beziersTo(int count, const Point2d* points, bool reverse, bool rel)
 
 bool MgPath::bezierTo(const Point2d& cp1, const Point2d& cp2, const Point2d& end, bool rel)
 {
+    m_data->clearLengths();
     Point2d lastpt(getEndPoint());
     
     m_data->points.push_back(rel ? cp1 + lastpt : cp1);
@@ -420,6 +467,7 @@ bool MgPath::bezierTo(const Point2d& cp1, const Point2d& cp2, const Point2d& end
 
 bool MgPath::smoothBezierTo(const Point2d& cp2, const Point2d& end, bool rel)
 {
+    m_data->clearLengths();
     Point2d lastpt(getEndPoint());
     Point2d cp1(m_data->points.size() > 1 ? 2 * lastpt -
                 m_data->points[m_data->points.size() - 2].asVector() : lastpt);
@@ -435,6 +483,7 @@ bool MgPath::smoothBezierTo(const Point2d& cp2, const Point2d& end, bool rel)
 
 bool MgPath::quadsTo(int count, const Point2d* points, bool rel)
 {
+    m_data->clearLengths();
     bool ret = (m_data->beginIndex >= 0 && count > 0 && points
                 && (count % 2) == 0);
     Point2d lastpt(getEndPoint());
@@ -451,6 +500,7 @@ bool MgPath::quadsTo(int count, const Point2d* points, bool rel)
 
 bool MgPath::quadTo(const Point2d& cp, const Point2d& end, bool rel)
 {
+    m_data->clearLengths();
     Point2d lastpt(getEndPoint());
     
     m_data->points.push_back(rel ? cp + lastpt : cp);
@@ -462,6 +512,7 @@ bool MgPath::quadTo(const Point2d& cp, const Point2d& end, bool rel)
 
 bool MgPath::smoothQuadTo(const Point2d& end, bool rel)
 {
+    m_data->clearLengths();
     Point2d lastpt(getEndPoint());
     Point2d cp(m_data->points.size() > 1 ? 2 * lastpt -
                m_data->points[m_data->points.size() - 2].asVector() : lastpt);
@@ -475,6 +526,7 @@ bool MgPath::smoothQuadTo(const Point2d& end, bool rel)
 
 bool MgPath::arcTo(const Point2d& point, bool rel)
 {
+    m_data->clearLengths();
     bool ret = false;
 
     if (m_data->beginIndex >= 0 
@@ -506,6 +558,7 @@ bool MgPath::arcTo(const Point2d& point, bool rel)
 
 bool MgPath::arcTo(const Point2d& point, const Point2d& end, bool rel)
 {
+    m_data->clearLengths();
     bool ret = false;
     Point2d lastpt(getEndPoint());
 
@@ -538,6 +591,7 @@ bool MgPath::arcTo(const Point2d& point, const Point2d& end, bool rel)
 
 bool MgPath::closeFigure()
 {
+    m_data->clearLengths();
     bool ret = false;
 
     if (m_data->beginIndex >= 0 
@@ -738,6 +792,62 @@ bool MgPath::scanSegments(MgSegmentCallback& c) const
     return ret;
 }
 
+// 遍历路径段时求段起点在整个路径中的序号。多个子路径时 scanSegments 按逆序遍历子路径，
+// 且 startIndex 为子路径内的序号，需加上子路径的起始序号
+struct MgPathIndexedCallback : MgPath::MgSegmentCallback {
+    std::vector<int>    starts;     // 各子路径的起始序号
+    int                 subpath;
+    int                 offset;
+    
+    MgPathIndexedCallback(const MgPath& path) : subpath(0), offset(0) {
+        const char* types = path.getTypes();
+        for (int i = 0; i < path.getCount(); i++) {
+            if (types[i] == kMgMoveTo)
+                starts.push_back(i);
+        }
+    }
+    
+    virtual void beginSubPath() {
+        int n = (int)starts.size();
+        offset = n > 1 && subpath < n ? starts[n - 1 - subpath] : 0;
+        subpath++;
+    }
+};
+
+// 三次贝塞尔曲线段在参数 t 处的速率，即导矢长度
+static inline float bezierSpeed(const Point2d* pts, float t)
+{
+    Point2d d;
+    mgcurv::bezierTanget(pts, t, d);
+    return d.asVector().length();
+}
+
+// 三次贝塞尔曲线段在参数区间 [t0, t1] 的弧长，用5点Gauss-Legendre积分
+static float bezierLengthBetween(const Point2d* pts, float t0, float t1)
+{
+    static const float x[] = { 0.f, -0.5384693101f, 0.5384693101f, -0.9061798459f, 0.9061798459f };
+    static const float w[] = { 0.5688888889f, 0.4786286705f, 0.4786286705f,
+                               0.2369268851f, 0.2369268851f };
+    const float half = (t1 - t0) / 2, mid = (t0 + t1) / 2;
+    float sum = 0;
+    
+    for (int i = 0; i < 5; i++) {
+        sum += w[i] * bezierSpeed(pts, mid + half * x[i]);
+    }
+    return sum * half;
+}
+
+// 曲线段各等分参数处的段内弧长，samples 有 kSamples+1 个
+static void sampleBezier(const Point2d* pts, float* samples)
+{
+    const int n = MgPathLengths::kSamples;
+    
+    samples[0] = 0;
+    for (int i = 0; i < n; i++) {
+        samples[i + 1] = samples[i] + bezierLengthBetween(pts, (float)i / n, (float)(i + 1) / n);
+    }
+}
+
 //! The callback class for getLength()
 struct MgPathLengthCallback : MgPath::MgSegmentCallback {
     float length;
@@ -754,13 +864,200 @@ struct MgPathLengthCallback : MgPath::MgSegmentCallback {
     }
 };
 
+//! The callback class for buildLengths()
+struct MgPathLengthTableCallback : MgPathIndexedCallback {
+    MgPathLengths*  p;
+    bool            sampled;    // 是否为曲线段建立参数-弧长采样
+    
+    MgPathLengthTableCallback(const MgPath& path, MgPathLengths* p, bool sampled)
+        : MgPathIndexedCallback(path), p(p), sampled(sampled) {}
+    
+    virtual bool processLine(int startIndex, int&, const Point2d& startpt, const Point2d& endpt) {
+        MgPathLengths::Seg seg = MgPathLengths::Seg();
+        
+        seg.pts[0] = seg.pts[1] = startpt;
+        seg.pts[2] = seg.pts[3] = endpt;
+        seg.length = startpt.distanceTo(endpt);
+        seg.index = offset + startIndex;
+        seg.sample = -1;
+        seg.curve = false;
+        p->segs.push_back(seg);
+        return true;
+    }
+    virtual bool processBezier(int startIndex, int&, const Point2d* pts) {
+        MgPathLengths::Seg seg = MgPathLengths::Seg();
+        
+        for (int i = 0; i < 4; i++) {
+            seg.pts[i] = pts[i];
+        }
+        seg.length = mgcurv::lengthOfBezier(pts);
+        seg.index = offset + startIndex;
+        seg.sample = -1;
+        seg.curve = true;
+        if (sampled) {
+            seg.sample = (int)p->samples.size();
+            p->samples.resize(p->samples.size() + MgPathLengths::kSamples + 1);
+            sampleBezier(pts, &p->samples[seg.sample]);
+        }
+        p->segs.push_back(seg);
+        return true;
+    }
+    
+    MgPathLengthTableCallback(const MgPathLengthTableCallback&);
+    MgPathLengthTableCallback& operator=(const MgPathLengthTableCallback&);
+};
+
+// 建立弧长表，sampled 为 false 时只记录各段长度，曲线段在查询时临时采样
+static void buildLengths(const MgPath& path, MgPathLengths* p, bool sampled)
+{
+    MgPathLengthTableCallback c(path, p, sampled);
+    
+    path.scanSegments(c);
+    std::sort(p->segs.begin(), p->segs.end());
+    p->length = 0;
+    for (size_t i = 0; i < p->segs.size(); i++) {
+        p->segs[i].start = p->length;
+        p->length += p->segs[i].length;
+    }
+}
+
+void MgPath::cacheLengths()
+{
+    if (!m_data->lengths) {
+        MgPathLengths* p = new MgPathLengths();
+        buildLengths(*this, p, true);
+        m_data->lengths = p;
+    }
+}
+
 float MgPath::getLength() const
 {
+    if (m_data->lengths) {
+        return m_data->lengths->length;
+    }
+    
     MgPathLengthCallback c;
     scanSegments(c);
     return c.length;
 }
 
+// 由曲线段内的弧长求参数，先在采样表中插值，再用牛顿法修正一次
+static float bezierParamAtLength(const Point2d* pts, const float* samples, float s)
+{
+    const int n = MgPathLengths::kSamples;
+    int i = (int)(std::upper_bound(samples, samples + n + 1, s) - samples) - 1;
+    
+    if (i < 0) {
+        return 0.f;
+    }
+    if (i >= n) {
+        return 1.f;
+    }
+    
+    const float t0 = (float)i / n, t1 = (float)(i + 1) / n;
+    const float ds = samples[i + 1] - samples[i];
+    float t = ds > _MGZERO ? t0 + (t1 - t0) * (s - samples[i]) / ds : t0;
+    float speed = bezierSpeed(pts, t);
+    
+    if (speed > _MGZERO) {
+        t -= (samples[i] + bezierLengthBetween(pts, t0, t) - s) / speed;
+        t = mgMax(t0, mgMin(t1, t));
+    }
+    return t;
+}
+
+// 未建立采样的曲线段在查询时临时采样，按弧长递增连续查询同一段时复用
+struct MgPathSampleBuffer {
+    int     seg;
+    float   samples[MgPathLengths::kSamples + 1];
+    
+    MgPathSampleBuffer() : seg(-1) {}
+};
+
+static bool pointAtLength(const MgPathLengths* p, float dist, Point2d& pt, Vector2d* tangent,
+                          MgPathSampleBuffer& buf)
+{
+    if (p->segs.empty()) {
+        return false;
+    }
+    
+    // 二分查找弧长所在的段
+    int lo = 0, hi = (int)p->segs.size() - 1;
+    
+    dist = mgMax(0.f, mgMin(p->length, dist));
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (p->segs[mid].start <= dist)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    
+    const MgPathLengths::Seg& seg = p->segs[lo];
+    float s = dist - seg.start;
+    
+    if (!seg.curve) {
+        float t = seg.length > _MGZERO ? mgMin(1.f, s / seg.length) : 0.f;
+        pt = seg.pts[0] + (seg.pts[3] - seg.pts[0]) * t;
+        if (tangent) {
+            *tangent = (seg.pts[3] - seg.pts[0]).unitVector();
+        }
+    } else {
+        if (seg.sample < 0 && buf.seg != lo) {
+            buf.seg = lo;
+            sampleBezier(seg.pts, buf.samples);
+        }
+        
+        // 段长度由 lengthOfBezier 求出，与采样的末项略有差别，按比例换算
+        const float* samples = seg.sample < 0 ? buf.samples : &p->samples[seg.sample];
+        const float total = samples[MgPathLengths::kSamples];
+        float t = bezierParamAtLength(seg.pts, samples,
+                                      seg.length > _MGZERO ? s * total / seg.length : 0.f);
+        mgcurv::fitBezier(seg.pts, t, pt);
+        if (tangent) {
+            Point2d d;
+            mgcurv::bezierTanget(seg.pts, t, d);
+            *tangent = (d.asVector().isZeroVector() ? seg.pts[3] - seg.pts[0]
+                        : d.asVector()).unitVector();
+        }
+    }
+    
+    return true;
+}
+
+// 有 cacheLengths() 建立的弧长表时直接使用，否则在 tmp 中临时记录各段长度，const 函数不修改路径
+static const MgPathLengths* getLengths(const MgPath& path, const MgPathImpl* impl, MgPathLengths& tmp)
+{
+    if (impl->lengths) {
+        return impl->lengths;
+    }
+    buildLengths(path, &tmp, false);
+    return &tmp;
+}
+
+bool MgPath::getPointAtLength(float dist, Point2d& pt, Vector2d* tangent) const
+{
+    MgPathLengths tmp;
+    MgPathSampleBuffer buf;
+    return pointAtLength(getLengths(*this, m_data, tmp), dist, pt, tangent, buf);
+}
+
+int MgPath::getEvenPoints(int count, Point2d* pts) const
+{
+    MgPathLengths tmp;
+    MgPathSampleBuffer buf;
+    const MgPathLengths* p = count < 2 || !pts ? (const MgPathLengths*)0
+        : getLengths(*this, m_data, tmp);
+    
+    if (!p || p->segs.empty()) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        pointAtLength(p, p->length * i / (count - 1), pts[i], (Vector2d*)0, buf);
+    }
+    return count;
+}
+
 //! The callback class for trimStart()
 struct MgPathTrimCallback : MgPath::MgSegmentCallback {
     MgPathImpl  *p;
@@ -816,6 +1113,7 @@ struct MgPathTrimCallback : MgPath::MgSegmentCallback {
 
 bool MgPath::trimStart(const Point2d& pt, float dist)
 {
+    m_data->clearLengths();
     if (getCount() < 2 || getNodeType(0) != kMgMoveTo || isClosed()
         || dist < _MGZERO || getSubPathCount() != 1) {
         return false;
@@ -829,87 +1127,311 @@ bool MgPath::trimStart(const Point2d& pt, float dist)
 
 #include "mglnrel.h"
 
-//! The callback class for getLength()
-struct MgPathCrossCallback : MgPath::MgSegmentCallback {
-    const Box2d     &box;
-    Point2d         &crosspt;
-    Point2d         a, b;
+// 求交用的路径段，直线段也按参数均匀的三次曲线保存控制点
+struct MgCrossSeg {
+    Point2d pts[4];
+    Box2d   box;
+    int     index;      // 段起点序号
+    int     which;      // 0: 本路径，1: 另一路径
+    bool    curve;
+};
+
+// 收集两个路径的段用于求交
+struct MgCrossSegCollector : MgPathIndexedCallback {
+    std::vector<MgCrossSeg>&    segs;
+    const Box2d*                box;
+    float                       tol;
+    int                         which;
     
-    Point2d         tmpcross;
-    float           mindist;
-    float           dist;
+    MgCrossSegCollector(std::vector<MgCrossSeg>& segs, const MgPath& path, int which,
+                        const Box2d* box, float tol)
+        : MgPathIndexedCallback(path), segs(segs), box(box), tol(tol), which(which) {}
     
-    MgPathCrossCallback(const Box2d &box, Point2d &crosspt)
-        : box(box), crosspt(crosspt), mindist(_FLT_MAX) {}
+    virtual bool processLine(int startIndex, int&, const Point2d& startpt, const Point2d& endpt) {
+        Point2d pts[4] = { startpt, (2 * startpt + endpt) / 3, (startpt + 2 * endpt) / 3, endpt };
+        add(startIndex, pts, false);
+        return true;
+    }
     
-    virtual bool processLine(int, int&, const Point2d& startpt, const Point2d& endpt) {
-        if (box.contains(Box2d(startpt, endpt))
-            && mglnrel::cross2Line(startpt, endpt, a, b, tmpcross)) {
-            dist = tmpcross.distanceTo(box.center());
-            if (mindist > dist) {
-                mindist = dist;
-                crosspt = tmpcross;
-            }
-        }
+    virtual bool processBezier(int startIndex, int&, const Point2d* pts) {
+        add(startIndex, pts, true);
         return true;
     }
     
-    virtual bool processBezier(int, int&, const Point2d* pts) {
-        float t = 0;
+    void add(int startIndex, const Point2d* pts, bool curve) {
+        MgCrossSeg seg;
         
-        if (box.contains(Box2d(4, pts))
-            && mgcurv::bezierIntersectionWithLine(pts, a, b, t)) {
-            mgcurv::fitBezier(pts, t, tmpcross);
-            dist = tmpcross.distanceTo(box.center());
-            if (mindist > dist) {
-                mindist = dist;
-                crosspt = tmpcross;
+        seg.box.set(4, pts);
+        if (box && (seg.box.xmin > box->xmax + tol || seg.box.xmax < box->xmin - tol
+                    || seg.box.ymin > box->ymax + tol || seg.box.ymax < box->ymin - tol)) {
+            return;
+        }
+        for (int i = 0; i < 4; i++) {
+            seg.pts[i] = pts[i];
+        }
+        seg.index = offset + startIndex;
+        seg.which = which;
+        seg.curve = curve;
+        segs.push_back(seg);
+    }
+    
+    MgCrossSegCollector(const MgCrossSegCollector&);
+    MgCrossSegCollector& operator=(const MgCrossSegCollector&);
+};
+
+struct MgCrossSegLess {
+    const std::vector<MgCrossSeg>& segs;
+    MgCrossSegLess(const std::vector<MgCrossSeg>& segs) : segs(segs) {}
+    bool operator()(int a, int b) const { return segs[a].box.xmin < segs[b].box.xmin; }
+    MgCrossSegLess& operator=(const MgCrossSegLess&);
+};
+
+static bool lessCrossPoint(const MgPathCrossPoint& a, const MgPathCrossPoint& b)
+{
+    return a.segment1 < b.segment1 || (a.segment1 == b.segment1 && a.t1 < b.t1);
+}
+
+static inline bool isBoxOverlap(const Box2d& a, const Box2d& b, float tol)
+{
+    return !(a.xmin > b.xmax + tol || a.xmax < b.xmin - tol
+             || a.ymin > b.ymax + tol || a.ymax < b.ymin - tol);
+}
+
+// 交点在线段或细分区间的端点附近，可能在相邻的段或区间中重复得到
+static inline bool isNearEnd(float u, float v)
+{
+    const float e = 1e-3f;
+    return u < e || u > 1 - e || v < e || v > 1 - e;
+}
+
+// 同一段的细分边界，或一段的终点为另一段的起点
+static inline bool isJoined(int seg1, float t1, int seg2, float t2)
+{
+    const float e = 1e-3f;
+    return seg1 == seg2 || (t1 > 1 - e && t2 < e) || (t1 < e && t2 > 1 - e);
+}
+
+// 两个路径段的求交上下文
+struct MgCrossContext {
+    std::vector<MgPathCrossPoint>&  points;
+    std::vector<int>                ends;       // 在端点附近得到的交点的序号
+    const Box2d*                    box;
+    float                           tol;
+    int                             segment1;
+    int                             segment2;
+    
+    MgCrossContext(std::vector<MgPathCrossPoint>& points, const Box2d* box, float tol)
+        : points(points), box(box), tol(tol), segment1(0), segment2(0) {}
+    
+    // nearEnd 为交点在线段或细分区间的端点附近，只在这样的交点间去重，相距很近的不同交点都保留
+    void add(const Point2d& pt, float t1, float t2, bool nearEnd) {
+        if (!box || box->contains(pt)) {
+            MgPathCrossPoint cp;
+            cp.pt = pt;
+            cp.segment1 = segment1;
+            cp.segment2 = segment2;
+            cp.t1 = mgMax(0.f, mgMin(1.f, t1));
+            cp.t2 = mgMax(0.f, mgMin(1.f, t2));
+            if (nearEnd) {
+                ends.push_back((int)points.size());
             }
+            points.push_back(cp);
         }
-        return true;
     }
+    
+    void removeDuplicates();
+    MgCrossContext& operator=(const MgCrossContext&);
+};
 
-    MgPathCrossCallback(const MgPathCrossCallback&);
-    MgPathCrossCallback& operator=(const MgPathCrossCallback&);
+struct MgCrossPointLess {
+    const std::vector<MgPathCrossPoint>& points;
+    MgCrossPointLess(const std::vector<MgPathCrossPoint>& points) : points(points) {}
+    bool operator()(int a, int b) const { return points[a].pt.x < points[b].pt.x; }
+    MgCrossPointLess& operator=(const MgCrossPointLess&);
 };
 
-bool MgPath::crossWithPath(const MgPath& p, const Box2d& box, Point2d& ptCross) const
+// 去掉在段的连接点或细分边界处重复得到的交点，端点附近的交点按x排序后只比较相距在容差内的
+void MgCrossContext::removeDuplicates()
 {
-    MgPathCrossCallback cc(box, ptCross);
+    std::vector<bool> removed(points.size(), false);
     
-    if (isLine() && p.isLine()) {
-        return (mglnrel::cross2Line(getPoint(0), getPoint(1),
-                                    p.getPoint(0), p.getPoint(1), ptCross)
-                && box.contains(ptCross));
+    std::sort(ends.begin(), ends.end(), MgCrossPointLess(points));
+    for (size_t i = 0; i < ends.size(); i++) {
+        const MgPathCrossPoint& a = points[ends[i]];
+        
+        for (size_t j = i + 1; j < ends.size() && points[ends[j]].pt.x - a.pt.x <= 2 * tol; j++) {
+            const MgPathCrossPoint& b = points[ends[j]];
+            
+            if (!removed[ends[i]] && a.pt.distanceTo(b.pt) <= 2 * tol
+                && isJoined(a.segment1, a.t1, b.segment1, b.t1)
+                && isJoined(a.segment2, a.t2, b.segment2, b.t2)) {
+                removed[ends[j]] = true;
+            }
+        }
+    }
+    
+    size_t n = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (!removed[i]) {
+            points[n++] = points[i];
+        }
+    }
+    points.resize(n);
+}
+
+// 求两条线段的交点参数，平行的相对容差与线段长度无关，端点处放宽 eps
+static bool crossChords(const Point2d& a, const Point2d& b, const Point2d& c, const Point2d& d,
+                        float eps, float& u, float& v)
+{
+    Vector2d ab(b - a), cd(d - c), ac(c - a);
+    float denom = ab.crossProduct(cd);
+    
+    if (fabsf(denom) <= 1e-6f * ab.length() * cd.length() || denom == 0) {
+        return false;
     }
-    if (isLines() && p.isLines()) {
-        for (int m = getCount() - (isClosed() ? 0 : 1), i = 0; i < m; i++) {
-            Point2d a(getPoint(i)), b(getPoint(i + 1));
+    u = ac.crossProduct(cd) / denom;
+    v = ac.crossProduct(ab) / denom;
+    
+    return u >= -eps && u <= 1 + eps && v >= -eps && v <= 1 + eps;
+}
+
+// 控制点与参数均匀的直线段的偏差都在容差内时视为平直
+static inline bool isFlatBezier(const Point2d* pts, float tol)
+{
+    return (pts[1].distanceTo((2 * pts[0] + pts[3]) / 3) <= tol
+            && pts[2].distanceTo((pts[0] + 2 * pts[3]) / 3) <= tol);
+}
+
+// 递归细分求两条三次曲线段的交点，参数区间为 [a0, a1] 和 [b0, b1]
+static void crossBeziers(MgCrossContext& ctx, const Point2d* p1, float a0, float a1,
+                         const Point2d* p2, float b0, float b1, int depth)
+{
+    if (!isBoxOverlap(Box2d(4, p1), Box2d(4, p2), ctx.tol)) {
+        return;
+    }
+    
+    bool flat1 = isFlatBezier(p1, ctx.tol);
+    bool flat2 = isFlatBezier(p2, ctx.tol);
+    
+    if ((flat1 && flat2) || depth > 30) {
+        float u, v;
+        if (crossChords(p1[0], p1[3], p2[0], p2[3], 1e-3f, u, v)) {
+            const bool nearEnd = isNearEnd(u, v);
+            u = mgMax(0.f, mgMin(1.f, u));
+            ctx.add(p1[0] + (p1[3] - p1[0]) * u, a0 + (a1 - a0) * u, b0 + (b1 - b0) * v, nearEnd);
+        }
+        return;
+    }
+    
+    Point2d h1[4], h2[4];
+    
+    if (!flat1 && (flat2 || (a1 - a0) >= (b1 - b0)
+                   || p1[0].distanceTo(p1[3]) >= p2[0].distanceTo(p2[3]))) {
+        float am = (a0 + a1) / 2;
+        mgcurv::splitBezier(p1, 0.5f, h1, h2);
+        crossBeziers(ctx, h1, a0, am, p2, b0, b1, depth + 1);
+        crossBeziers(ctx, h2, am, a1, p2, b0, b1, depth + 1);
+    } else {
+        float bm = (b0 + b1) / 2;
+        mgcurv::splitBezier(p2, 0.5f, h1, h2);
+        crossBeziers(ctx, p1, a0, a1, h1, b0, bm, depth + 1);
+        crossBeziers(ctx, p1, a0, a1, h2, bm, b1, depth + 1);
+    }
+}
+
+static void crossSegments(MgCrossContext& ctx, const MgCrossSeg& s1, const MgCrossSeg& s2)
+{
+    ctx.segment1 = s1.index;
+    ctx.segment2 = s2.index;
+    
+    if (!s1.curve && !s2.curve) {
+        float u, v;
+        if (crossChords(s1.pts[0], s1.pts[3], s2.pts[0], s2.pts[3], 1e-5f, u, v)) {
+            ctx.add(s1.pts[0] + (s1.pts[3] - s1.pts[0]) * u, u, v, isNearEnd(u, v));
+        }
+    } else {
+        crossBeziers(ctx, s1.pts, 0, 1, s2.pts, 0, 1, 0);
+    }
+}
+
+int MgPath::crossWithPath(const MgPath& p, std::vector<MgPathCrossPoint>& points,
+                          const Box2d* box) const
+{
+    points.clear();
+    if (getCount() < 2 || p.getCount() < 2) {
+        return 0;
+    }
+    
+    Box2d rect(getCount(), getPoints());
+    rect.unionWith(Box2d(p.getCount(), p.getPoints()));
+    const float tol = _MGZERO + mgMax(1e-5f * mgMax(rect.width(), rect.height()),
+                                      1e-6f * mgMax(mgMax(fabsf(rect.xmin), fabsf(rect.xmax)),
+                                                    mgMax(fabsf(rect.ymin), fabsf(rect.ymax))));
+    std::vector<MgCrossSeg> segs;
+    std::vector<int> order, active[2];
+    MgCrossSegCollector c1(segs, *this, 0, box, tol);
+    MgCrossSegCollector c2(segs, p, 1, box, tol);
+    
+    scanSegments(c1);
+    p.scanSegments(c2);
+    
+    // 按包络框左边排序扫描，活动表中只保留右边未越过扫描线的段，只对另一路径的活动段求交
+    order.resize(segs.size());
+    for (size_t i = 0; i < segs.size(); i++) {
+        order[i] = (int)i;
+    }
+    std::sort(order.begin(), order.end(), MgCrossSegLess(segs));
+    
+    MgCrossContext ctx(points, box, tol);
+    
+    for (size_t i = 0; i < order.size(); i++) {
+        const MgCrossSeg& seg = segs[order[i]];
+        std::vector<int>& others = active[1 - seg.which];
+        
+        for (size_t k = 0; k < others.size(); ) {
+            const MgCrossSeg& other = segs[others[k]];
             
-            for (int n = p.getCount() - (p.isClosed() ? 0 : 1), j = 0; j < n; j++) {
-                Point2d c(p.getPoint(j)), d(p.getPoint(j + 1));
-                
-                if (mglnrel::cross2Line(a, b, c, d, cc.tmpcross)
-                    && box.contains(cc.tmpcross)) {
-                    float dist = cc.tmpcross.distanceTo(box.center());
-                    if (cc.mindist > dist) {
-                        cc.mindist = dist;
-                        ptCross = cc.tmpcross;
-                    }
-                }
+            if (other.box.xmax < seg.box.xmin - tol) {
+                others[k] = others.back();
+                others.pop_back();
+                continue;
+            }
+            if (isBoxOverlap(seg.box, other.box, tol)) {
+                if (seg.which == 0)
+                    crossSegments(ctx, seg, other);
+                else
+                    crossSegments(ctx, other, seg);
             }
+            k++;
         }
+        active[seg.which].push_back(order[i]);
     }
-    else if (isLine() && p.getSubPathCount() == 1) {
-        cc.a = getPoint(0);
-        cc.b = getPoint(1);
-        p.scanSegments(cc);
+    
+    ctx.removeDuplicates();
+    std::sort(points.begin(), points.end(), lessCrossPoint);
+    
+    return (int)points.size();
+}
+
+bool MgPath::crossWithPath(const MgPath& p, const Box2d& box, Point2d& ptCross) const
+{
+    if (isLine() && p.isLine()) {
+        return (mglnrel::cross2Line(getPoint(0), getPoint(1),
+                                    p.getPoint(0), p.getPoint(1), ptCross)
+                && box.contains(ptCross));
     }
-    else if (p.isLine() && getSubPathCount() == 1) {
-        cc.a = p.getPoint(0);
-        cc.b = p.getPoint(1);
-        scanSegments(cc);
+    
+    std::vector<MgPathCrossPoint> points;
+    float mindist = _FLT_MAX;
+    
+    crossWithPath(p, points, &box);
+    for (size_t i = 0; i < points.size(); i++) {
+        float dist = points[i].pt.distanceTo(box.center());
+        if (mindist > dist) {
+            mindist = dist;
+            ptCross = points[i].pt;
+        }
     }
     
-    return cc.mindist < box.width();
+    return mindist < box.width();
 }
@@ -0,0 +1,557 @@
+// mgpathbool.cpp: 实现路径的布尔运算类 MgPathBoolean
+// Copyright (c) 2004-2015, https://github.com/rhcad/vgcore, BSD License
+
+#include "mgpathbool.h"
+#include "mgsegcache.h"
+#include "mgcurv.h"
+#include <vector>
+#include <algorithm>
+
+struct MgBoolEdge {
+    Point2d p1, p2;
+    int     path;       // 所属路径的序号
+};
+
+// 按边中点的Morton码排序，使分块缓存中同一块的边相互靠近
+struct MgBoolEdgeLess {
+    const Box2d& extent;
+    MgBoolEdgeLess(const Box2d& extent) : extent(extent) {}
+    
+    static unsigned spread(unsigned v) {    // 将低16位分散到偶数位
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+    unsigned code(const MgBoolEdge& e) const {
+        const float sx = 65535.f / mgMax(extent.width(), _MGZERO);
+        const float sy = 65535.f / mgMax(extent.height(), _MGZERO);
+        const unsigned x = (unsigned)mgMax(0.f, mgMin(65535.f, ((e.p1.x + e.p2.x) / 2 - extent.xmin) * sx));
+        const unsigned y = (unsigned)mgMax(0.f, mgMin(65535.f, ((e.p1.y + e.p2.y) / 2 - extent.ymin) * sy));
+        return spread(x) | (spread(y) << 1);
+    }
+    bool operator()(const MgBoolEdge& a, const MgBoolEdge& b) const { return code(a) < code(b); }
+    MgBoolEdgeLess& operator=(const MgBoolEdgeLess&);
+};
+
+struct MgBoolSplit {
+    int     edge;
+    float   t;          // 在边上的参数
+    Point2d pt;
+    
+    bool operator<(const MgBoolSplit& s) const {
+        return edge < s.edge || (edge == s.edge && t < s.t);
+    }
+};
+
+struct MgBoolLink {     // 结果中的有向边，端点为合并后的顶点号
+    int     from, to;
+    
+    bool operator<(const MgBoolLink& e) const {
+        return from < e.from || (from == e.from && to < e.to);
+    }
+    bool operator==(const MgBoolLink& e) const { return from == e.from && to == e.to; }
+};
+
+struct MgBoolPointLess {
+    const std::vector<Point2d>& pts;
+    MgBoolPointLess(const std::vector<Point2d>& pts) : pts(pts) {}
+    bool operator()(int a, int b) const { return pts[a].x < pts[b].x; }
+    MgBoolPointLess& operator=(const MgBoolPointLess&);
+};
+
+struct MgPathBoolean::Impl {
+    std::vector<MgPath> paths;
+    std::vector<int>    groups;
+    float               tol;                // 曲线离散的容差
+    
+    std::vector<MgBoolEdge> edges;          // 离散后各路径的边
+    std::vector<Box2d>  boxes;              // 各路径的范围
+    MgSegmentCache      cache;              // 各边的分块缓存，段号为边的序号
+    MgSegmentCache      pathCache;          // 各路径范围的分块缓存，段号为路径的序号
+    Box2d               extent;
+    float               eps;                // 长度容差
+    
+    mutable std::vector<int>    winding;    // 射线法中各路径的环绕数
+    mutable std::vector<int>    through;    // 穿过射线起点的边对各路径环绕数的增量
+    mutable std::vector<int>    candidates; // 范围包含射线起点的路径
+    mutable std::vector<int>    found;
+    
+    void flatten();
+    void splitEdges(std::vector<MgBoolSplit>& splits) const;
+    void classify(const Point2d& start, const Point2d& end, bool left[2], bool right[2]) const;
+    void link(const std::vector<Point2d>& pts, std::vector<MgBoolLink>& links, MgPath& result) const;
+};
+
+// 将路径各子路径离散为闭合折线
+struct MgBoolFlattenCallback : MgPath::MgSegmentCallback {
+    std::vector<MgBoolEdge>&    edges;
+    int                         path;
+    float                       tol;
+    Point2d                     first, last;
+    bool                        started;
+    
+    MgBoolFlattenCallback(std::vector<MgBoolEdge>& edges, int path, float tol)
+        : edges(edges), path(path), tol(tol), started(false) {}
+    
+    virtual void beginSubPath() { started = false; }
+    
+    virtual void endSubPath(bool) {
+        if (started) {
+            add(last, first);   // 未闭合的子路径也按闭合区域处理
+        }
+    }
+    
+    virtual bool processLine(int, int&, const Point2d& startpt, const Point2d& endpt) {
+        add(startpt, endpt);
+        return true;
+    }
+    
+    virtual bool processBezier(int, int&, const Point2d* pts) {
+        // 由二阶差分估计离散段数，使弦高不超过容差
+        float d = mgMax((pts[0] - 2 * pts[1].asVector() + pts[2].asVector()).asVector().length(),
+                        (pts[1] - 2 * pts[2].asVector() + pts[3].asVector()).asVector().length());
+        int n = mgMax(1, mgMin(256, (int)ceilf(sqrtf(0.75f * d / tol))));
+        Point2d prev(pts[0]), pt;
+        
+        for (int i = 1; i <= n; i++) {
+            mgcurv::fitBezier(pts, (float)i / n, pt);
+            add(prev, pt);
+            prev = pt;
+        }
+        return true;
+    }
+    
+    void add(const Point2d& a, const Point2d& b) {
+        if (!started) {
+            first = a;
+            started = true;
+        }
+        if (a != b) {
+            MgBoolEdge e;
+            e.p1 = a;
+            e.p2 = b;
+            e.path = path;
+            edges.push_back(e);
+        }
+        last = b;
+    }
+    
+    MgBoolFlattenCallback& operator=(const MgBoolFlattenCallback&);
+};
+
+void MgPathBoolean::Impl::flatten()
+{
+    extent.empty();
+    for (size_t i = 0; i < paths.size(); i++) {
+        extent.unionWith(Box2d(paths[i].getCount(), paths[i].getPoints()));
+    }
+    
+    const float size = mgMax(extent.width(), extent.height());
+    const float flattenTol = tol > _MGZERO ? tol : mgMax(1e-4f * size, _MGZERO);
+    
+    eps = _MGZERO + mgMax(1e-5f * size,
+                          1e-6f * mgMax(mgMax(fabsf(extent.xmin), fabsf(extent.xmax)),
+                                        mgMax(fabsf(extent.ymin), fabsf(extent.ymax))));
+    edges.clear();
+    cache.clear();
+    for (size_t i = 0; i < paths.size(); i++) {
+        MgBoolFlattenCallback c(edges, (int)i, flattenTol);
+        paths[i].scanSegments(c);
+    }
+    std::sort(edges.begin(), edges.end(), MgBoolEdgeLess(extent));
+    pathCache.clear();
+    boxes.assign(paths.size(), Box2d());
+    for (size_t i = 0; i < edges.size(); i++) {
+        cache.addLine(edges[i].p1, edges[i].p2, (int)i);
+        boxes[edges[i].path].unionWith(Box2d(edges[i].p1, edges[i].p2));    // 空框不含原点
+    }
+    for (size_t i = 0; i < boxes.size(); i++) {
+        if (!boxes[i].isNull()) {
+            boxes[i].inflate(eps);
+            pathCache.addLine(boxes[i].leftBottom(), boxes[i].rightTop(), (int)i);
+        }
+    }
+}
+
+// 求各边与其他边的交点、以及落在边上的其他顶点，作为切分点
+void MgPathBoolean::Impl::splitEdges(std::vector<MgBoolSplit>& splits) const
+{
+    std::vector<int> indices;
+    MgBoolSplit split;
+    
+    for (int i = 0; i < (int)edges.size(); i++) {
+        const MgBoolEdge& e = edges[i];
+        const Vector2d ab(e.p2 - e.p1);
+        const float len2 = ab.lengthSquare();
+        const float teps = eps / sqrtf(len2);
+        
+        cache.findSegments(Box2d(e.p1, e.p2).inflate(eps), indices);
+        for (size_t k = 0; k < indices.size(); k++) {
+            const int j = cache.getSegmentID(indices[k]);
+            if (j == i) {
+                continue;
+            }
+            const MgBoolEdge& f = edges[j];
+            
+            // 另一边的起点落在本边内部，含重合边和T形相接的情况
+            float t = (f.p1 - e.p1).dotProduct(ab) / len2;
+            if (t > teps && t < 1 - teps
+                && fabsf((f.p1 - e.p1).crossProduct(ab)) <= eps * sqrtf(len2)) {
+                split.edge = i;
+                split.t = t;
+                split.pt = f.p1;
+                splits.push_back(split);
+            }
+            
+            // 两边在内部相交，每对边只求一次
+            if (j > i) {
+                const Vector2d cd(f.p2 - f.p1), ac(f.p1 - e.p1);
+                const float denom = ab.crossProduct(cd);
+                
+                if (fabsf(denom) > 1e-6f * sqrtf(len2 * cd.lengthSquare())) {
+                    float u = ac.crossProduct(cd) / denom;
+                    float v = ac.crossProduct(ab) / denom;
+                    float veps = eps / cd.length();
+                    
+                    if (u > teps && u < 1 - teps && v > veps && v < 1 - veps) {
+                        split.pt = e.p1 + ab * u;
+                        split.edge = i;
+                        split.t = u;
+                        splits.push_back(split);
+                        split.edge = j;
+                        split.t = v;
+                        splits.push_back(split);
+                    }
+                }
+            }
+        }
+    }
+    std::sort(splits.begin(), splits.end());
+}
+
+// 点到线段的距离
+static float distanceToEdge(const Point2d& pt, const MgBoolEdge& e)
+{
+    const Vector2d ab(e.p2 - e.p1);
+    const float t = mgMax(0.f, mgMin(1.f, (pt - e.p1).dotProduct(ab) / ab.lengthSquare()));
+    return pt.distanceTo(e.p1 + ab * t);
+}
+
+// 求小段两侧分别是否在两组路径的区域内。从小段中点沿与小段大致垂直的坐标轴方向作射线，
+// 只计入范围包含中点的路径的边。穿过中点的边（小段所在的边及与其重合的边）在射线前方一侧不计入，
+// 在后方一侧计入，这样两侧的结果一致，不受狭长区域的影响
+void MgPathBoolean::Impl::classify(const Point2d& start, const Point2d& end,
+                                   bool left[2], bool right[2]) const
+{
+    const Point2d pt((start + end) / 2);
+    const Vector2d dir(end - start);
+    const bool alongX = fabsf(dir.y) >= fabsf(dir.x);
+    const float tol = mgMin(eps, dir.length() / 4);     // 穿过中点的容差，不含小段端点处相接的边
+    float ahead = 0, behind = 0;
+    
+    left[0] = left[1] = right[0] = right[1] = false;
+    candidates.clear();
+    pathCache.findSegments(Box2d(pt, pt).inflate(eps), found);
+    for (size_t k = 0; k < found.size(); k++) {
+        const int path = pathCache.getSegmentID(found[k]);
+        const Box2d& box = boxes[path];
+        
+        candidates.push_back(path);
+        ahead = mgMax(ahead, alongX ? box.xmax - pt.x : box.ymax - pt.y);
+        behind = mgMax(behind, alongX ? pt.x - box.xmin : pt.y - box.ymin);
+    }
+    if (candidates.empty()) {
+        return;
+    }
+    
+    // 射线沿范围较近的一侧，d 为射线方向
+    const float sign = ahead <= behind ? 1.f : -1.f;
+    const Vector2d d(alongX ? sign : 0.f, alongX ? 0.f : sign);
+    const Point2d rayEnd(pt + d * (mgMin(ahead, behind) + eps));
+    
+    cache.findSegments(Box2d(pt, rayEnd).inflate(eps), found);  // 切分点有舍入误差，中点可能略偏离所在的边
+    for (size_t k = 0; k < candidates.size(); k++) {
+        winding[candidates[k]] = 0;
+        through[candidates[k]] = 0;
+    }
+    
+    for (size_t k = 0; k < found.size(); k++) {
+        const MgBoolEdge& e = edges[cache.getSegmentID(found[k])];
+        
+        if (!boxes[e.path].contains(pt)) {
+            continue;
+        }
+        if (distanceToEdge(pt, e) <= tol) {
+            through[e.path] += d.crossProduct(e.p2 - e.p1) > 0 ? 1 : -1;
+            continue;
+        }
+        
+        // 旋转到射线沿x轴正向的局部坐标系
+        const Vector2d a(e.p1 - pt), b(e.p2 - pt);
+        const float ay = d.x * a.y - d.y * a.x, by = d.x * b.y - d.y * b.x;
+        
+        if ((ay > 0) != (by > 0)) {
+            const float ax = d.x * a.x + d.y * a.y, bx = d.x * b.x + d.y * b.y;
+            if (ax + (bx - ax) * ay / (ay - by) > 0) {
+                winding[e.path] += by > ay ? 1 : -1;
+            }
+        }
+    }
+    
+    const bool leftAhead = Vector2d(-dir.y, dir.x).dotProduct(d) > 0;
+    
+    for (size_t k = 0; k < candidates.size(); k++) {
+        const int path = candidates[k];
+        const int group = groups[path];
+        const int wBehind = winding[path] + through[path];
+        
+        if (winding[path] != 0) {
+            (leftAhead ? left : right)[group] = true;
+        }
+        if (wBehind != 0) {
+            (leftAhead ? right : left)[group] = true;
+        }
+    }
+}
+
+static bool applyOp(MgPathBoolOp op, const bool inside[2])
+{
+    switch (op) {
+        case kMgPathUnion:      return inside[0] || inside[1];
+        case kMgPathIntersect:  return inside[0] && inside[1];
+        case kMgPathDifference: return inside[0] && !inside[1];
+        default:                return inside[0] != inside[1];
+    }
+}
+
+// 合并相距在容差内的顶点，将有向边首尾相连为多边形
+void MgPathBoolean::Impl::link(const std::vector<Point2d>& pts, std::vector<MgBoolLink>& links,
+                               MgPath& result) const
+{
+    std::vector<int> order(pts.size()), ids(pts.size());
+    std::vector<Point2d> verts;
+    
+    for (size_t i = 0; i < pts.size(); i++) {
+        order[i] = (int)i;
+    }
+    std::sort(order.begin(), order.end(), MgBoolPointLess(pts));
+    for (size_t i = 0; i < order.size(); i++) {
+        const Point2d& pt = pts[order[i]];
+        int id = -1;
+        
+        for (int j = (int)i - 1; j >= 0 && pt.x - pts[order[j]].x <= eps; j--) {
+            if (pt.distanceTo(pts[order[j]]) <= eps) {
+                id = ids[order[j]];
+                break;
+            }
+        }
+        if (id < 0) {
+            id = (int)verts.size();
+            verts.push_back(pt);
+        }
+        ids[order[i]] = id;
+    }
+    
+    // links 中的端点原为 pts 的序号，换为合并后的顶点号，去掉退化边和重复边
+    size_t n = 0;
+    for (size_t i = 0; i < links.size(); i++) {
+        MgBoolLink e = { ids[links[i].from], ids[links[i].to] };
+        if (e.from != e.to) {
+            links[n++] = e;
+        }
+    }
+    links.resize(n);
+    std::sort(links.begin(), links.end());
+    links.erase(std::unique(links.begin(), links.end()), links.end());
+    
+    std::vector<int> first(verts.size() + 1, 0);   // 各顶点的出边在 links 中的起始位置
+    std::vector<bool> used(links.size(), false);
+    std::vector<int> ring;
+    
+    for (size_t i = 0; i < links.size(); i++) {
+        first[links[i].from + 1]++;
+    }
+    for (size_t i = 1; i < first.size(); i++) {
+        first[i] += first[i - 1];
+    }
+    for (size_t i = 0; i < links.size(); i++) {
+        if (used[i]) {
+            continue;
+        }
+        ring.clear();
+        ring.push_back(links[i].from);
+        used[i] = true;
+        
+        int prev = links[i].from;
+        int cur = links[i].to;
+        while (cur != ring[0]) {
+            // 顶点有多条出边时取左转最多的一条，使各环不在接触点处交叉，原路折回的优先级最低
+            const Vector2d dir(verts[cur] - verts[prev]);
+            float best = 0;
+            int next = -1;
+            
+            for (int k = first[cur]; k < first[cur + 1]; k++) {
+                if (!used[k]) {
+                    float angle = dir.angleTo2(verts[links[k].to] - verts[cur]);
+                    if (angle > _M_PI - 1e-4f) {
+                        angle = -_M_PI;
+                    }
+                    if (next < 0 || angle > best) {
+                        best = angle;
+                        next = k;
+                    }
+                }
+            }
+            if (next < 0) {         // 顶点合并使出入边不平衡时，直接闭合已走过的边
+                ring.push_back(cur);
+                break;
+            }
+            used[next] = true;
+            ring.push_back(cur);
+            prev = cur;
+            cur = links[next].to;
+        }
+        
+        // 去掉共线的中间顶点
+        size_t m = 0;
+        for (size_t k = 0; k < ring.size(); k++) {
+            const Point2d& prev = verts[m > 0 ? ring[m - 1] : ring.back()];
+            const Point2d& pt = verts[ring[k]];
+            const Point2d& next = verts[ring[(k + 1) % ring.size()]];
+            
+            if (fabsf((pt - prev).crossProduct(next - prev)) > eps * prev.distanceTo(next)) {
+                ring[m++] = ring[k];
+            }
+        }
+        if (m >= 3) {
+            result.moveTo(verts[ring[0]]);
+            for (size_t k = 1; k < m; k++) {
+                result.lineTo(verts[ring[k]]);
+            }
+            result.closeFigure();
+        }
+    }
+}
+
+MgPathBoolean::MgPathBoolean(float tol)
+{
+    im = new Impl();
+    im->tol = tol;
+}
+
+MgPathBoolean::~MgPathBoolean()
+{
+    delete im;
+}
+
+void MgPathBoolean::clear()
+{
+    im->paths.clear();
+    im->groups.clear();
+}
+
+void MgPathBoolean::addPath(const MgPath& path, int group)
+{
+    if (path.getCount() > 1) {
+        im->paths.push_back(path);
+        im->groups.push_back(group ? 1 : 0);
+    }
+}
+
+bool MgPathBoolean::execute(MgPathBoolOp op, MgPath& result) const
+{
+    result.clear();
+    im->flatten();
+    if (im->edges.empty()) {
+        return false;
+    }
+    
+    std::vector<MgBoolSplit> splits;
+    std::vector<Point2d> pts;
+    std::vector<MgBoolLink> links;
+    
+    im->splitEdges(splits);
+    im->winding.assign(im->paths.size(), 0);
+    im->through.assign(im->paths.size(), 0);
+    
+    std::vector<Point2d> chain;
+    
+    for (size_t i = 0, s = 0; i < im->edges.size(); i++) {
+        const MgBoolEdge& e = im->edges[i];
+        
+        chain.clear();
+        chain.push_back(e.p1);
+        for (; s < splits.size() && splits[s].edge == (int)i; s++) {
+            if (splits[s].pt.distanceTo(chain.back()) > im->eps) {
+                chain.push_back(splits[s].pt);
+            }
+        }
+        if (chain.size() > 1 && chain.back().distanceTo(e.p2) <= im->eps) {
+            chain.pop_back();
+        }
+        chain.push_back(e.p2);
+        
+        // 运算结果只在小段一侧时保留此段，并使结果区域在其左侧
+        for (size_t k = 0; k + 1 < chain.size(); k++) {
+            const Point2d& start = chain[k];
+            const Point2d& end = chain[k + 1];
+            if (start.distanceTo(end) > im->eps) {
+                bool insideLeft[2], insideRight[2];
+                
+                im->classify(start, end, insideLeft, insideRight);
+                bool left = applyOp(op, insideLeft);
+                bool right = applyOp(op, insideRight);
+                
+                if (left != right) {
+                    MgBoolLink link = { (int)pts.size(), (int)pts.size() + 1 };
+                    pts.push_back(left ? start : end);
+                    pts.push_back(left ? end : start);
+                    links.push_back(link);
+                }
+            }
+        }
+    }
+    
+    im->link(pts, links, result);
+    
+    return result.getCount() > 0;
+}
+
+bool MgPathBoolean::combine(const MgPath& path1, const MgPath& path2, MgPathBoolOp op,
+                            MgPath& result, float tol)
+{
+    MgPathBoolean b(tol);
+    
+    b.addPath(path1, 0);
+    b.addPath(path2, 1);
+    return b.execute(op, result);
+}
+
+float MgPathBoolean::getArea(const MgPath& path, float tol)
+{
+    MgPathBoolean b(tol);
+    MgPath result;
+    
+    b.addPath(path);
+    b.execute(kMgPathUnion, result);
+    return getPolygonArea(result);
+}
+
+float MgPathBoolean::getPolygonArea(const MgPath& path)
+{
+    const Point2d* pts = path.getPoints();
+    const char* types = path.getTypes();
+    float area = 0;
+    
+    for (int i = 0, start = 0; i < path.getCount(); i++) {
+        int next = i + 1 < path.getCount() && types[i + 1] != kMgMoveTo ? i + 1 : start;
+        
+        area += pts[i].x * pts[next].y - pts[next].x * pts[i].y;
+        if (next == start) {
+            start = i + 1;
+        }
+    }
+    return area / 2;
+}
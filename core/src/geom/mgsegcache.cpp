@@ -0,0 +1,576 @@
+// mgsegcache.cpp: 实现图形子段的分块点中缓存 MgSegmentCache
+// Copyright (c) 2004-2015, https://github.com/rhcad/vgcore, BSD License
+
+#include "mgsegcache.h"
+#include "mgnear.h"
+#include "mglnrel.h"
+#include "mgcurv.h"
+#include <vector>
+#include <algorithm>
+
+struct MgSegmentCache::Impl {
+    std::vector<float>  x0, y0, x1, y1, x2, y2, x3, y3;     // 各段的控制点坐标分量
+    std::vector<float>  xmin, ymin, xmax, ymax;             // 各段的绑定框，同 mgnear::bezierBox1
+    std::vector<float>  bxmin, bymin, bxmax, bymax;         // 各块的绑定框，包含各段的绑定框和控制点
+    std::vector<float>  nxmin, nymin, nxmax, nymax;         // 层次包围盒各节点的绑定框，第0层为各块
+    std::vector<int>    levels;     // 层次包围盒各层首个节点的序号，为空表示待生成
+    std::vector<float>  prevx;      // 折线各边起点的前一顶点的X坐标
+    std::vector<int>    ids;        // 各段在图形中的段号
+    std::vector<char>   curves;     // 各段是否为贝塞尔曲线段
+    std::vector<MgBezierCoeffs> coeffs; // 各曲线段求最近点的幂基系数
+    int     vertexCount;            // setLines 的顶点数
+    bool    closed;
+    
+    Impl() : vertexCount(0), closed(false) {}
+    
+    int count() const { return (int)ids.size(); }
+    void add(const Point2d* pts, int segment, bool curve, const Box2d& box);
+    void getSegment(int i, Point2d pts[4]) const;
+    Point2d vertex(int i) const;
+    void buildTree();
+    void findBlocks(const Box2d& rect, std::vector<int>& blocks);
+    bool isIgnoredEdge(int i, int ignoreVertex) const;
+    int nearestVertex(const Point2d& pt, float tol, int ignoreVertex);
+    int nearestEdge(const Point2d& pt, float tol, int ignoreVertex) const;
+    bool isInside(const Point2d& pt, int ignoreVertex);
+};
+
+// 块内各点到给定点的距离平方
+static void pointDistances(int m, const float* xs, const float* ys,
+                           float px, float py, float* d2)
+{
+    for (int k = 0; k < m; k++) {
+        const float dx = xs[k] - px;
+        const float dy = ys[k] - py;
+        d2[k] = dx * dx + dy * dy;
+    }
+}
+
+// 块内各直线(无限长)到给定点的距离平方
+static void beelineDistances(int m, const float* x1, const float* y1,
+                             const float* x2, const float* y2,
+                             float px, float py, float* d2)
+{
+    for (int k = 0; k < m; k++) {
+        const float ax = px - x1[k];
+        const float ay = py - y1[k];
+        const float vx = x2[k] - x1[k];
+        const float vy = y2[k] - y1[k];
+        const float len2 = vx * vx + vy * vy;
+        const float cross = vx * ay - vy * ax;
+        const float dist2 = cross * cross / (len2 > 0.f ? len2 : 1.f);
+        d2[k] = len2 > 0.f ? dist2 : ax * ax + ay * ay;
+    }
+}
+
+// 块内绑定框与给定点的公差框相交的各段，其控制点范围到该点的距离平方，不相交的为极大数
+// 曲线段在控制点的凸包内，该距离不超过点到曲线段的距离
+static void boxDistances(int m, const float* xmin, const float* ymin,
+                         const float* xmax, const float* ymax,
+                         const float* const xs[4], const float* const ys[4],
+                         const Point2d& pt, const Box2d& rect, float* d2)
+{
+    for (int k = 0; k < m; k++) {
+        const float hxmin = mgMin(mgMin(xs[0][k], xs[1][k]), mgMin(xs[2][k], xs[3][k]));
+        const float hxmax = mgMax(mgMax(xs[0][k], xs[1][k]), mgMax(xs[2][k], xs[3][k]));
+        const float hymin = mgMin(mgMin(ys[0][k], ys[1][k]), mgMin(ys[2][k], ys[3][k]));
+        const float hymax = mgMax(mgMax(ys[0][k], ys[1][k]), mgMax(ys[2][k], ys[3][k]));
+        const float dx1 = hxmin - pt.x;
+        const float dx2 = pt.x - hxmax;
+        const float dy1 = hymin - pt.y;
+        const float dy2 = pt.y - hymax;
+        const float dx = dx1 > dx2 ? (dx1 > 0.f ? dx1 : 0.f) : (dx2 > 0.f ? dx2 : 0.f);
+        const float dy = dy1 > dy2 ? (dy1 > 0.f ? dy1 : 0.f) : (dy2 > 0.f ? dy2 : 0.f);
+        const bool cross = (xmin[k] <= rect.xmax && xmax[k] >= rect.xmin
+                            && ymin[k] <= rect.ymax && ymax[k] >= rect.ymin);
+        d2[k] = cross ? dx * dx + dy * dy : _FLT_MAX;
+    }
+}
+
+// 块内各边与从给定点向下的射线的交点数，同 mglnrel::ptInArea 的奇偶判断
+static int edgeCrossings(int m, const float* x1, const float* y1,
+                         const float* x2, const float* y2,
+                         const float* x0, float px, float py)
+{
+    int n = 0;
+    
+    for (int k = 0; k < m; k++) {
+        const bool inx = ((x2[k] > x1[k]) && (px >= x1[k]) && (px < x2[k]))
+                      || ((x1[k] > x2[k]) && (px <= x1[k]) && (px > x2[k]));
+        const float dx = x2[k] - x1[k];
+        const bool above = py > y1[k] + (px - x1[k]) * (y2[k] - y1[k]) / (dx != 0.f ? dx : 1.f);
+        const bool turn = mgEquals(px, x1[k]) && (((x0[k] > px) && (x2[k] > px))
+                                                  || ((x0[k] < px) && (x2[k] < px)));
+        n += (inx && above && !turn) ? 1 : 0;
+    }
+    
+    return n;
+}
+
+// 给定点到矩形框的距离平方
+static inline float boxDistance2(float xmin, float ymin, float xmax, float ymax, const Point2d& pt)
+{
+    const float dx = pt.x < xmin ? xmin - pt.x : (pt.x > xmax ? pt.x - xmax : 0.f);
+    const float dy = pt.y < ymin ? ymin - pt.y : (pt.y > ymax ? pt.y - ymax : 0.f);
+    return dx * dx + dy * dy;
+}
+
+void MgSegmentCache::Impl::add(const Point2d* pts, int segment, bool curve, const Box2d& box)
+{
+    const int i = count();
+    Box2d rect(box);
+    
+    for (int j = 0; j < 4; j++) {
+        rect.xmin = mgMin(rect.xmin, pts[j].x); rect.ymin = mgMin(rect.ymin, pts[j].y);
+        rect.xmax = mgMax(rect.xmax, pts[j].x); rect.ymax = mgMax(rect.ymax, pts[j].y);
+    }
+    
+    x0.push_back(pts[0].x); y0.push_back(pts[0].y);
+    x1.push_back(pts[1].x); y1.push_back(pts[1].y);
+    x2.push_back(pts[2].x); y2.push_back(pts[2].y);
+    x3.push_back(pts[3].x); y3.push_back(pts[3].y);
+    xmin.push_back(box.xmin); ymin.push_back(box.ymin);
+    xmax.push_back(box.xmax); ymax.push_back(box.ymax);
+    ids.push_back(segment);
+    curves.push_back(curve ? 1 : 0);
+    coeffs.resize(i + 1);
+    if (curve) {
+        mgnear::bezierCoeffs(pts, coeffs[i]);
+    }
+    levels.clear();
+    
+    if (i % kBlockSize == 0) {
+        bxmin.push_back(rect.xmin); bymin.push_back(rect.ymin);
+        bxmax.push_back(rect.xmax); bymax.push_back(rect.ymax);
+    } else {
+        const int b = i / kBlockSize;
+        bxmin[b] = mgMin(bxmin[b], rect.xmin); bymin[b] = mgMin(bymin[b], rect.ymin);
+        bxmax[b] = mgMax(bxmax[b], rect.xmax); bymax[b] = mgMax(bymax[b], rect.ymax);
+    }
+}
+
+void MgSegmentCache::Impl::getSegment(int i, Point2d pts[4]) const
+{
+    pts[0].set(x0[i], y0[i]);
+    pts[1].set(x1[i], y1[i]);
+    pts[2].set(x2[i], y2[i]);
+    pts[3].set(x3[i], y3[i]);
+}
+
+Point2d MgSegmentCache::Impl::vertex(int i) const
+{
+    const int n = count();
+    return i < n ? Point2d(x0[i], y0[i]) : Point2d(x3[n - 1], y3[n - 1]);
+}
+
+void MgSegmentCache::Impl::buildTree()
+{
+    int start = 0, size = (int)bxmin.size();
+    
+    nxmin = bxmin; nymin = bymin;
+    nxmax = bxmax; nymax = bymax;
+    levels.push_back(0);
+    
+    while (size > 1) {          // 将下层的相邻两个节点合并为上层的一个节点
+        const int next = start + size;
+        for (int j = 0; j < size; j += 2) {
+            const int a = start + j, b = j + 1 < size ? a + 1 : a;
+            nxmin.push_back(mgMin(nxmin[a], nxmin[b])); nymin.push_back(mgMin(nymin[a], nymin[b]));
+            nxmax.push_back(mgMax(nxmax[a], nxmax[b])); nymax.push_back(mgMax(nymax[a], nymax[b]));
+        }
+        start = next;
+        size = (size + 1) / 2;
+        levels.push_back(start);
+    }
+}
+
+void MgSegmentCache::Impl::findBlocks(const Box2d& rect, std::vector<int>& blocks)
+{
+    int stack[64], depth[64], top = 0;
+    
+    blocks.clear();
+    if (ids.empty()) {
+        return;
+    }
+    if (levels.empty()) {
+        buildTree();
+    }
+    stack[top] = 0;
+    depth[top++] = (int)levels.size() - 1;
+    
+    while (top > 0) {           // 深度优先，先左后右，使得块号为升序
+        const int j = stack[--top];
+        const int level = depth[top];
+        const int i = levels[level] + j;
+        
+        if (nxmin[i] > rect.xmax || nxmax[i] < rect.xmin
+            || nymin[i] > rect.ymax || nymax[i] < rect.ymin) {
+            continue;
+        }
+        if (level == 0) {
+            blocks.push_back(j);
+            continue;
+        }
+        const int size = levels[level] - levels[level - 1];     // 下层的节点数
+        if (2 * j + 1 < size) {
+            stack[top] = 2 * j + 1;
+            depth[top++] = level - 1;
+        }
+        stack[top] = 2 * j;
+        depth[top++] = level - 1;
+    }
+}
+
+bool MgSegmentCache::Impl::isIgnoredEdge(int i, int ignoreVertex) const
+{
+    return i == ignoreVertex || (i + 1 < vertexCount ? i + 1 : 0) == ignoreVertex;
+}
+
+int MgSegmentCache::Impl::nearestVertex(const Point2d& pt, float tol, int ignoreVertex)
+{
+    const int n = count();
+    float d2[kBlockSize];
+    float minDist2 = tol * tol;
+    int order = -1;
+    std::vector<int> blocks;
+    
+    if (tol >= 1.e5f) {
+        return -1;
+    }
+    findBlocks(Box2d(pt, 2 * tol, 2 * tol), blocks);
+    for (size_t j = 0; j < blocks.size(); j++) {
+        const int b = blocks[j], base = b * kBlockSize;
+        const int m = mgMin(n - base, (int)kBlockSize);
+        
+        if (boxDistance2(bxmin[b], bymin[b], bxmax[b], bymax[b], pt) >= minDist2) {
+            continue;
+        }
+        pointDistances(m, &x0[base], &y0[base], pt.x, pt.y, d2);
+        for (int k = 0; k < m; k++) {
+            if (minDist2 > d2[k] && base + k != ignoreVertex) {
+                minDist2 = d2[k];
+                order = base + k;
+            }
+        }
+    }
+    if (!closed && n > 0 && n != ignoreVertex) {    // 折线的末点
+        if (minDist2 > vertex(n).distanceSquare(pt)) {
+            order = n;
+        }
+    }
+    
+    return order;
+}
+
+int MgSegmentCache::Impl::nearestEdge(const Point2d& pt, float tol, int ignoreVertex) const
+{
+    const int n = count();
+    float d2[kBlockSize];
+    float minDist2 = tol * tol;
+    int order = -1;
+    
+    for (int base = 0; base < n; base += kBlockSize) {
+        const int m = mgMin(n - base, (int)kBlockSize);
+        
+        beelineDistances(m, &x0[base], &y0[base], &x3[base], &y3[base], pt.x, pt.y, d2);
+        for (int k = 0; k < m; k++) {
+            if (minDist2 > d2[k] && !isIgnoredEdge(base + k, ignoreVertex)) {
+                minDist2 = d2[k];
+                order = base + k;
+            }
+        }
+    }
+    
+    return order;
+}
+
+bool MgSegmentCache::Impl::isInside(const Point2d& pt, int ignoreVertex)
+{
+    const int n = count();
+    int crossings = 0;
+    std::vector<int> blocks;
+    
+    findBlocks(Box2d(pt.x, -_FLT_MAX, pt.x, pt.y), blocks);     // 给定点正下方的各块
+    for (size_t j = 0; j < blocks.size(); j++) {
+        const int b = blocks[j], base = b * kBlockSize;
+        if (pt.x < bxmin[b] || pt.x > bxmax[b] || pt.y <= bymin[b]) {
+            continue;   // 块内各边都不在给定点的正下方
+        }
+        crossings += edgeCrossings(mgMin(n - base, (int)kBlockSize),
+                                   &x0[base], &y0[base], &x3[base], &y3[base],
+                                   &prevx[base], pt.x, pt.y);
+    }
+    if (ignoreVertex >= 0) {    // 扣除与忽略顶点相邻的边
+        const int e = ignoreVertex > 0 ? ignoreVertex - 1 : n - 1;
+        if (e < n && e != ignoreVertex && isIgnoredEdge(e, ignoreVertex)) {
+            crossings -= edgeCrossings(1, &x0[e], &y0[e], &x3[e], &y3[e], &prevx[e], pt.x, pt.y);
+        }
+        if (ignoreVertex < n) {
+            crossings -= edgeCrossings(1, &x0[ignoreVertex], &y0[ignoreVertex], &x3[ignoreVertex],
+                                       &y3[ignoreVertex], &prevx[ignoreVertex], pt.x, pt.y);
+        }
+    }
+    
+    return crossings % 2 != 0;
+}
+
+MgSegmentCache::MgSegmentCache()
+{
+    im = new Impl();
+}
+
+MgSegmentCache::~MgSegmentCache()
+{
+    delete im;
+}
+
+void MgSegmentCache::clear()
+{
+    Impl* p = new Impl();
+    delete im;
+    im = p;
+}
+
+int MgSegmentCache::getSegmentCount() const
+{
+    return im->count();
+}
+
+int MgSegmentCache::getVertexCount() const
+{
+    return im->vertexCount;
+}
+
+bool MgSegmentCache::isClosed() const
+{
+    return im->closed;
+}
+
+void MgSegmentCache::addLine(const Point2d& pt1, const Point2d& pt2, int segment)
+{
+    const Point2d pts[4] = { pt1, pt1, pt2, pt2 };
+    im->add(pts, segment, false, Box2d(pt1, pt2));
+}
+
+void MgSegmentCache::addBezier(const Point2d* pts, int segment)
+{
+    im->add(pts, segment, true, mgnear::bezierBox1(pts));
+}
+
+int MgSegmentCache::getSegmentID(int index) const
+{
+    return im->ids[index];
+}
+
+void MgSegmentCache::getSegment(int index, Point2d pts[4]) const
+{
+    im->getSegment(index, pts);
+}
+
+int MgSegmentCache::findSegments(const Box2d& rect, std::vector<int>& indices) const
+{
+    const int n = im->count();
+    std::vector<int> blocks;
+    
+    indices.clear();
+    im->findBlocks(rect, blocks);
+    for (size_t j = 0; j < blocks.size(); j++) {
+        for (int i = blocks[j] * kBlockSize; i < mgMin(n, (blocks[j] + 1) * kBlockSize); i++) {
+            if (rect.isIntersect(Box2d(im->xmin[i], im->ymin[i], im->xmax[i], im->ymax[i]))) {
+                indices.push_back(i);
+            }
+        }
+    }
+    
+    return (int)indices.size();
+}
+
+bool MgSegmentCache::intersectBox(const Box2d& rect) const
+{
+    const int n = im->count();
+    std::vector<int> blocks;
+    
+    im->findBlocks(rect, blocks);
+    for (size_t j = 0; j < blocks.size(); j++) {
+        for (int i = blocks[j] * kBlockSize; i < mgMin(n, (blocks[j] + 1) * kBlockSize); i++) {
+            if (rect.isIntersect(Box2d(im->xmin[i], im->ymin[i], im->xmax[i], im->ymax[i]))) {
+                return true;
+            }
+        }
+    }
+    
+    return false;
+}
+
+void MgSegmentCache::setLines(int n, const Point2d* points, bool closed)
+{
+    clear();
+    if (n < 2 || !points) {
+        return;
+    }
+    im->vertexCount = n;
+    im->closed = closed;
+    for (int i = 0; i < (closed ? n : n - 1); i++) {
+        addLine(points[i], points[(i + 1) % n], i);
+        im->prevx.push_back(points[i > 0 ? i - 1 : n - 1].x);
+    }
+}
+
+void MgSegmentCache::setCubicSplines(int n, const Point2d* knots, const Vector2d* knotvs,
+                                     bool closed, bool hermite)
+{
+    Point2d pts[4];
+    int n2 = (closed && n > 1) ? n + 1 : n;
+    
+    clear();
+    im->closed = closed;
+    for (int i = 0; i + 1 < n2; i++) {
+        mgcurv::cubicSplineToBezier(n, knots, knotvs, i, pts, hermite);
+        addBezier(pts, i);
+    }
+}
+
+void MgSegmentCache::setQuadSplines(int n, const Point2d* knots, bool closed)
+{
+    Point2d pts[3 + 4];
+    
+    clear();
+    im->closed = closed;
+    for (int i = 0; i < (closed ? n : n - 2); i++, pts[0] = pts[2]) {
+        if (i == 0) {
+            pts[0] = closed ? (knots[0] + knots[1]) / 2 : knots[0];
+        }
+        pts[1] = knots[(i+1) % n];
+        if (closed || i + 3 < n)
+            pts[2] = (knots[(i+1) % n] + knots[(i+2) % n]) / 2;
+        else
+            pts[2] = knots[i+2];
+        
+        mgcurv::quadBezierToCubic(pts, pts + 3);
+        addBezier(pts + 3, i);
+    }
+}
+
+float MgSegmentCache::curvesHit(const Point2d& pt, float tol, Point2d& nearpt, int& segment) const
+{
+    const int n = im->count();
+    const Box2d rect (pt, 2 * tol, 2 * tol);
+    std::vector<std::pair<float, int> > candidates;
+    float d2[kBlockSize];
+    Point2d pts[4], ptTemp;
+    float dist, distMin = _FLT_MAX;
+    int index = n;
+    std::vector<int> blocks;
+    
+    im->findBlocks(rect, blocks);
+    for (size_t j = 0; j < blocks.size(); j++) {
+        const int b = blocks[j], base = b * kBlockSize;
+        if (!rect.isIntersect(Box2d(im->bxmin[b], im->bymin[b], im->bxmax[b], im->bymax[b]))) {
+            continue;
+        }
+        const int m = mgMin(n - base, (int)kBlockSize);
+        const float* const xs[4] = { &im->x0[base], &im->x1[base], &im->x2[base], &im->x3[base] };
+        const float* const ys[4] = { &im->y0[base], &im->y1[base], &im->y2[base], &im->y3[base] };
+        
+        boxDistances(m, &im->xmin[base], &im->ymin[base], &im->xmax[base], &im->ymax[base],
+                     xs, ys, pt, rect, d2);
+        for (int k = 0; k < m; k++) {
+            if (d2[k] < _FLT_MAX) {
+                candidates.push_back(std::pair<float, int>(d2[k], base + k));
+            }
+        }
+    }
+    
+    // 按绑定框的距离由近到远精确计算，绑定框已比当前最近距离远的段不必再算
+    std::sort(candidates.begin(), candidates.end());
+    segment = -1;
+    for (size_t j = 0; j < candidates.size(); j++) {
+        const int i = candidates[j].second;
+        
+        if (segment >= 0 && candidates[j].first > distMin * distMin) {
+            break;
+        }
+        if (!rect.isIntersect(Box2d(im->xmin[i], im->ymin[i], im->xmax[i], im->ymax[i]))) {
+            continue;
+        }
+        if (im->curves[i]) {
+            dist = mgnear::nearestOnBezier(pt, im->coeffs[i], ptTemp);
+        } else {
+            im->getSegment(i, pts);
+            dist = mglnrel::ptToLine(pts[0], pts[3], pt, ptTemp);
+        }
+        if (dist < distMin || (dist == distMin && i < index)) {
+            distMin = dist;
+            nearpt = ptTemp;
+            index = i;
+            segment = im->ids[i];
+        }
+    }
+    
+    return distMin;
+}
+
+float MgSegmentCache::linesHit(const Point2d& pt, float tol, Point2d& nearpt, int& segment,
+                               bool* inside, int* hitType, int flags, int ignoreVertex) const
+{
+    const int n = im->vertexCount;
+    const bool closed = im->closed;
+    const float tolp = Tol(tol).equalPoint();
+    float dist, distMin = _FLT_MAX;
+    Point2d ptTemp;
+    int type = mglnrel::kPtOutArea;
+    
+    if (flags & (1 << mglnrel::kPtAtVertex)) {
+        segment = im->nearestVertex(pt, tolp, ignoreVertex);
+        if (segment >= 0) {
+            type = mglnrel::kPtAtVertex;
+        }
+    }
+    if (type == mglnrel::kPtOutArea && (flags & (1 << mglnrel::kPtOnEdge))) {
+        segment = im->nearestEdge(pt, tolp, ignoreVertex);
+        if (segment >= 0) {
+            type = mglnrel::kPtOnEdge;
+        }
+        else if ((flags & (1 << mglnrel::kPtInArea)) && im->isInside(pt, ignoreVertex)) {
+            type = mglnrel::kPtInArea;
+        }
+    }
+    
+    if (inside) {
+        *inside = (closed && type == mglnrel::kPtInArea);
+    }
+    if (hitType) {
+        *hitType = type;
+    }
+    if (type == mglnrel::kPtAtVertex) {
+        nearpt = im->vertex(segment);
+        distMin = nearpt.distanceTo(pt);
+        return distMin;
+    }
+    if (type == mglnrel::kPtOnEdge) {
+        distMin = mglnrel::ptToLine(im->vertex(segment), im->vertex((segment+1)%n), pt, nearpt);
+        return distMin;
+    }
+    if (!closed || type != mglnrel::kPtInArea || n < 1) {
+        return distMin;
+    }
+    
+    // 其余各边的直线距离都超出公差，只需比较第一条边和与忽略顶点相邻的边
+    const int edges[] = { 0, ignoreVertex > 0 ? ignoreVertex - 1 : n - 1, ignoreVertex };
+    
+    for (int j = 0; j < (ignoreVertex >= 0 && ignoreVertex < n ? 3 : 1); j++) {
+        const int i = edges[j];
+        if (j > 0 && (i == 0 || (j == 2 && i == edges[1]))) {
+            continue;
+        }
+        dist = mglnrel::ptToLine(im->vertex(i), im->vertex((i + 1) % n), pt, ptTemp);
+        if (distMin > 1e10f || (dist <= tol && dist < distMin)) {
+            distMin = dist;
+            nearpt = ptTemp;
+            if (dist <= tol)
+                segment = i;
+        }
+    }
+    
+    return distMin;
+}
@@ -20,6 +20,7 @@
 #include <mglnrel.h>
 #include <mgnear.h>
 #include <mgpath.h>
+#include <mgpathbool.h>
 
 #include <mgstorage.h>
 #include <mgcshapes.h>
@@ -50,6 +51,7 @@
 %include <mglnrel.h>
 %include <mgnear.h>
 %include <mgpath.h>
+%include <mgpathbool.h>
 
 %feature("director") MgBaseShape;
 %feature("director") MgBaseRect;
@@ -182,6 +182,15 @@ float MgBaseShape::linesHit(int n, const Point2d* points, bool closed,
                             &res.inside, (int*)0, flags, res.ignoreHandle);
 }
 
+float MgBaseShape::linesHit(const MgSegmentCache& cache,
+                            const Point2d& pt, float tol, MgHitResult& res)
+{
+    int flags = ( (res.snapVertexEnabled() ? (1 << mglnrel::kPtAtVertex) : 0)
+                 |(res.snapEdgeEnabled() ? (1 << mglnrel::kPtOnEdge) : 0) );
+    return cache.linesHit(pt, tol, res.nearpt, res.segment,
+                          &res.inside, (int*)0, flags, res.ignoreHandle);
+}
+
 bool MgBaseShape::getFlag(MgShapeBit bit) const
 {
     return (_flags & (1 << bit)) != 0;
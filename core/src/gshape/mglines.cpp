@@ -3,11 +3,138 @@
 
 #include "mglines.h"
 #include "mgshape_.h"
+#include <math.h>
+#include <string.h>
+
+// MgPackedPoints
+//
+
+template <typename T>
+static void unpackDeltas(const T* d, int n, double x, double y, float step, float* xy)
+{
+    int qx = 0, qy = 0;
+    
+    for (int i = 0; i < n; i++) {
+        qx += d[2 * i];
+        qy += d[2 * i + 1];
+        xy[2 * i] = (float)(x + (double)step * qx);     // 只舍入一次，大坐标也不增加误差
+        xy[2 * i + 1] = (float)(y + (double)step * qy);
+    }
+}
+
+MgPackedPoints* MgPackedPoints::pack(int count, const float* xy, float step)
+{
+    if (count < 1 || !xy || step < _MGZERO)
+        return (MgPackedPoints*)0;
+    
+    int* q = new int[count * 2];
+    double maxd = 0;
+    
+    for (int i = 0; i < count * 2; i++) {
+        double v = floor(((double)xy[i] - xy[i % 2]) / step + 0.5);    // 相对于首点的量化坐标
+        
+        if (fabs(v) > 2147483647.0 / 2) {      // 差值也要在32位范围内
+            delete[] q;
+            return (MgPackedPoints*)0;
+        }
+        q[i] = (int)v;
+        if (i > 1) {
+            maxd = mgMax(maxd, fabs((double)q[i] - q[i - 2]));
+        }
+    }
+    
+    MgPackedPoints head;
+    
+    head.x0 = xy[0];
+    head.y0 = xy[1];
+    head.step = step;
+    head.count = count;
+    head.bytes = maxd < 128 ? 1 : maxd < 32768 ? 2 : 4;
+    
+    const int bytes = head.bytes;
+    char* buf = new char[head.memorySize()];
+    MgPackedPoints* p = (MgPackedPoints*)buf;
+    int* keys = (int*)(buf + sizeof(MgPackedPoints) + head.deltaSize());
+    
+    *p = head;
+    memset(buf + sizeof(MgPackedPoints) + count * 2 * bytes, 0, head.deltaSize() - count * 2 * bytes);
+    for (int k = 0; k < head.keyCount(); k++) {
+        keys[2 * k] = q[2 * k * kKeyStep];
+        keys[2 * k + 1] = q[2 * k * kKeyStep + 1];
+    }
+    for (int i = count * 2 - 1; i > 1; i--) {
+        q[i] -= q[i - 2];
+    }
+    for (int i = 0; i < count * 2; i++) {
+        if (bytes == 1)
+            ((signed char*)(p + 1))[i] = (signed char)q[i];
+        else if (bytes == 2)
+            ((short*)(p + 1))[i] = (short)q[i];
+        else
+            ((int*)(p + 1))[i] = q[i];
+    }
+    delete[] q;
+    
+    return p;
+}
+
+MgPackedPoints* MgPackedPoints::clone() const
+{
+    char* buf = new char[memorySize()];
+    
+    memcpy(buf, this, memorySize());
+    return (MgPackedPoints*)buf;
+}
+
+void MgPackedPoints::unpack(float* xy) const
+{
+    if (bytes == 1)
+        unpackDeltas((const signed char*)(this + 1), count, x0, y0, step, xy);
+    else if (bytes == 2)
+        unpackDeltas((const short*)(this + 1), count, x0, y0, step, xy);
+    else
+        unpackDeltas((const int*)(this + 1), count, x0, y0, step, xy);
+}
+
+template <typename T>
+static void unpackDeltaAt(const T* d, const int* keys, int index, double x, double y, float step,
+                          float* xy)
+{
+    const int k = index / MgPackedPoints::kKeyStep;
+    int qx = keys[2 * k], qy = keys[2 * k + 1];
+    
+    for (int i = k * MgPackedPoints::kKeyStep + 1; i <= index; i++) {
+        qx += d[2 * i];
+        qy += d[2 * i + 1];
+    }
+    xy[0] = (float)(x + (double)step * qx);
+    xy[1] = (float)(y + (double)step * qy);
+}
+
+void MgPackedPoints::unpackAt(int index, float* xy) const
+{
+    if (bytes == 1)
+        unpackDeltaAt((const signed char*)(this + 1), keys(), index, x0, y0, step, xy);
+    else if (bytes == 2)
+        unpackDeltaAt((const short*)(this + 1), keys(), index, x0, y0, step, xy);
+    else
+        unpackDeltaAt((const int*)(this + 1), keys(), index, x0, y0, step, xy);
+}
+
+void MgPackedPoints::release(MgPackedPoints*& p)
+{
+    if (p) {
+        delete[] (char*)p;
+        p = (MgPackedPoints*)0;
+    }
+}
 
 // MgBaseLines
 //
 
-MgBaseLines::MgBaseLines() : _points((Point2d*)0), _maxCount(0), _count(0)
+MgBaseLines::MgBaseLines()
+    : _points((Point2d*)0), _maxCount(0), _count(0), _cache((MgSegmentCache*)0)
+    , _packed((MgPackedPoints*)0), _unpacked((Point2d*)0)
 {
 }
 
@@ -15,6 +142,88 @@ MgBaseLines::~MgBaseLines()
 {
     if (_points)
         delete[] _points;
+    delete _cache;
+    delete[] _unpacked;
+    MgPackedPoints::release(_packed);
+}
+
+bool MgBaseLines::compact(float tol)
+{
+    if (!_packed && _count > 0) {
+        if (tol < _MGZERO)
+            tol = minTol().equalPoint();
+        if (packPoints(tol)) {
+            clearCachedData();
+        }
+    }
+    return !!_packed;
+}
+
+bool MgBaseLines::packPoints(float tol)
+{
+    _packed = MgPackedPoints::pack(_count, &_points[0].x, tol);
+    if (_packed && _packed->memorySize() >= _maxCount * (int)sizeof(Point2d)) {
+        MgPackedPoints::release(_packed);   // 点数太少，不节省内存
+    }
+    if (_packed) {
+        delete[] _points;
+        _points = (Point2d*)0;
+        _maxCount = 0;
+    }
+    return !!_packed;
+}
+
+void MgBaseLines::unpackPoints()
+{
+    if (_unpacked) {                // 直接使用 getPoints() 已解码的数组
+        _points = _unpacked;
+        _unpacked = (Point2d*)0;
+    } else {
+        _points = new Point2d[_count];
+        _packed->unpack(&_points[0].x);
+    }
+    _maxCount = _count;
+    MgPackedPoints::release(_packed);
+}
+
+void MgBaseLines::freePacked()
+{
+    MgPackedPoints::release(_packed);
+    delete[] _unpacked;
+    _unpacked = (Point2d*)0;
+}
+
+const Point2d* MgBaseLines::unpackedPoints() const
+{
+    if (!_unpacked) {
+        _unpacked = new Point2d[_count];
+        _packed->unpack(&_unpacked[0].x);
+    }
+    return _unpacked;
+}
+
+const Point2d* MgBaseLines::readPoints(Point2d*& buf) const
+{
+    if (!_packed)
+        return _points;
+    if (_unpacked)
+        return _unpacked;
+    buf = new Point2d[_count];
+    _packed->unpack(&buf[0].x);
+    return buf;
+}
+
+MgLinesReader::MgLinesReader(const MgBaseLines& sp)
+    : _buf((Point2d*)0), _vbuf((Vector2d*)0)
+{
+    _pts = sp.readPoints(_buf);
+    _vecs = sp.readVectors(_vbuf);
+}
+
+MgLinesReader::~MgLinesReader()
+{
+    delete[] _buf;
+    delete[] _vbuf;
 }
 
 bool MgBaseLines::_isClosed() const
@@ -29,22 +238,39 @@ int MgBaseLines::_getPointCount() const
 
 Point2d MgBaseLines::_getPoint(int index) const
 {
-    return (_count < 1 || index < 0 ? Point2d()
-            : _points[index < _count ? index : index % _count]);
+    if (_count < 1 || index < 0)
+        return Point2d();
+    index = index < _count ? index : index % _count;
+    if (_packed) {
+        Point2d pt;
+        _packed->unpackAt(index, &pt.x);
+        return pt;
+    }
+    return _points[index];
 }
 
 void MgBaseLines::_setPoint(int index, const Point2d& pt)
 {
     if (index >= 0 && index < _count) {
+        unpack();
         _points[index] = pt;
+        clearCachedData();
     }
 }
 
 void MgBaseLines::_copy(const MgBaseLines& src)
 {
-    resize(src._count);
-    for (int i = 0; i < _count; i++)
-        _points[i] = src._points[i];
+    if (src._packed) {              // 直接复制紧凑数据，不解码
+        resize(0);
+        setCapacity(0);
+        _packed = src._packed->clone();
+        _count = src._count;
+        clearCachedData();
+    } else {
+        resize(src._count);
+        for (int i = 0; i < _count; i++)
+            _points[i] = src._points[i];
+    }
 
     __super::_copy(src);
 }
@@ -53,9 +279,10 @@ bool MgBaseLines::_equals(const MgBaseLines& src) const
 {
     if (_count != src._count)
         return false;
+    MgLinesReader a(*this), b(src);
 
     for (int i = 0; i < _count; i++) {
-        if (_points[i] != src._points[i])
+        if (a.points()[i] != b.points()[i])
             return false;
     }
 
@@ -66,9 +293,10 @@ bool MgBaseLines::isIncrementFrom(const MgBaseLines& src) const
 {
     if (_count <= src._count)
         return false;
+    MgLinesReader a(*this), b(src);
     
     for (int i = 0; i < src._count; i++) {
-        if (!_points[i].isEqualTo(src._points[i], minTol()))
+        if (!a.points()[i].isEqualTo(b.points()[i], minTol()))
             return false;
     }
     
@@ -82,46 +310,83 @@ bool MgBaseLines::_isKindOf(int type) const
 
 void MgBaseLines::_update()
 {
-    _extent.set(_count, _points);
-    if (_extent.isEmpty() && _points)
-        _extent.set(_points[0], 2 * Tol::gTol().equalPoint(), 0);
+    clearCachedData();
+    MgLinesReader r(*this);
+    _extent.set(_count, r.points());
+    if (_extent.isEmpty() && r.points())
+        _extent.set(r.points()[0], 2 * Tol::gTol().equalPoint(), 0);
     __super::_update();
 }
 
 void MgBaseLines::_transform(const Matrix2d& mat)
 {
+    unpack();
     mat.transformPoints(_count, _points);
+    clearCachedData();
     __super::_transform(mat);
 }
 
 void MgBaseLines::_clear()
 {
+    freePacked();
     _count = 0;
+    clearCachedData();
     __super::_clear();
 }
 
-Point2d MgBaseLines::endPoint() const
+void MgBaseLines::_clearCachedData()
 {
-    return _count > 0 ? _points[_count - 1] : Point2d();
+    if (_cache) {
+        delete _cache;
+        _cache = (MgSegmentCache*)0;
+    }
 }
 
-bool MgBaseLines::resize(int count)
+Point2d MgBaseLines::endPoint() const
 {
-    if (_maxCount < count) {
-        _maxCount = (count + 32 - 1) / 32 * 32;
+    return _count > 0 ? _getPoint(_count - 1) : Point2d();
+}
 
-        Point2d* pts = new Point2d[_maxCount];
+void MgBaseLines::setCapacity(int count)
+{
+    Point2d* pts = count > 0 ? new Point2d[count] : (Point2d*)0;
+    
+    if (_count > 0) {
+        memcpy((void*)pts, (const void*)_points, mgMin(_count, count) * sizeof(Point2d));
+    }
+    if (_points)
+        delete[] _points;
+    _points = pts;
+    _maxCount = count;
+}
 
-        for (int i = 0; i < _count; i++)
-            pts[i] = _points[i];
-        if (_points)
-            delete[] _points;
-        _points = pts;
+bool MgBaseLines::resize(int count)
+{
+    unpack();
+    if (_maxCount < count) {    // 几何增长，逐点添加时的平均复制次数为常数
+        setCapacity(mgMax((count + 32 - 1) / 32 * 32, _maxCount + _maxCount / 2));
     }
     _count = count;
+    clearCachedData();
     return true;
 }
 
+bool MgBaseLines::reserve(int count)
+{
+    unpack();
+    if (_maxCount < count) {
+        setCapacity((count + 32 - 1) / 32 * 32);
+    }
+    return true;
+}
+
+void MgBaseLines::shrinkToFit()
+{
+    if (!_packed && _maxCount > _count) {
+        setCapacity(_count);
+    }
+}
+
 int MgBaseLines::maxEdgeIndex() const
 {
     return _count - (isClosed() ? 1 : 2);
@@ -140,8 +405,8 @@ bool MgBaseLines::insertPoint(int segment, const Point2d& pt)
     
     if (segment >= 0 && segment <= maxEdgeIndex()) {
         resize(_count + 1);
-        for (int i = _count - 1; i > segment + 1; i--)
-            _points[i] = _points[i - 1];
+        memmove((void*)(_points + segment + 2), (const void*)(_points + segment + 1),
+                (_count - segment - 2) * sizeof(Point2d));
         _points[segment + 1] = pt;
         ret = true;
     }
@@ -154,9 +419,11 @@ bool MgBaseLines::removePoint(int index)
     bool ret = false;
     
     if (index < _count && _count > 1) {
+        unpack();
         for (int i = index + 1; i < _count; i++)
             _points[i - 1] = _points[i];
         _count--;
+        clearCachedData();
         ret = true;
     }
     
@@ -165,7 +432,27 @@ bool MgBaseLines::removePoint(int index)
 
 float MgBaseLines::_hitTest(const Point2d& pt, float tol, MgHitResult& res) const
 {
-    return linesHit(_count, _points, isClosed(), pt, tol, res);
+    const MgSegmentCache* cache = getSegmentCache();
+    
+    if (cache) {
+        return linesHit(*cache, pt, tol, res);
+    }
+    MgLinesReader r(*this);
+    return linesHit(_count, r.points(), isClosed(), pt, tol, res);
+}
+
+const MgSegmentCache* MgBaseLines::getSegmentCache() const
+{
+    if (_count < MgSegmentCache::kMinSegments) {
+        return (const MgSegmentCache*)0;
+    }
+    if (!_cache || _cache->isClosed() != isClosed()) {
+        if (!_cache)
+            _cache = new MgSegmentCache();
+        MgLinesReader r(*this);
+        _cache->setLines(_count, r.points(), isClosed());
+    }
+    return _cache;
 }
 
 bool MgBaseLines::_hitTestBox(const Box2d& rect) const
@@ -173,8 +460,16 @@ bool MgBaseLines::_hitTestBox(const Box2d& rect) const
     if (!__super::_hitTestBox(rect))
         return false;
     
+    const MgSegmentCache* cache = getSegmentCache();
+    if (cache) {
+        return cache->intersectBox(rect);
+    }
+    
+    MgLinesReader r(*this);
+    const Point2d* pts = r.points();
+    
     for (int i = 0, n = isClosed() ? _count : _count - 1; i < n; i++) {
-        if (Box2d(_points[i], _points[(i + 1) % _count]).isIntersect(rect)) {
+        if (Box2d(pts[i], pts[(i + 1) % _count]).isIntersect(rect)) {
             return true;
         }
     }
@@ -185,8 +480,9 @@ bool MgBaseLines::_hitTestBox(const Box2d& rect) const
 bool MgBaseLines::_save(MgStorage* s) const
 {
     bool ret = __super::_save(s);
+    MgLinesReader r(*this);
     s->writeInt("count", _count);
-    s->writeFloatArray("points", (const float*)_points, _count * 2);
+    s->writeFloatArray("points", (const float*)r.points(), _count * 2);
     return ret;
 }
 
@@ -220,8 +516,9 @@ MgLines::~MgLines()
 void MgLines::_output(MgPath& path) const
 {
     if (_count > 1) {
-        path.moveTo(_points[0]);
-        path.linesTo(_count - 1, _points + 1);
+        MgLinesReader r(*this);
+        path.moveTo(r.points()[0]);
+        path.linesTo(_count - 1, r.points() + 1);
         if (isClosed())
             path.closeFigure();
     }
@@ -235,7 +532,7 @@ int MgLines::_getHandleCount() const
 Point2d MgLines::_getHandlePoint(int index) const
 {
     return (index < _count ? __super::_getHandlePoint(index)
-            : (_points[index % _count] + _points[(index + 1) % _count]) / 2);
+            : (_getPoint(index % _count) + _getPoint((index + 1) % _count)) / 2);
 }
 
 int MgLines::_getHandleType(int index) const
@@ -10,12 +10,13 @@
 
 MG_IMPLEMENT_CREATE(MgPathShape)
 
-MgPathShape::MgPathShape()
+MgPathShape::MgPathShape() : _cache((MgSegmentCache*)0), _edges((MgSegmentCache*)0)
 {
 }
 
 MgPathShape::~MgPathShape()
 {
+    _clearCachedData();
 }
 
 int MgPathShape::_getPointCount() const
@@ -31,11 +32,13 @@ Point2d MgPathShape::_getPoint(int index) const
 void MgPathShape::_setPoint(int index, const Point2d& pt)
 {
     _path.setPoint(index, pt);
+    _clearCachedData();
 }
 
 void MgPathShape::_copy(const MgPathShape& src)
 {
     _path.copy(src._path);
+    _clearCachedData();
     __super::_copy(src);
 }
 
@@ -56,6 +59,7 @@ bool MgPathShape::_equals(const MgPathShape& src) const
 void MgPathShape::_update()
 {
     _extent.set(_path.getCount(), _path.getPoints());
+    _clearCachedData();
     __super::_update();
 }
 
@@ -64,15 +68,25 @@ void MgPathShape::_transform(const Matrix2d& mat)
     for (int i = 0; i < _path.getCount(); i++) {
         _path.setPoint(i, _path.getPoint(i) * mat);
     }
+    _clearCachedData();
     __super::_transform(mat);
 }
 
 void MgPathShape::_clear()
 {
     _path.clear();
+    _clearCachedData();
     __super::_clear();
 }
 
+void MgPathShape::_clearCachedData()
+{
+    delete _cache;
+    delete _edges;
+    _cache = (MgSegmentCache*)0;
+    _edges = (MgSegmentCache*)0;
+}
+
 bool MgPathShape::_isClosed() const
 {
     return !!(_path.getNodeType(_path.getCount() - 1) & kMgCloseFigure);
@@ -89,6 +103,10 @@ bool MgPathShape::isCurve() const
 
 float MgPathShape::_hitTest(const Point2d& pt, float tol, MgHitResult& res) const
 {
+    if (_path.getCount() >= MgSegmentCache::kMinSegments) {
+        return hitTestByCache(pt, tol, res);
+    }
+    
     int n = _path.getCount();
     const Point2d* pts = _path.getPoints();
     const char* types = _path.getTypes();
@@ -143,7 +161,7 @@ float MgPathShape::_hitTest(const Point2d& pt, float tol, MgHitResult& res) cons
                 
                 mgcurv::quadBezierToCubic(bz, bz + 3);
                 if (rect.isIntersect(mgnear::bezierBox1(bz + 3))) {
-                    dist = mgnear::nearestOnBezier(pt, bz, nearpt);
+                    dist = mgnear::nearestOnBezier(pt, bz + 3, nearpt);
                 }
                 i++;
                 break;
@@ -169,10 +187,107 @@ float MgPathShape::_hitTest(const Point2d& pt, float tol, MgHitResult& res) cons
     return res.dist;
 }
 
+void MgPathShape::buildCache() const
+{
+    int n = _path.getCount();
+    const Point2d* pts = _path.getPoints();
+    const char* types = _path.getTypes();
+    Point2d pos, ends, bz[7];
+    bool err = false;
+    std::vector<Point2d> edges;
+    
+    _cache = new MgSegmentCache();
+    _edges = new MgSegmentCache();
+    
+    for (int i = 0; i < n && !err; i++) {
+        pos = ends;
+        
+        switch (types[i] & ~kMgCloseFigure) {
+            case kMgMoveTo:
+                ends = pts[i];
+                break;
+                
+            case kMgLineTo:
+                ends = pts[i];
+                _cache->addLine(pos, ends, i);
+                break;
+                
+            case kMgBezierTo:
+                if (i + 2 >= n) {
+                    err = true;
+                    break;
+                }
+                bz[0] = pos;
+                bz[1] = pts[i];
+                bz[2] = pts[i+1];
+                bz[3] = pts[i+2];
+                ends = bz[3];
+                i += 2;
+                _cache->addBezier(bz, i);
+                break;
+                
+            case kMgQuadTo:
+                if (i + 1 >= n) {
+                    err = true;
+                    break;
+                }
+                bz[0] = pos;
+                bz[1] = pts[i];
+                bz[2] = pts[i+1];
+                ends = bz[2];
+                
+                mgcurv::quadBezierToCubic(bz, bz + 3);
+                i++;
+                _cache->addBezier(bz + 3, i);
+                break;
+                
+            default:
+                err = true;
+                break;
+        }
+        edges.push_back(ends);
+    }
+    if (edges.size() > 2) {
+        _edges->setLines((int)edges.size(), &edges.front(), true);
+    }
+}
+
+float MgPathShape::hitTestByCache(const Point2d& pt, float tol, MgHitResult& res) const
+{
+    Point2d nearpt;
+    int segment;
+    
+    if (!_cache) {
+        buildCache();
+    }
+    res.dist = _FLT_MAX - tol;
+    
+    float dist = _cache->curvesHit(pt, tol, nearpt, segment);
+    if (segment >= 0 && res.dist > dist) {
+        res.dist = dist;
+        res.segment = segment;
+        res.nearpt = nearpt;
+    }
+    if (isClosed() && _edges->getVertexCount() > 2) {
+        MgHitResult tmpres;
+        tmpres = res;
+        linesHit(*_edges, pt, tol, tmpres);
+        res.inside = tmpres.inside;
+    }
+    
+    return res.dist;
+}
+
 bool MgPathShape::_hitTestBox(const Box2d& rect) const
 {
     if (!__super::_hitTestBox(rect))
         return false;
+    if (_path.getCount() >= MgSegmentCache::kMinSegments) {
+        if (!_cache) {
+            buildCache();
+        }
+        return _cache->intersectBox(rect);
+    }
     
     int n = _path.getCount();
     const Point2d* pts = _path.getPoints();
@@ -381,5 +496,27 @@ bool MgPathShape::_load(MgShapeFactory* factory, MgStorage* s)
 bool MgPathShape::importSVGPath(const char* d)
 {
     _path.clear();
+    _clearCachedData();
     return _path.addSVGPath(d).getCount() > 0;
 }
+
+bool MgPathShape::combineWith(const MgPath& path, MgPathBoolOp op, float tol)
+{
+    MgPath result;
+    bool ret = MgPathBoolean::combine(_path, path, op, result, tol);
+    
+    _path.copy(result);
+    _clearCachedData();
+    return ret;
+}
+
+float MgPathShape::getArea(float tol) const
+{
+    return MgPathBoolean::getArea(_path, tol);
+}
+
+bool MgPathShape::getPointAtLength(float dist, Point2d& pt, Vector2d* tangent) const
+{
+    const_cast<MgPath&>(_path).cacheLengths();     // 与点中测试缓存一样按需建立，修改路径后自动清除
+    return _path.getPointAtLength(dist, pt, tangent);
+}
@@ -3,28 +3,99 @@
 
 #include "mgsplines.h"
 #include "mgshape_.h"
+#include "mgcurvefit.h"
 
 MG_IMPLEMENT_CREATE(MgSplines)
 
-MgSplines::MgSplines() : _knotvs((Vector2d*)0)
+MgSplines::MgSplines() : _knotvs((Vector2d*)0), _curves((MgSegmentCache*)0)
+    , _packedvs((MgPackedPoints*)0), _unpackedvs((Vector2d*)0)
 {
 }
 
 MgSplines::~MgSplines()
 {
     delete[] _knotvs;
+    delete _curves;
+    delete[] _unpackedvs;
+    MgPackedPoints::release(_packedvs);
+}
+
+bool MgSplines::packPoints(float tol)
+{
+    if (_knotvs) {
+        _packedvs = MgPackedPoints::pack(_count, &_knotvs[0].x, tol);
+        if (!_packedvs)
+            return false;
+    }
+    if (!__super::packPoints(tol)) {
+        MgPackedPoints::release(_packedvs);
+        return false;
+    }
+    if (_packedvs) {
+        delete[] _knotvs;
+        _knotvs = (Vector2d*)0;
+    }
+    return true;
+}
+
+void MgSplines::unpackPoints()
+{
+    if (_packedvs) {
+        if (_unpackedvs) {          // 直接使用 getVectors() 已解码的数组
+            _knotvs = _unpackedvs;
+            _unpackedvs = (Vector2d*)0;
+        } else {
+            _knotvs = new Vector2d[_count];
+            _packedvs->unpack(&_knotvs[0].x);
+        }
+        MgPackedPoints::release(_packedvs);
+    }
+    __super::unpackPoints();
+}
+
+const Vector2d* MgSplines::unpackedVectors() const
+{
+    if (!_unpackedvs) {
+        _unpackedvs = new Vector2d[_count];
+        _packedvs->unpack(&_unpackedvs[0].x);
+    }
+    return _unpackedvs;
+}
+
+const Vector2d* MgSplines::readVectors(Vector2d*& buf) const
+{
+    if (!_packedvs)
+        return _knotvs;
+    if (_unpackedvs)
+        return _unpackedvs;
+    buf = new Vector2d[_count];
+    _packedvs->unpack(&buf[0].x);
+    return buf;
+}
+
+void MgSplines::freePacked()
+{
+    MgPackedPoints::release(_packedvs);
+    delete[] _unpackedvs;
+    _unpackedvs = (Vector2d*)0;
+    __super::freePacked();
 }
 
 float MgSplines::_hitTest(const Point2d& pt, float tol, MgHitResult& res) const
 {
     if (_count == 2) {
-        return mglnrel::ptToLine(_points[0], _points[1], pt, res.nearpt);
+        return mglnrel::ptToLine(_getPoint(0), _getPoint(1), pt, res.nearpt);
     }
-    if (_knotvs) {
-        return mgnear::cubicSplinesHit(_count, _points, _knotvs, isClosed(),
+    const MgSegmentCache* curves = getCurveCache();
+    if (curves) {
+        return curves->curvesHit(pt, tol, res.nearpt, res.segment);
+    }
+    MgLinesReader r(*this);
+    if (r.vectors()) {
+        return mgnear::cubicSplinesHit(_count, r.points(), r.vectors(), isClosed(),
                                        pt, tol, res.nearpt, res.segment, false);
     }
-    return mgnear::quadSplinesHit(_count, _points, isClosed(),
+    return mgnear::quadSplinesHit(_count, r.points(), isClosed(),
                                   pt, tol, res.nearpt, res.segment);
 }
 
@@ -32,25 +103,53 @@ bool MgSplines::_hitTestBox(const Box2d& rect) const
 {
     if (!__super::_hitTestBox(rect))
         return false;
-    if (_knotvs) {
-        return mgnear::cubicSplinesIntersectBox(rect, _count, _points, _knotvs, isClosed(), false);
+    if (_knotvs || _packedvs) {
+        const MgSegmentCache* curves = getCurveCache();
+        if (curves) {
+            return curves->intersectBox(rect);
+        }
+        MgLinesReader r(*this);
+        return mgnear::cubicSplinesIntersectBox(rect, _count, r.points(), r.vectors(), isClosed(), false);
     }
     return true;
 }
 
+const MgSegmentCache* MgSplines::getCurveCache() const
+{
+    if (_count < MgSegmentCache::kMinSegments) {
+        return (const MgSegmentCache*)0;
+    }
+    if (!_curves || _curves->isClosed() != isClosed()) {
+        if (!_curves)
+            _curves = new MgSegmentCache();
+        MgLinesReader r(*this);
+        if (r.vectors())
+            _curves->setCubicSplines(_count, r.points(), r.vectors(), isClosed(), false);
+        else
+            _curves->setQuadSplines(_count, r.points(), isClosed());
+    }
+    return _curves;
+}
+
 void MgSplines::_output(MgPath& path) const
 {
+    MgLinesReader r(*this);
+    const Point2d* pts = r.points();
+    const Vector2d* vs = r.vectors();
+    
     if (_count < 2) {
     }
     else if (_count == 2) {
-        path.moveTo(_points[0]);
-        path.lineTo(_points[1]);
-    }
-    else if (_knotvs) {
-        path.moveTo(_points[0]);
-        for (int i = 1; i + 1 < _count; i++) {
-            path.bezierTo(_points[i] + _knotvs[i],
-                          _points[i+1] - _knotvs[i+1], _points[i+1]);
+        path.moveTo(pts[0]);
+        path.lineTo(pts[1]);
+    }
+    else if (vs) {
+        int n = isClosed() ? _count : _count - 1;
+        
+        path.moveTo(pts[0]);
+        for (int i = 0; i < n; i++) {
+            path.bezierTo(pts[i] + vs[i],
+                          pts[(i+1) % _count] - vs[(i+1) % _count], pts[(i+1) % _count]);
         }
         if (isClosed()) {
             path.closeFigure();
@@ -61,13 +160,13 @@ void MgSplines::_output(MgPath& path) const
         
         for (int i = 0; i < (isClosed() ? _count : _count - 2); i++) {
             if (i == 0) {
-                path.moveTo(isClosed() ? (_points[0] + _points[1]) / 2 : _points[0]);
+                path.moveTo(isClosed() ? (pts[0] + pts[1]) / 2 : pts[0]);
             }
             if (isClosed() || i + 3 < _count)
-                mid = (_points[(i+1) % _count] + _points[(i+2) % _count]) / 2;
+                mid = (pts[(i+1) % _count] + pts[(i+2) % _count]) / 2;
             else
-                mid = _points[i+2];
-            path.quadTo(_points[(i+1) % _count], mid);
+                mid = pts[i+2];
+            path.quadTo(pts[(i+1) % _count], mid);
         }
         if (isClosed()) {
             path.closeFigure();
@@ -78,7 +177,10 @@ void MgSplines::_output(MgPath& path) const
 void MgSplines::_copy(const MgSplines& src)
 {
     __super::_copy(src);    // will clear _knotvs via MgSplines::resize
-    if (src._knotvs) {
+    if (src._packedvs) {
+        _packedvs = src._packedvs->clone();
+    }
+    else if (src._knotvs) {
         _knotvs = new Vector2d[_count];
         for (int i = 0; i < _count; i++)
             _knotvs[i] = src._knotvs[i];
@@ -87,12 +189,16 @@ void MgSplines::_copy(const MgSplines& src)
 
 bool MgSplines::_equals(const MgSplines& src) const
 {
-    if (!__super::_equals(src) || !_knotvs != !src._knotvs)
+    if (!__super::_equals(src))
         return false;
     
-    if (_knotvs) {
+    MgLinesReader a(*this), b(src);
+    
+    if (!a.vectors() != !b.vectors())
+        return false;
+    if (a.vectors()) {
         for (int i = 0; i < _count; i++) {
-            if (_knotvs[i] != src._knotvs[i])
+            if (a.vectors()[i] != b.vectors()[i])
                 return false;
         }
     }
@@ -102,6 +208,7 @@ bool MgSplines::_equals(const MgSplines& src) const
 
 void MgSplines::_transform(const Matrix2d& mat)
 {
+    unpack();
     if (_knotvs) {
         for (int i = 0; i < _count; i++)
             _knotvs[i] *= mat;
@@ -115,6 +222,15 @@ void MgSplines::_clear()
     __super::_clear();
 }
 
+void MgSplines::_clearCachedData()
+{
+    if (_curves) {
+        delete _curves;
+        _curves = (MgSegmentCache*)0;
+    }
+    __super::_clearCachedData();
+}
+
 void MgSplines::_setPoint(int index, const Point2d& pt)
 {
     clearVectors();
@@ -123,17 +239,26 @@ void MgSplines::_setPoint(int index, const Point2d& pt)
 
 void MgSplines::clearVectors()
 {
+    if (_packedvs) {
+        MgPackedPoints::release(_packedvs);
+        delete[] _unpackedvs;
+        _unpackedvs = (Vector2d*)0;
+        _clearCachedData();
+    }
     if (_knotvs) {
         delete[] _knotvs;
         _knotvs = (Vector2d*)0;
+        _clearCachedData();
     }
 }
 
 bool MgSplines::_save(MgStorage* s) const
 {
     bool ret = __super::_save(s);
-    if (_knotvs) {
-        s->writeFloatArray("vec", (const float*)_knotvs, _count * 2);
+    MgLinesReader r(*this);
+    
+    if (r.vectors()) {
+        s->writeFloatArray("vec", (const float*)r.vectors(), _count * 2);
     }
     return ret;
 }
@@ -203,13 +328,42 @@ bool MgSplines::_setHandlePoint(int index, const Point2d& pt, float tol)
 
 bool MgSplines::smooth(const Matrix2d& m2d, float tol)
 {
+    unpack();
     return smoothForPoints(_count, _points, m2d, tol) > 0;
 }
 
+int MgSplines::smoothForFitter(const MgCurveFitter& fitter, const Matrix2d& d2m)
+{
+    int knotCount = fitter.getMaxKnotCount();
+    
+    if (knotCount < 2)
+        return 0;
+    unpack();
+    
+    Point2d* knots = new Point2d[knotCount];
+    Vector2d* knotvs = new Vector2d[knotCount];
+    
+    _count = fitter.getKnots(knotCount, knots, knotvs);
+    _maxCount = knotCount;
+    
+    for (int i = 0; i < _count; i++) {
+        knots[i] *= d2m;
+        knotvs[i] *= d2m;
+    }
+    delete[] _points;
+    _points = knots;
+    delete[] _knotvs;
+    _knotvs = knotvs;
+    update();
+    
+    return _count;
+}
+
 int MgSplines::smoothForPoints(int count, const Point2d* points, const Matrix2d& m2d, float tol)
 {
     if (count < 3 || !points || tol < _MGZERO)
         return 0;
+    unpack();
     
     int i, knotCount = count + 1;
     Point2d* ptx = new Point2d[count];
@@ -220,7 +374,7 @@ int MgSplines::smoothForPoints(int count, const Point2d* points, const Matrix2d&
     for (i = 0; i < count; i++)
         ptx[i] = points[i] * m2d;
     
-    _count = mgcurv::fitCurve(knotCount, knots, knotvs, count, ptx, tol);
+    _count = mgcurv::fitCurveFast(knotCount, knots, knotvs, count, ptx, tol);
     _maxCount = knotCount;
     
     for (i = 0; i < _count; i++) {
@@ -50,7 +50,7 @@ private:
     int readIntArray(const char* name, int* values, int count, bool report = true);
     void writeIntArray(const char* name, const int* values, int count);
     
-    bool hasNum(const char* name) { return strspn(name, "01234567890") > 0; }
+    bool hasNum(const char* name) { return strpbrk(name, "0123456789") != NULL; }
     
 private:
     Document _doc;
@@ -12,49 +12,660 @@
 #include "mglog.h"
 #include <sstream>
 #include <map>
+#include <set>
+#include <deque>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
 
 static const bool VG_PRETTY = false;
+static const char* const JOURNAL_NAME = "steps.vgj";    // 所有步骤的追加式日志文件
+static const char JOURNAL_MAGIC[4] = { 'V', 'G', 'J', '1' };
+static const char* const INDEX_NAME = "records.jsonl";      // 播放索引，每帧追加一行
+static const char* const OLD_INDEX_NAME = "records.json";   // 以前整体重写的播放索引
+static const int FRAME_MARK = 0x4D52467A;
+static const int CHECKPOINT = 2;           // 帧头中检查点的类型
+
+// 日志中每个步骤记录的帧头，其后紧跟 size 字节的 JSON 内容
+struct FrameHeader {
+    int     mark;
+    int     index;      // 步骤序号，即原来的文件序号
+    int     back;       // 0:正向(.vgr), 1:反向(.vgu), 2:检查点(该步骤后的完整文档)
+    int     tick;
+    int     flags;
+    int     size;
+};
+
+static long nowMs()
+{
+#ifdef _WIN32
+    return (long)GetTickCount();
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+#endif
+}
+
+// 读取其他线程修改的计数，用相同值的比较并交换起到内存屏障的作用
+static long atomicRead(const volatile long* p)
+{
+    volatile long* v = const_cast<volatile long*>(p);
+    long value = *v;
+    
+    while (!giAtomicCompareAndSwap(v, value, value)) {
+        value = *v;
+    }
+    return value;
+}
+
+// 写入供其他线程读取的值
+static void atomicWrite(volatile long* p, long value)
+{
+    long old = *p;
+    
+    while (!giAtomicCompareAndSwap(p, value, old)) {
+        old = *p;
+    }
+}
+
+#ifndef _WIN32
+// 在条件变量上最多等待 ms 毫秒，调用前已锁定 mutex
+static void timedWait(pthread_cond_t* cond, pthread_mutex_t* mutex, int ms)
+{
+    struct timeval tv;
+    struct timespec ts;
+    
+    gettimeofday(&tv, NULL);
+    tv.tv_usec += ms * 1000;
+    ts.tv_sec = tv.tv_sec + tv.tv_usec / 1000000;
+    ts.tv_nsec = (tv.tv_usec % 1000000) * 1000;
+    pthread_cond_timedwait(cond, mutex, &ts);
+}
+#endif
+
+// 动态折线增量的紧凑编码：坐标按每帧记录的步长 dynq 量化，首个新增点记录量化坐标，
+// 其余点记录与前一点的差值，都用 zig-zag 变长整数编码后再转为 base64 文本
+
+static const float DYN_QUANTUM = 0.01f;         // 文档没有显示比例时的量化步长
+static const float DYN_PIXELS = 0.1f;           // 量化误差不超过的显示像素数
+
+// 得到动态图形坐标的量化步长，为文档显示比例下 DYN_PIXELS 个像素对应的模型长度
+static float dynQuantum(MgShapeDoc* doc)
+{
+    if (!doc || doc->getViewScale() < _MGZERO)
+        return DYN_QUANTUM;
+    
+    float pixelW = 25.4f / (96.f * doc->getViewScale());     // 一个像素的世界长度(mm)
+    float m2w = Vector2d(1.f, 0.f).transform(doc->modelTransform()).length();
+    float q = DYN_PIXELS * pixelW / (m2w > _MGZERO ? m2w : 1.f);
+    
+    return q > 1e-4f ? q : 1e-4f;               // 避免量化后的整数溢出
+}
+
+static void putVarint(std::string& buf, unsigned v)
+{
+    for (; v >= 0x80; v >>= 7) {
+        buf += (char)((v & 0x7F) | 0x80);
+    }
+    buf += (char)v;
+}
+
+static bool getVarint(const std::string& buf, size_t& pos, unsigned& v)
+{
+    v = 0;
+    for (int shift = 0; pos < buf.size() && shift < 35; shift += 7) {
+        unsigned char c = (unsigned char)buf[pos++];
+        v |= (unsigned)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static inline unsigned zigzag(int v) { return ((unsigned)v << 1) ^ (unsigned)(v >> 31); }
+static inline int unzigzag(unsigned v) { return (int)(v >> 1) ^ -(int)(v & 1); }
+static inline int quantize(float v, float q) { return (int)floorf(v / q + 0.5f); }
+
+static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string encodeBase64(const std::string& data)
+{
+    std::string text;
+    unsigned bits = 0;
+    int n = 0;
+    
+    text.reserve((data.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < data.size(); i++) {
+        bits = (bits << 8) | (unsigned char)data[i];
+        for (n += 8; n >= 6; n -= 6) {
+            text += BASE64[(bits >> (n - 6)) & 0x3F];
+        }
+    }
+    if (n > 0) {
+        text += BASE64[(bits << (6 - n)) & 0x3F];
+    }
+    return text;
+}
+
+static std::string decodeBase64(const char* text)
+{
+    std::string data;
+    unsigned bits = 0;
+    int n = 0;
+    
+    for (; *text; text++) {
+        const char* p = strchr(BASE64, *text);
+        if (!p || !*p)
+            break;
+        bits = (bits << 6) | (unsigned)(p - BASE64);
+        if ((n += 6) >= 8) {
+            n -= 8;
+            data += (char)((bits >> n) & 0xFF);
+        }
+    }
+    return data;
+}
+
+// 记录一个图形的增量：图形序号，新增点数，各新增点的坐标差
+static void encodeIncrement(std::string& buf, int index, float q,
+                            const MgBaseLines* oldlines, const MgBaseLines* lines)
+{
+    int n = oldlines->getPointCount();
+    int x = 0, y = 0;                           // 不用已有点作基准，以免与播放端的舍入不同
+    
+    putVarint(buf, index);
+    putVarint(buf, lines->getPointCount() - n);
+    
+    for (int i = n; i < lines->getPointCount(); i++) {
+        int qx = quantize(lines->getPoint(i).x, q);
+        int qy = quantize(lines->getPoint(i).y, q);
+        putVarint(buf, zigzag(qx - x));
+        putVarint(buf, zigzag(qy - y));
+        x = qx;
+        y = qy;
+    }
+}
+
+// 将增量加到上一帧的动态图形上，生成新的动态图形
+static bool applyIncrement(const std::string& buf, float q, const MgShapes* lastDyns, MgShapes* dyns)
+{
+    std::vector<MgShape*> shapes;
+    MgShapeIterator it(lastDyns);
+    size_t pos = 0;
+    unsigned index, count, dx, dy;
+    bool ret = q > 0;
+    
+    while (const MgShape* sp = it.getNext()) {
+        shapes.push_back(sp->cloneShape());
+    }
+    while (ret && pos < buf.size()) {
+        ret = getVarint(buf, pos, index) && getVarint(buf, pos, count)
+            && index < shapes.size()
+            && shapes[index]->shapec()->isKindOf(MgBaseLines::Type());
+        if (!ret)
+            break;
+        
+        MgBaseLines* lines = (MgBaseLines*)shapes[index]->shape();
+        int x = 0, y = 0;
+        
+        for (unsigned i = 0; i < count && ret; i++) {
+            ret = getVarint(buf, pos, dx) && getVarint(buf, pos, dy);
+            if (!ret)
+                break;
+            x += unzigzag(dx);
+            y += unzigzag(dy);
+            lines->addPoint(Point2d(x * q, y * q));
+        }
+    }
+    for (size_t i = 0; i < shapes.size(); i++) {
+        if (ret) {
+            dyns->addShapeDirect(shapes[i], true);
+        } else {
+            shapes[i]->release();
+        }
+    }
+    return ret;
+}
+
+// 录制用的后台线程，空闲时才用条件变量等待唤醒
+struct MgRecordThread {
+    volatile long   idle;           // 线程是否在等待
+    volatile long   quit;
+#ifdef _WIN32
+    HANDLE          thread;
+    HANDLE          event;
+#else
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+#endif
+    
+    MgRecordThread() : idle(0), quit(0) {}
+    virtual ~MgRecordThread() {}
+    virtual void run() = 0;
+    virtual bool hasWork() const = 0;
+    
+    bool start();
+    void stop();
+    void wakeUp(bool force);
+    void waitForWork();
+    
+#ifdef _WIN32
+    static DWORD WINAPI threadProc(LPVOID p) { ((MgRecordThread*)p)->run(); return 0; }
+#else
+    static void* threadProc(void* p) { ((MgRecordThread*)p)->run(); return NULL; }
+#endif
+};
+
+bool MgRecordThread::start()
+{
+#ifdef _WIN32
+    event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    thread = event ? CreateThread(NULL, 0, threadProc, this, 0, NULL) : NULL;
+    if (!thread && event) {
+        CloseHandle(event);
+    }
+    return thread != NULL;
+#else
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+    if (pthread_create(&thread, NULL, threadProc, this) != 0) {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+        return false;
+    }
+    return true;
+#endif
+}
+
+void MgRecordThread::stop()
+{
+    giAtomicIncrement(&quit);
+    wakeUp(true);
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+    CloseHandle(event);
+#else
+    pthread_join(thread, NULL);
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+#endif
+}
+
+void MgRecordThread::wakeUp(bool force)
+{
+    if (idle || force) {
+#ifdef _WIN32
+        SetEvent(event);
+#else
+        pthread_mutex_lock(&mutex);
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+#endif
+    }
+}
+
+void MgRecordThread::waitForWork()
+{
+    giAtomicIncrement(&idle);
+#ifdef _WIN32
+    if (!hasWork() && !quit) {
+        WaitForSingleObject(event, 100);
+    }
+#else
+    pthread_mutex_lock(&mutex);
+    if (!hasWork() && !quit) {
+        timedWait(&cond, &mutex, 100);          // 超时后重新检查，避免意外丢失唤醒
+    }
+    pthread_mutex_unlock(&mutex);
+#endif
+    giAtomicDecrement(&idle);
+}
+
+// 待后台写入的一个步骤，文档和图形都是调用方交出的只读快照
+struct MgRecordItem {
+    long            tick;
+    long            changeCountOld;
+    long            changeCountNew;
+    MgShapeDoc      *doc;
+    MgShapes        *dynShapes;
+    std::vector<MgShapes*> extShapes;
+    long            queuedAt;
+};
+
+// 录制的后台写线程。录制方与写线程间是单生产者单消费者的无锁环形队列，
+// 队列满时录制方等待写线程写完一步(反压)
+struct MgRecordWriter : public MgRecordThread {
+    MgRecordShapes  *owner;
+    std::vector<MgRecordItem> items;
+    volatile long   head;           // 已入队的步骤数，仅录制方修改
+    volatile long   tail;           // 已写完的步骤数，仅写线程修改
+    volatile long   maxDepth;
+    volatile long   lastLatency;
+    volatile long   maxLatency;
+#ifdef _WIN32
+    HANDLE          progress;       // 写完一步的通知
+#else
+    pthread_cond_t  progress;
+#endif
+    
+    MgRecordWriter(MgRecordShapes* owner, int capacity);
+    ~MgRecordWriter();
+    
+    void push(long tick, long changeCountOld, long changeCountNew, MgShapeDoc* doc,
+              MgShapes* dynShapes, const std::vector<MgShapes*>& extShapes);
+    bool flush(int timeoutMs);
+    void waitProgress(int ms);
+    int depth() const { return (int)(atomicRead(&head) - atomicRead(&tail)); }
+    virtual void run();
+    virtual bool hasWork() const { return atomicRead(&tail) != atomicRead(&head); }
+};
+
+MgRecordWriter::MgRecordWriter(MgRecordShapes* owner, int capacity) : owner(owner)
+    , items(capacity), head(0), tail(0), maxDepth(0), lastLatency(0), maxLatency(0)
+{
+#ifdef _WIN32
+    progress = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+    pthread_cond_init(&progress, NULL);
+#endif
+}
+
+MgRecordWriter::~MgRecordWriter()
+{
+#ifdef _WIN32
+    CloseHandle(progress);
+#else
+    pthread_cond_destroy(&progress);
+#endif
+}
+
+// 等待写线程写完一步，最多等待 ms 毫秒，代替忙等
+void MgRecordWriter::waitProgress(int ms)
+{
+    const long n = atomicRead(&tail);
+    
+    wakeUp(false);
+#ifdef _WIN32
+    if (atomicRead(&tail) == n) {
+        WaitForSingleObject(progress, ms);
+    }
+#else
+    pthread_mutex_lock(&mutex);
+    if (atomicRead(&tail) == n) {
+        timedWait(&progress, &mutex, ms);
+    }
+    pthread_mutex_unlock(&mutex);
+#endif
+}
+
+void MgRecordWriter::push(long tick, long changeCountOld, long changeCountNew, MgShapeDoc* doc,
+                          MgShapes* dynShapes, const std::vector<MgShapes*>& extShapes)
+{
+    const long capacity = (long)items.size();
+    
+    if (head - atomicRead(&tail) >= capacity) {
+        LOGD("Record queue is full, wait for the writer");
+        while (head - atomicRead(&tail) >= capacity) {
+            waitProgress(100);
+        }
+    }
+    
+    MgRecordItem& item = items[head % capacity];
+    
+    item.tick = tick;
+    item.changeCountOld = changeCountOld;
+    item.changeCountNew = changeCountNew;
+    item.doc = doc;
+    item.dynShapes = dynShapes;
+    item.extShapes = extShapes;
+    item.queuedAt = nowMs();
+    for (unsigned i = 0; i < extShapes.size(); i++) {
+        extShapes[i]->addRef();
+    }
+    
+    long n = giAtomicIncrement(&head) - atomicRead(&tail);
+    if (maxDepth < n) {
+        atomicWrite(&maxDepth, n);
+    }
+    wakeUp(false);
+}
+
+bool MgRecordWriter::flush(int timeoutMs)
+{
+    long start = nowMs();
+    
+    while (atomicRead(&tail) != head) {
+        long left = timeoutMs >= 0 ? timeoutMs - (nowMs() - start) : 100;
+        if (left < 0) {
+            return false;
+        }
+        waitProgress((int)mgMin(left, 100L));
+    }
+    return true;
+}
+
+void MgRecordWriter::run()
+{
+    for (;;) {
+        if (tail == atomicRead(&head)) {
+            if (quit)
+                break;
+            waitForWork();
+            continue;
+        }
+        
+        MgRecordItem& item = items[tail % (long)items.size()];
+        
+        owner->saveStep(item.tick, item.changeCountOld, item.changeCountNew,
+                        item.doc, item.dynShapes, item.extShapes);
+        for (unsigned i = 0; i < item.extShapes.size(); i++) {
+            MgObject::release_pointer(item.extShapes[i]);
+        }
+        item.extShapes.clear();
+        
+        long latency = nowMs() - item.queuedAt;
+        atomicWrite(&lastLatency, latency);
+        if (maxLatency < latency) {
+            atomicWrite(&maxLatency, latency);
+        }
+        giAtomicIncrement(&tail);
+#ifdef _WIN32
+        SetEvent(progress);
+#else
+        pthread_mutex_lock(&mutex);
+        pthread_cond_broadcast(&progress);
+        pthread_mutex_unlock(&mutex);
+#endif
+    }
+}
+
+// 复制动态图形作为下一帧增量解码的基准
+static void copyDyns(MgShapes*& base, const MgShapes* dyns)
+{
+    MgObject::release_pointer(base);
+    if (dyns) {
+        base = MgShapes::create();
+        base->copyShapes(dyns, false);
+    }
+}
+
+// 预先解码好的一帧，文档和动态图形由预取线程交给播放方
+struct MgPrefetchedFrame {
+    int             ret;            // applyRecord 的结果
+    int             index;
+    int             tick;
+    MgShapeDoc      *doc;           // 该帧后文档的浅拷贝，文档未变时为空
+    MgShapes        *dyns;          // 该帧的动态图形，未变时为空
+    MgShapes        *base;          // 解码该帧前的增量基准，停止预取时用于回退
+    int             baseTick;
+};
+
+// 播放的预取线程，依次解码后续帧放入单生产者单消费者的环形队列。
+// 每个播放项有自己的播放器和预取线程，多个播放项就能并行解码。
+// 解码的时刻和增量基准是线程自己的，播放器的步骤号和时刻由播放方取帧时更新
+struct MgRecordPrefetcher : public MgRecordThread {
+    MgRecordShapes  *owner;
+    MgShapeFactory  *factory;
+    MgShapeDoc      *doc;           // 预取线程独占的解码文档
+    std::vector<MgPrefetchedFrame> items;
+    volatile long   head;           // 已解码的帧数，仅预取线程修改
+    volatile long   tail;           // 已取走的帧数，仅播放方修改
+    volatile long   ended;          // 后面暂时没有帧了
+    int             next;           // 下一个要解码的步骤号
+    int             tick;           // 已解码帧的时刻
+    MgShapes        *lastDyns;      // 已解码帧的动态图形，作为增量解码的基准
+    
+    MgRecordPrefetcher(MgRecordShapes* owner, MgShapeFactory* f, MgShapeDoc* doc, int depth)
+        : owner(owner), factory(f), doc(doc), items(depth), head(0), tail(0), ended(0), next(0)
+        , tick(0), lastDyns(NULL) {}
+    ~MgRecordPrefetcher();
+    
+    int count() const { return (int)(atomicRead(&head) - tail); }
+    const MgPrefetchedFrame* front() const {
+        return atomicRead(&head) != tail ? &items[tail % (long)items.size()] : NULL; }
+    void pop();
+    virtual void run();
+    virtual bool hasWork() const { return !ended && head - atomicRead(&tail) < (long)items.size(); }
+};
+
+MgRecordPrefetcher::~MgRecordPrefetcher()
+{
+    while (head != tail) {
+        MgPrefetchedFrame& item = items[tail % (long)items.size()];
+        MgObject::release_pointer(item.doc);
+        MgObject::release_pointer(item.dyns);
+        MgObject::release_pointer(item.base);
+        tail++;
+    }
+    MgObject::release_pointer(doc);
+    MgObject::release_pointer(lastDyns);
+}
+
+void MgRecordPrefetcher::pop()
+{
+    MgObject::release_pointer(items[tail % (long)items.size()].base);
+    giAtomicIncrement(&tail);
+    wakeUp(false);
+}
+
+// 内存中的撤销快照，是某步骤后文档的浅拷贝，图形与其他快照共享
+struct MgUndoSnapshot {
+    MgShapeDoc  *doc;
+    long        changeCount;
+    int         tick;
+    long        bytes;          // 估计的独占内存
+};
 
 struct MgRecordShapes::Impl
 {
     std::string     path;
     int             type;
     std::map<int, long> id2ver;
-    std::vector<int>    lastids;
+    long            markLineage;        // 上次记录时图形列表的改变记录点
+    long            markSeq;
     volatile int    fileCount;
     volatile int    maxCount;
     volatile long   loading;
     MgShapeDoc      *lastDoc;
-    MgShape         *lastShape;
+    MgShapes        *lastDyns;          // 上一帧的动态图形，作为增量记录的基准
     volatile long   startTick;
     int             tick, lastTick;
+    int             stepTick;           // 当前步骤记录中写入的时刻
     int             flags[2];
     int             shapeCount;
-    MgJsonStorage   *js[3];
-    MgStorage       *s[3];
+    MgJsonStorage   *js[2];
+    MgStorage       *s[2];
+    FILE            *journal;
+    FILE            *indexFile;         // 播放索引文件，打开后每帧追加一行
+    bool            recordIndex;        // 是否需要记录播放索引
+    long            journalEnd;         // 日志中最后一个完整帧的结束位置
+    std::vector<long>   offsets[3];     // 各步骤正向、反向记录和检查点在日志中的位置
+    bool            keepJournal;        // 续录时保留已有日志
+    MgRecordWriter  *writer;            // 后台写线程，为空时同步写入
+    MgRecordPrefetcher  *prefetcher;    // 播放的预取线程
+    int             checkpointFrames;   // 每隔多少帧写一个检查点
+    long            checkpointBytes;    // 增量记录累计多少字节后写一个检查点
+    int             deltaFrames;        // 上个检查点以来的帧数
+    long            deltaBytes;         // 上个检查点以来的增量字节数
+    long            stepBytes;          // 当前步骤记录的字节数
+    std::deque<MgUndoSnapshot> snapshots;   // 内存中的撤销快照，依次对应状态 firstSnapshot 起的各步骤
+    int             firstSnapshot;
+    long            undoBudget;         // 撤销快照的内存上限，为0时不用快照
+    long            undoBytes;
+    volatile long   pubTick;            // 写线程写完一步后发布的状态，供写入期间的查询
+    volatile long   pubFileCount;
+    volatile long   pubMaxCount;
+    volatile long   pubFlags;
     
-    Impl(long curTick) : fileCount(0), maxCount(0), loading(0), lastDoc(NULL)
-        , lastShape(NULL), startTick(curTick), tick(0), lastTick(0)
+    Impl(long curTick) : markLineage(0), markSeq(0), fileCount(0), maxCount(0), loading(0)
+        , lastDoc(NULL), lastDyns(NULL), startTick(curTick), tick(0), lastTick(0), stepTick(0)
+        , journal(NULL), indexFile(NULL), recordIndex(false), journalEnd(0), keepJournal(false)
+        , writer(NULL), prefetcher(NULL), checkpointFrames(300), checkpointBytes(1L << 20)
+        , deltaFrames(0), deltaBytes(0), stepBytes(0)
+        , firstSnapshot(0), undoBudget(0), undoBytes(0)
+        , pubTick(0), pubFileCount(0), pubMaxCount(0), pubFlags(0)
     {
         memset(flags, 0, sizeof(flags));
         memset(js, 0, sizeof(js));
         memset(s, 0, sizeof(s));
     }
     ~Impl() {
+        clearSnapshots(0);
         MgObject::release_pointer(lastDoc);
-        MgObject::release_pointer(lastShape);
+        MgObject::release_pointer(lastDyns);
+        if (journal) {
+            fclose(journal);
+        }
     }
     
     void beginJsonFile();
     bool saveJsonFile();
+    bool openJournal();
+    void scanJournal();
+    long getOffset(int kind, int index) const;
+    void setOffset(int kind, int index, long offset);
+    void forwardFrameAdded(int index);
+    void frameAdded(const FrameHeader& h);
+    bool appendFrame(int kind, int index, int flags, const char* content);
+    MgStorage* loadStep(int kind, int index, MgJsonStorage& js);
+    bool hasStep(int index);
+    bool needCheckpoint() const;
+    bool writeCheckpoint(const MgShapes* dynShapes);
     std::string getFileName(bool back, int index = -1) const;
     void resetVersion(const MgShapes* shapes);
     void startRecord();
     void stopRecordIndex();
-    bool saveIndexFile(bool ended);
+    bool openIndexFile();
+    bool appendIndex(int tick, int flags);
     void recordShapes(const MgShapes* shapes);
+    void recordShape(const MgShapes* shapes, const MgShape* sp, std::vector<int>& newids, int& i2);
+    static void getShapeIds(const MgShapes* shapes, std::vector<int>& ids);
     bool forUndo() const { return type == 0; }
+    void waitWriter() { if (writer) writer->flush(-1); }
+    bool isWriting() const { return writer && writer->depth() > 0; }
+    void publish() {
+        atomicWrite(&pubTick, tick);
+        atomicWrite(&pubFileCount, fileCount);
+        atomicWrite(&pubMaxCount, maxCount);
+        atomicWrite(&pubFlags, flags[0]);
+    }
     bool incrementRecord(MgShapes* dynShapes);
+    void setLastDyns(const MgShapes* dyns);
+    void pushSnapshot(MgShapeDoc* doc, int tick, long changeCountOld, long changeCountNew);
+    void clearSnapshots(int from);
+    bool applySnapshot(int state, MgShapeDoc* doc, long* changeCount);
 };
 
 MgRecordShapes::MgRecordShapes(const char* path, MgShapeDoc* doc, bool forUndo, long curTick)
@@ -74,38 +685,111 @@ MgRecordShapes::MgRecordShapes(const char* path, MgShapeDoc* doc, bool forUndo,
 
 MgRecordShapes::~MgRecordShapes()
 {
+    stopPrefetch();
+    setAsync(false);
     _im->stopRecordIndex();
     delete _im;
 }
 
 void MgRecordShapes::stopRecordIndex()
 {
+    _im->waitWriter();
     _im->stopRecordIndex();
 }
 
+bool MgRecordShapes::setAsync(bool async, int capacity)
+{
+    if (async && !_im->writer) {
+        _im->writer = new MgRecordWriter(this, mgMax(capacity, 1));
+        if (!_im->writer->start()) {
+            LOGE("Fail to start the record writer thread");
+            delete _im->writer;
+            _im->writer = NULL;
+        }
+    } else if (!async && _im->writer) {
+        _im->writer->stop();                    // 写完队列中的步骤后退出
+        delete _im->writer;
+        _im->writer = NULL;
+    }
+    return !!_im->writer == async;
+}
+
+void MgRecordShapes::setUndoMemoryBudget(long bytes)
+{
+    _im->waitWriter();
+    _im->undoBudget = _im->forUndo() && bytes > 0 ? bytes : 0;
+    
+    if (!_im->undoBudget) {
+        _im->clearSnapshots(0);
+    } else if (_im->snapshots.empty() && _im->lastDoc && _im->fileCount > 0) {
+        _im->pushSnapshot(_im->lastDoc, _im->tick, -1, -1);     // 当前状态
+    }
+}
+
+long MgRecordShapes::getUndoMemoryBytes() const
+{
+    return _im->undoBytes;
+}
+
+bool MgRecordShapes::isAsync() const
+{
+    return !!_im->writer;
+}
+
+bool MgRecordShapes::flush(int timeoutMs)
+{
+    return !_im->writer || _im->writer->flush(timeoutMs);
+}
+
+int MgRecordShapes::getQueueDepth() const
+{
+    return _im->writer ? _im->writer->depth() : 0;
+}
+
+int MgRecordShapes::getMaxQueueDepth() const
+{
+    return _im->writer ? (int)atomicRead(&_im->writer->maxDepth) : 0;
+}
+
+long MgRecordShapes::getLastWriteLatency() const
+{
+    return _im->writer ? atomicRead(&_im->writer->lastLatency) : 0;
+}
+
+long MgRecordShapes::getMaxWriteLatency() const
+{
+    return _im->writer ? atomicRead(&_im->writer->maxLatency) : 0;
+}
+
+long MgRecordShapes::getWrittenCount() const
+{
+    return _im->writer ? atomicRead(&_im->writer->tail) : 0;
+}
+
 bool MgRecordShapes::isPlaying() const
 {
     return _im->type > 1;
 }
 
+// 写线程有未写完的步骤时返回其最近发布的状态，否则写线程空闲，可直接读取
 int MgRecordShapes::getFileTick() const
 {
-    return _im->tick;
+    return _im->isWriting() ? (int)atomicRead(&_im->pubTick) : _im->tick;
 }
 
 int MgRecordShapes::getFileFlags() const
 {
-    return _im->flags[0];
+    return _im->isWriting() ? (int)atomicRead(&_im->pubFlags) : _im->flags[0];
 }
 
 int MgRecordShapes::getFileCount() const
 {
-    return _im->fileCount;
+    return _im->isWriting() ? (int)atomicRead(&_im->pubFileCount) : _im->fileCount;
 }
 
 int MgRecordShapes::getMaxFileCount() const
 {
-    return _im->maxCount;
+    return _im->isWriting() ? (int)atomicRead(&_im->pubMaxCount) : _im->maxCount;
 }
 
 long MgRecordShapes::getCurrentTick(long curTick) const
@@ -124,6 +808,19 @@ bool MgRecordShapes::onResume(long ticks)
 
 bool MgRecordShapes::recordStep(long tick, long changeCountOld, long changeCountNew, MgShapeDoc* doc,
                                 MgShapes* dynShapes, const std::vector<MgShapes*>& extShapes)
+{
+    if (_im->writer) {
+        if (_im->writer->depth() == 0) {
+            _im->publish();                     // 写线程空闲，发布撤销等在本线程改变的状态
+        }
+        _im->writer->push(tick, changeCountOld, changeCountNew, doc, dynShapes, extShapes);
+        return true;
+    }
+    return saveStep(tick, changeCountOld, changeCountNew, doc, dynShapes, extShapes);
+}
+
+bool MgRecordShapes::saveStep(long tick, long changeCountOld, long changeCountNew, MgShapeDoc* doc,
+                              MgShapes* dynShapes, const std::vector<MgShapes*>& extShapes)
 {
     _im->beginJsonFile();
     _im->tick = (int)tick;
@@ -134,7 +831,7 @@ bool MgRecordShapes::recordStep(long tick, long changeCountOld, long changeCount
             _im->recordShapes(doc->getCurrentLayer());
             MgObject::release_pointer(_im->lastDoc);
             if (_im->flags[0])
-                MgObject::release_pointer(_im->lastShape);
+                MgObject::release_pointer(_im->lastDyns);
         }
         _im->lastDoc = doc;
     }
@@ -156,7 +853,6 @@ bool MgRecordShapes::recordStep(long tick, long changeCountOld, long changeCount
             _im->s[0]->writeNode("dynamic", -1, true);
         }
     }
-    MgObject::release_pointer(dynShapes);
     
     _im->s[0]->writeInt("flags", _im->flags[0]);
     if (_im->flags[0] != DYN) {
@@ -166,53 +862,128 @@ bool MgRecordShapes::recordStep(long tick, long changeCountOld, long changeCount
     
     bool ret = _im->saveJsonFile();
     
-    if (ret && _im->s[2]) {
-        _im->s[2]->writeNode("r", _im->fileCount - 2, false);
-        _im->s[2]->writeInt("tick", _im->tick);
-        _im->s[2]->writeInt("flags", _im->flags[0]);
-        _im->s[2]->writeNode("r", _im->fileCount - 2, true);
-        
-        if (_im->fileCount % 10 == 0 || _im->flags[0] != MgRecordShapes::DYN) {
-            _im->saveIndexFile(false);
-        }
+    if (ret && _im->recordIndex) {
+        _im->appendIndex(_im->tick, _im->flags[0]);
+    }
+    if (ret && _im->needCheckpoint()) {
+        _im->writeCheckpoint(needDyn ? dynShapes : NULL);
+    }
+    if (ret && _im->undoBudget > 0 && _im->lastDoc) {
+        _im->pushSnapshot(_im->lastDoc, _im->tick, changeCountOld, changeCountNew);
     }
+    MgObject::release_pointer(dynShapes);
+    _im->publish();
     
     return ret;
 }
 
 bool MgRecordShapes::Impl::incrementRecord(MgShapes* dynShapes)
 {
+    const int n = dynShapes->getShapeCount();
     bool ret = false;
     
-    if (flags[0] == 0 && lastShape
-        && dynShapes->getShapeCount() == 1
-        && dynShapes->getLastShape()->shapec()->isKindOf(MgBaseLines::Type())
-        && dynShapes->getLastShape()->getType() == lastShape->getType())
-    {
-        if (lastShape->equals(*dynShapes->getLastShape()))
-            return true;
-            
-        const MgBaseLines* oldlines = (const MgBaseLines*)lastShape->shapec();
-        const MgBaseLines* lines = (const MgBaseLines*)dynShapes->getLastShape()->shapec();
+    if (flags[0] == 0 && lastDyns && lastDyns->getShapeCount() == n) {
+        const float q = dynQuantum(lastDoc);
+        std::string buf;
+        int i = 0;
         
-        if (lines->isIncrementFrom(*oldlines)) {
-            const Point2d* pts = lines->getPoints() + oldlines->getPointCount();
-            s[0]->writeFloatArray("dyninc", (const float*)pts,
-                                  (lines->getPointCount() - oldlines->getPointCount()) * 2);
+        for (; i < n; i++) {                    // 各图形都不变或只在末尾加点时才能增量记录
+            const MgShape* oldsp = lastDyns->getShapeAtIndex(i);
+            const MgShape* sp = dynShapes->getShapeAtIndex(i);
+            
+            if (sp->getType() != oldsp->getType())
+                break;
+            if (sp->equals(*oldsp))
+                continue;
+            if (!sp->shapec()->isKindOf(MgBaseLines::Type())
+                || !((const MgBaseLines*)sp->shapec())->isIncrementFrom(
+                    *(const MgBaseLines*)oldsp->shapec())) {
+                break;
+            }
+            encodeIncrement(buf, i, q, (const MgBaseLines*)oldsp->shapec(),
+                            (const MgBaseLines*)sp->shapec());
+        }
+        if (i == n) {
+            if (buf.empty())
+                return true;
+            s[0]->writeFloat("dynq", q);
+            s[0]->writeString("dynpts", encodeBase64(buf).c_str());
             flags[0] |= DYN;
             ret = true;
         }
     }
-    
-    MgObject::release_pointer(lastShape);
-    lastShape = const_cast<MgShape*>(dynShapes->getLastShape());
-    lastShape->addRef();
+    setLastDyns(dynShapes);
     
     return ret;
 }
 
+void MgRecordShapes::Impl::pushSnapshot(MgShapeDoc* doc, int tick,
+                                         long changeCountOld, long changeCountNew)
+{
+    const int state = fileCount - 1;            // 刚记录的步骤后的状态
+    
+    clearSnapshots(state);                      // 新步骤使可重做的快照失效
+    if (snapshots.empty() || firstSnapshot + (int)snapshots.size() != state) {
+        clearSnapshots(0);
+        firstSnapshot = state;
+    } else {
+        snapshots.back().changeCount = changeCountOld;
+    }
+    
+    MgUndoSnapshot snap;
+    
+    snap.doc = doc;
+    snap.doc->addRef();
+    snap.changeCount = changeCountNew;
+    snap.tick = tick;
+    snap.bytes = (long)sizeof(snap) + stepBytes
+        + doc->getCurrentLayer()->getShapeCount() * (long)(4 * sizeof(void*));
+    snapshots.push_back(snap);
+    undoBytes += snap.bytes;
+    
+    while (undoBytes > undoBudget && snapshots.size() > 1) {   // 更早的步骤只从日志中撤销
+        undoBytes -= snapshots.front().bytes;
+        snapshots.front().doc->release();
+        snapshots.pop_front();
+        firstSnapshot++;
+    }
+}
+
+void MgRecordShapes::Impl::clearSnapshots(int from)
+{
+    while (!snapshots.empty() && firstSnapshot + (int)snapshots.size() > from) {
+        undoBytes -= snapshots.back().bytes;
+        snapshots.back().doc->release();
+        snapshots.pop_back();
+    }
+}
+
+bool MgRecordShapes::Impl::applySnapshot(int state, MgShapeDoc* doc, long* changeCount)
+{
+    if (state < firstSnapshot || state >= firstSnapshot + (int)snapshots.size())
+        return false;
+    
+    const MgUndoSnapshot& snap = snapshots[state - firstSnapshot];
+    
+    doc->modelTransform() = snap.doc->modelTransform();
+    doc->setPageRectW(snap.doc->getPageRectW(), snap.doc->getViewScale());
+    doc->getCurrentLayer()->copyShapes(snap.doc->getCurrentLayer(), false);
+    tick = snap.tick;
+    if (changeCount && snap.changeCount >= 0) {
+        *changeCount = snap.changeCount;
+    }
+    
+    return true;
+}
+
+void MgRecordShapes::Impl::setLastDyns(const MgShapes* dyns)
+{
+    copyDyns(lastDyns, dyns);
+}
+
 void MgRecordShapes::resetDoc(MgShapeDoc* doc)
 {
+    _im->waitWriter();
     if (doc) {
         MgObject::release_pointer(_im->lastDoc);
         _im->lastDoc = doc;
@@ -221,29 +992,18 @@ void MgRecordShapes::resetDoc(MgShapeDoc* doc)
 
 void MgRecordShapes::restore(int index, int count, int tick, long curTick)
 {
-    std::vector<int> arr;
-    
-    if (_im->s[2] && loadFrameIndex(_im->path, arr)) {
-        for (unsigned i = 0; i + 2 < arr.size(); i += 3) {
-            _im->s[2]->writeNode("r", i / 3, false);
-            _im->s[2]->writeInt("tick", arr[i + 1]);
-            _im->s[2]->writeInt("flags", arr[i + 2]);
-            _im->s[2]->writeNode("r", i / 3, true);
-        }
-    }
+    _im->waitWriter();
+    _im->clearSnapshots(0);
+    _im->keepJournal = true;
     _im->fileCount = index;
     _im->maxCount = count ? count : index;
     _im->startTick = curTick - tick;
-    LOGD("restore fileCount=%d, maxCount=%d, startTick=%d, frames=%d",
-         _im->fileCount, _im->maxCount, tick, (int)arr.size() / 3);
+    LOGD("restore fileCount=%d, maxCount=%d, startTick=%d",
+         _im->fileCount, _im->maxCount, tick);
 }
 
-bool MgRecordShapes::loadFrameIndex(std::string path, std::vector<int>& arr)
+static bool loadOldFrameIndex(const std::string& path, std::vector<int>& arr)
 {
-    if (*path.rbegin() != '/' && *path.rbegin() != '\\')
-        path += '/';
-    path += "records.json";
-    
     FILE *fp = mgopenfile(path.c_str(), "rt");
     if (!fp) {
         LOGE("Fail to read file: %s", path.c_str());
@@ -266,6 +1026,33 @@ bool MgRecordShapes::loadFrameIndex(std::string path, std::vector<int>& arr)
     return s->readNode("records", -1, true);
 }
 
+bool MgRecordShapes::loadFrameIndex(std::string path, std::vector<int>& arr)
+{
+    if (*path.rbegin() != '/' && *path.rbegin() != '\\')
+        path += '/';
+    
+    FILE *fp = mgopenfile((path + INDEX_NAME).c_str(), "rt");
+    if (!fp) {
+        return loadOldFrameIndex(path + OLD_INDEX_NAME, arr);
+    }
+    
+    char line[128];
+    int tick, flags, n;
+    
+    while (fgets(line, sizeof(line), fp)) {
+        n = 0;
+        if (sscanf(line, "{\"tick\":%d,\"flags\":%d}%n", &tick, &flags, &n) == 2
+            && n > 0) {                         // 忽略未写完的行
+            arr.push_back((int)arr.size() / 3 + 1);
+            arr.push_back(tick);
+            arr.push_back(flags);
+        }
+    }
+    fclose(fp);
+    
+    return true;
+}
+
 std::string MgRecordShapes::getFileName(bool back, int index) const
 {
     return _im->getFileName(back, index);
@@ -276,6 +1063,11 @@ std::string MgRecordShapes::getPath() const
     return _im->path;
 }
 
+std::string MgRecordShapes::getJournalName() const
+{
+    return _im->path + JOURNAL_NAME;
+}
+
 bool MgRecordShapes::isLoading() const
 {
     return _im->loading > 0;
@@ -283,12 +1075,12 @@ bool MgRecordShapes::isLoading() const
 
 bool MgRecordShapes::canUndo() const
 {
-    return _im->fileCount > 1 && !_im->loading;
+    return (getFileCount() > 1 || getQueueDepth() > 0) && !_im->loading;
 }
 
 bool MgRecordShapes::canRedo() const
 {
-    return _im->fileCount < _im->maxCount && !_im->loading;
+    return getQueueDepth() == 0 && getFileCount() < getMaxFileCount() && !_im->loading;
 }
 
 void MgRecordShapes::setLoading(bool loading)
@@ -301,19 +1093,24 @@ void MgRecordShapes::setLoading(bool loading)
 
 bool MgRecordShapes::undo(MgShapeFactory *factory, MgShapeDoc* doc, long* changeCount)
 {
+    _im->waitWriter();
     if (_im->loading > 1 || !_im->lastDoc)
         return false;
     
     giAtomicIncrement(&_im->loading);
     
-    std::string fn(_im->getFileName(true, _im->fileCount - 1));
-    int ret = applyFile(_im->tick, factory, doc, NULL, fn.c_str(), changeCount);
+    int ret = _im->applySnapshot(_im->fileCount - 2, doc, changeCount) ? DOC_CHANGED : 0;
     
+    if (!ret) {
+        MgJsonStorage js;
+        MgStorage* s = _im->loadStep(true, _im->fileCount - 1, js);
+        ret = s ? applyRecord(_im->tick, factory, doc, NULL, s, changeCount) : 0;
+    }
     if (ret) {
         _im->fileCount--;
         _im->resetVersion(doc->getCurrentLayer());
         MgObject::release_pointer(_im->lastDoc);
-        LOGD("Undo with %s", fn.c_str());
+        LOGD("Undo with step %d", _im->fileCount);
     }
     giAtomicDecrement(&_im->loading);
     
@@ -322,19 +1119,25 @@ bool MgRecordShapes::undo(MgShapeFactory *factory, MgShapeDoc* doc, long* change
 
 bool MgRecordShapes::redo(MgShapeFactory *factory, MgShapeDoc* doc, long* changeCount)
 {
+    _im->waitWriter();
     if (_im->loading > 1)
         return false;
     
     giAtomicIncrement(&_im->loading);
     
-    std::string fn(_im->getFileName(false, _im->fileCount));
-    int ret = applyFile(_im->tick, factory, doc, NULL, fn.c_str(), changeCount);
+    int ret = _im->applySnapshot(_im->fileCount, doc, changeCount) ? DOC_CHANGED : 0;
+    
+    if (!ret) {
+        MgJsonStorage js;
+        MgStorage* s = _im->loadStep(false, _im->fileCount, js);
+        ret = s ? applyRecord(_im->tick, factory, doc, NULL, s, changeCount) : 0;
+    }
     
     if (ret) {
+        LOGD("Redo with step %d", _im->fileCount);
         _im->fileCount++;
         _im->resetVersion(doc->getCurrentLayer());
         MgObject::release_pointer(_im->lastDoc);
-        LOGD("Redo with %s", fn.c_str());
     }
     giAtomicDecrement(&_im->loading);
     
@@ -354,54 +1157,55 @@ static void saveIds(const std::vector<int>& ids, MgStorage *s, const char* group
 
 void MgRecordShapes::Impl::recordShapes(const MgShapes* shapes)
 {
-    MgShapeIterator it(shapes);
-    std::map<int, long> tmpids(id2ver);
-    std::map<int, long>::iterator i;
+    std::vector<int> ids, newids, delids;
+    bool reordered = false;
     int i2 = 0;
-    int sid;
-    std::vector<int> newids, nowids;
     
     s[0]->writeNode("shapes", shapes->getIndex(), false);
     s[1]->writeNode("shapes", shapes->getIndex(), false);
     
-    while (const MgShape* sp = it.getNext()) {
-        sid = sp->getID();
-        i = id2ver.find(sid);                                   // 查找是否之前已存在
-        nowids.push_back(sid);
+    if (shapes->getChangedIDs(markLineage, markSeq, ids)) {    // 只比较改变过的图形
+        std::set<int> done;
         
-        if (i == id2ver.end()) {                                // 是新增的图形
-            newids.push_back(sid);
-            id2ver[sid] = sp->shapec()->getChangeCount();       // 增加记录版本
-            shapes->saveShape(s[0], sp, shapeCount++);          // 写图形节点
-            flags[0] |= flags[0] ? EDIT : ADD;
-        } else {
-            tmpids.erase(tmpids.find(sid));                     // 标记是已有图形
-            if (i->second != sp->shapec()->getChangeCount()) {  // 改变的图形
-                i->second = sp->shapec()->getChangeCount();
-                id2ver[sid] = sp->shapec()->getChangeCount();   // 更新版本
-                shapes->saveShape(s[0], sp, shapeCount++);
-                flags[0] |= EDIT;
-                i2 += shapes->saveShape(s[1], lastDoc->findShape(sid), i2) ? 1 : 0;
-                flags[1] |= EDIT;
+        for (unsigned j = 0; j < ids.size(); j++) {
+            if (ids[j] == 0) {
+                reordered = true;
+            } else if (done.insert(ids[j]).second) {
+                const MgShape* sp = shapes->findShape(ids[j]);
+                if (sp) {
+                    recordShape(shapes, sp, newids, i2);
+                } else if (id2ver.find(ids[j]) != id2ver.end()) {
+                    delids.push_back(ids[j]);                   // 之前存在，现在已删除
+                }
             }
         }
+    } else {                                                    // 比较全部图形
+        MgShapeIterator it(shapes);
+        std::map<int, long> tmpids(id2ver);
+        
+        while (const MgShape* sp = it.getNext()) {
+            tmpids.erase(sp->getID());                          // 标记是已有图形
+            recordShape(shapes, sp, newids, i2);
+        }
+        for (std::map<int, long>::iterator i = tmpids.begin(); i != tmpids.end(); ++i) {
+            delids.push_back(i->first);
+        }
+        reordered = true;
     }
     s[0]->writeNode("shapes", shapes->getIndex(), true);
-    s[0]->writeInt("count", shapeCount += (int)tmpids.size());
+    s[0]->writeInt("count", shapeCount += (int)delids.size());
     
-    if (!tmpids.empty()) {                                      // 之前存在，现在已删除
+    if (!delids.empty()) {
         flags[0] |= DEL;
         s[0]->writeNode("delete", -1, false);
-        int j = 0;
-        for (i = tmpids.begin(); i != tmpids.end(); ++i) {
-            sid = i->first;
-            id2ver.erase(id2ver.find(sid));
+        for (unsigned j = 0; j < delids.size(); j++) {
+            id2ver.erase(delids[j]);
             
             std::stringstream ss;
-            ss << "d" << j++;
-            s[0]->writeInt(ss.str().c_str(), sid);              // 记下删除的图形的ID
+            ss << "d" << j;
+            s[0]->writeInt(ss.str().c_str(), delids[j]);        // 记下删除的图形的ID
             flags[1] |= ADD;
-            i2 += shapes->saveShape(s[1], lastDoc->findShape(sid), i2) ? 1 : 0;
+            i2 += shapes->saveShape(s[1], lastDoc->findShape(delids[j]), i2) ? 1 : 0;
         }
         s[0]->writeNode("delete", -1, true);
     }
@@ -418,37 +1222,66 @@ void MgRecordShapes::Impl::recordShapes(const MgShapes* shapes)
         }
         s[1]->writeNode("delete", -1, true);
     }
-    if (!flags[0] && nowids.size() == lastids.size() && nowids != lastids) {
-        flags[0] |= EDIT;
-        flags[1] |= EDIT;
-        saveIds(lastids, s[1], "reorder");
-        saveIds(nowids, s[0], "reorder");
+    if (!flags[0] && reordered) {                               // 只有调整顺序时才需要比较顺序
+        std::vector<int> nowids, lastids;
+        
+        getShapeIds(shapes, nowids);
+        getShapeIds(lastDoc->getCurrentLayer(), lastids);
+        if (nowids.size() == lastids.size() && nowids != lastids) {
+            flags[0] |= EDIT;
+            flags[1] |= EDIT;
+            saveIds(lastids, s[1], "reorder");
+            saveIds(nowids, s[0], "reorder");
+        }
     }
-    lastids = nowids;
+    shapes->getChangeMark(markLineage, markSeq);
     
     s[1]->writeInt("flags", flags[1]);
     s[1]->writeInt("count", i2 + (int)newids.size());
 }
 
+void MgRecordShapes::Impl::recordShape(const MgShapes* shapes, const MgShape* sp,
+                                       std::vector<int>& newids, int& i2)
+{
+    const int sid = sp->getID();
+    std::map<int, long>::iterator i = id2ver.find(sid);         // 查找是否之前已存在
+    
+    if (i == id2ver.end()) {                                    // 是新增的图形
+        newids.push_back(sid);
+        id2ver[sid] = sp->shapec()->getChangeCount();           // 增加记录版本
+        shapes->saveShape(s[0], sp, shapeCount++);              // 写图形节点
+        flags[0] |= flags[0] ? EDIT : ADD;
+    } else if (i->second != sp->shapec()->getChangeCount()) {   // 改变的图形
+        i->second = sp->shapec()->getChangeCount();             // 更新版本
+        shapes->saveShape(s[0], sp, shapeCount++);
+        flags[0] |= EDIT;
+        i2 += shapes->saveShape(s[1], lastDoc->findShape(sid), i2) ? 1 : 0;
+        flags[1] |= EDIT;
+    }
+}
+
+void MgRecordShapes::Impl::getShapeIds(const MgShapes* shapes, std::vector<int>& ids)
+{
+    MgShapeIterator it(shapes);
+    while (const MgShape* sp = it.getNext()) {
+        ids.push_back(sp->getID());
+    }
+}
+
 void MgRecordShapes::Impl::resetVersion(const MgShapes* shapes)
 {
     MgShapeIterator it(shapes);
     
     id2ver.clear();
-    lastids.clear();
     while (const MgShape* sp = it.getNext()) {
         id2ver[sp->getID()] = sp->shapec()->getChangeCount();
-        lastids.push_back(sp->getID());
     }
+    shapes->getChangeMark(markLineage, markSeq);
 }
 
 void MgRecordShapes::Impl::startRecord()
 {
-    if (!forUndo()) {
-        js[2] = new MgJsonStorage();
-        s[2] = js[2]->storageForWrite();
-        s[2]->writeNode("records", -1, false);
-    }
+    recordIndex = !forUndo();
     fileCount = 1;
     maxCount = 1;
 }
@@ -461,6 +1294,8 @@ void MgRecordShapes::Impl::beginJsonFile()
     flags[0] = 0;
     flags[1] = 0;
     shapeCount = 0;
+    stepTick = tick;
+    stepBytes = 0;
     
     for (int i = 0; i < 2; i++) {
         js[i] = new MgJsonStorage();
@@ -482,7 +1317,6 @@ std::string MgRecordShapes::Impl::getFileName(bool back, int index) const
 bool MgRecordShapes::Impl::saveJsonFile()
 {
     bool ret = false;
-    std::string filename;
     
     if (flags[0] == DYN && tick - lastTick < 20) {
         //LOGD("Ignore record at the same time %d", tick);
@@ -496,17 +1330,10 @@ bool MgRecordShapes::Impl::saveJsonFile()
             s[i]->writeFloat("viewScale", lastDoc->getViewScale());
         }
         if (flags[i] != 0) {
-            filename = getFileName(i > 0);
-            FILE *fp = mgopenfile(filename.c_str(), "wt");
-            
-            if (!fp) {
-                LOGE("Fail to save file: %s", filename.c_str());
-            } else {
-                ret = s[i]->writeNode("record", -1, true) && js[i]->save(fp, VG_PRETTY);
-                fclose(fp);
-                if (!ret) {
-                    LOGE("Fail to record shapes: %s", filename.c_str());
-                }
+            ret = (s[i]->writeNode("record", -1, true)
+                   && appendFrame(i, fileCount, flags[i], js[i]->stringify(VG_PRETTY)));
+            if (!ret) {
+                LOGE("Fail to record step %d in %s", fileCount, JOURNAL_NAME);
             }
         }
         delete js[i];
@@ -514,14 +1341,6 @@ bool MgRecordShapes::Impl::saveJsonFile()
         s[i] = NULL;
     }
     if (ret) {
-        /*if (flags[0] && !forUndo()) {
-            struct stat stat1;
-            filename = getFileName(false);
-            stat(filename.c_str(), &stat1);
-            
-            LOGD("Record %03d: tick=%d, flags=%d, count=%d, filesize=%ld",
-                 fileCount, tick, flags[0], shapeCount, (long)stat1.st_size);
-        }*/
         maxCount = ++fileCount;
         lastTick = tick;
     }
@@ -529,56 +1348,266 @@ bool MgRecordShapes::Impl::saveJsonFile()
     return ret;
 }
 
-bool MgRecordShapes::Impl::saveIndexFile(bool ended)
+bool MgRecordShapes::Impl::openIndexFile()
 {
-    std::string filename(path + "records.json");
-    FILE *fp = mgopenfile(filename.c_str(), "wt");
-    bool ret = false;
+    std::string filename(path + INDEX_NAME);
     
-    if (!fp) {
-        LOGE("Fail to save file: %s", filename.c_str());
+    if (!keepJournal) {
+        indexFile = mgopenfile(filename.c_str(), "wb");
+    } else if ((indexFile = mgopenfile(filename.c_str(), "a+b")) != NULL) {
+        fseek(indexFile, 0, SEEK_END);
+        long size = ftell(indexFile);
+        
+        if (size == 0) {                        // 续录以前整体保存的索引
+            std::vector<int> arr;
+            loadOldFrameIndex(path + OLD_INDEX_NAME, arr);
+            for (unsigned i = 0; i + 2 < arr.size(); i += 3) {
+                fprintf(indexFile, "{\"tick\":%d,\"flags\":%d}\n", arr[i + 1], arr[i + 2]);
+            }
+        } else if (fseek(indexFile, size - 1, SEEK_SET) == 0 && fgetc(indexFile) != '\n') {
+            fputc('\n', indexFile);            // 隔开未写完的行
+        }
+    }
+    if (!indexFile) {
+        LOGE("Fail to open file: %s", filename.c_str());
+        recordIndex = false;
+    }
+    
+    return indexFile != NULL;
+}
+
+bool MgRecordShapes::Impl::appendIndex(int tick, int flags)
+{
+    if (!indexFile && !openIndexFile())
+        return false;
+    
+    return fprintf(indexFile, "{\"tick\":%d,\"flags\":%d}\n", tick, flags) > 0
+        && fflush(indexFile) == 0;
+}
+
+bool MgRecordShapes::Impl::openJournal()
+{
+    if (!journal) {
+        std::string filename(path + JOURNAL_NAME);
+        
+        if (type > 1) {                         // 播放时只读，没有日志就读各步骤的文件
+            journal = mgopenfile(filename.c_str(), "rb");
+        } else {
+            journal = keepJournal ? mgopenfile(filename.c_str(), "r+b") : NULL;
+            if (!journal) {
+                journal = mgopenfile(filename.c_str(), "w+b");
+            }
+            if (!journal) {
+                LOGE("Fail to open file: %s", filename.c_str());
+            }
+        }
+        if (journal) {
+            scanJournal();
+        }
+    }
+    return !!journal;
+}
+
+void MgRecordShapes::Impl::scanJournal()
+{
+    FrameHeader h;
+    char magic[sizeof(JOURNAL_MAGIC)];
+    long size;
+    
+    offsets[0].clear();
+    offsets[1].clear();
+    offsets[2].clear();
+    journalEnd = 0;
+    deltaFrames = 0;
+    deltaBytes = 0;
+    fseek(journal, 0, SEEK_END);
+    size = ftell(journal);
+    fseek(journal, 0, SEEK_SET);
+    
+    if (fread(magic, sizeof(magic), 1, journal) == 1
+        && memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) == 0) {
+        journalEnd = sizeof(magic);
+        while (fread(&h, sizeof(h), 1, journal) == 1       // 末尾不完整的帧会被之后的记录覆盖
+               && h.mark == FRAME_MARK && h.index >= 0 && h.size >= 0
+               && h.back >= 0 && h.back <= CHECKPOINT
+               && journalEnd + (long)sizeof(h) + h.size <= size
+               && fseek(journal, h.size, SEEK_CUR) == 0) {
+            if (!h.back) {
+                forwardFrameAdded(h.index);
+            }
+            setOffset(h.back, h.index, journalEnd);
+            frameAdded(h);
+            journalEnd += (long)sizeof(h) + h.size;
+        }
+    }
+    else if (type < 2 && size <= (long)sizeof(magic)) {
+        fseek(journal, 0, SEEK_SET);
+        if (fwrite(JOURNAL_MAGIC, sizeof(magic), 1, journal) == 1) {
+            journalEnd = sizeof(magic);
+        }
+    }
+}
+
+long MgRecordShapes::Impl::getOffset(int kind, int index) const
+{
+    const std::vector<long>& arr = offsets[kind];
+    return index >= 0 && index < (int)arr.size() ? arr[index] : -1;
+}
+
+void MgRecordShapes::Impl::setOffset(int kind, int index, long offset)
+{
+    std::vector<long>& arr = offsets[kind];
+    if (index >= (int)arr.size()) {
+        arr.resize(index + 1, -1);
+    }
+    arr[index] = offset;
+}
+
+void MgRecordShapes::Impl::forwardFrameAdded(int index)
+{
+    setOffset(1, index, -1);                    // 新的正向记录使该步骤之前的反向记录失效
+    if ((int)offsets[CHECKPOINT].size() > index) {
+        offsets[CHECKPOINT].resize(index);      // 也使该步骤及以后的检查点失效
+    }
+}
+
+void MgRecordShapes::Impl::frameAdded(const FrameHeader& h)
+{
+    if (h.back == CHECKPOINT) {
+        deltaFrames = 0;
+        deltaBytes = 0;
     } else {
-        if (ended) {
-            s[2]->writeNode("records", -1, true);
+        deltaFrames += h.back ? 0 : 1;
+        deltaBytes += h.size;
+    }
+}
+
+bool MgRecordShapes::Impl::needCheckpoint() const
+{
+    return !forUndo() && lastDoc && (deltaFrames >= checkpointFrames
+                                     || deltaBytes >= checkpointBytes);
+}
+
+bool MgRecordShapes::Impl::writeCheckpoint(const MgShapes* dynShapes)
+{
+    MgJsonStorage js;
+    MgStorage* s = js.storageForWrite();
+    int index = fileCount - 1;                  // 刚记录的步骤
+    
+    s->writeNode("checkpoint", -1, false);
+    s->writeInt("tick", stepTick);             // 与播放该步骤后的时刻一致
+    lastDoc->save(s, 0);
+    if (dynShapes && dynShapes->getShapeCount() > 0) {
+        s->writeNode("dynamic", -1, false);
+        dynShapes->save(s);
+        s->writeNode("dynamic", -1, true);
+    }
+    s->writeNode("checkpoint", -1, true);
+    
+    if (!appendFrame(CHECKPOINT, index, 0, js.stringify(VG_PRETTY))) {
+        LOGE("Fail to write checkpoint %d in %s", index, JOURNAL_NAME);
+        return false;
+    }
+    return true;
+}
+
+bool MgRecordShapes::Impl::appendFrame(int kind, int index, int flags, const char* content)
+{
+    if (!content || !openJournal() || journalEnd == 0) {
+        return false;
+    }
+    
+    FrameHeader h;
+    
+    h.mark = FRAME_MARK;
+    h.index = index;
+    h.back = kind;
+    h.tick = tick;
+    h.flags = flags;
+    h.size = (int)strlen(content);
+    
+    bool ret = (fseek(journal, journalEnd, SEEK_SET) == 0
+                && fwrite(&h, sizeof(h), 1, journal) == 1
+                && (h.size == 0 || fwrite(content, h.size, 1, journal) == 1)
+                && fflush(journal) == 0);
+    if (ret) {
+        if (kind == 0) {
+            forwardFrameAdded(index);
         }
-        ret = js[2]->save(fp, VG_PRETTY);
-        if (!ret) {
-            LOGE("Fail to save records: %s", filename.c_str());
+        setOffset(kind, index, journalEnd);
+        journalEnd += (long)sizeof(h) + h.size;
+        frameAdded(h);
+        if (kind != CHECKPOINT) {
+            stepBytes += h.size;
         }
-        fclose(fp);
     }
     
     return ret;
 }
 
-void MgRecordShapes::Impl::stopRecordIndex()
+MgStorage* MgRecordShapes::Impl::loadStep(int kind, int index, MgJsonStorage& js)
 {
-    if (js[2]) {
-        if (fileCount > 1 && saveIndexFile(true)) {
-            LOGD("Save records.json in %s", path.c_str());
+    if (!openJournal()) {                       // 兼容以前每步一个文件的录制
+        if (kind == CHECKPOINT)
+            return NULL;
+        std::string filename(getFileName(kind > 0, index));
+        FILE *fp = mgopenfile(filename.c_str(), "rt");
+        MgStorage* s = fp ? js.storageForRead(fp) : NULL;
+        
+        if (fp) {
+            fclose(fp);
         }
-        delete js[2];
-        js[2] = NULL;
-        s[2] = NULL;
+        return s;
+    }
+    
+    long offset = getOffset(kind, index);
+    FrameHeader h;
+    
+    if (offset < 0 || fseek(journal, offset, SEEK_SET) != 0
+        || fread(&h, sizeof(h), 1, journal) != 1 || h.mark != FRAME_MARK) {
+        return NULL;
+    }
+    
+    std::vector<char> buf(h.size + 1, 0);
+    if (h.size > 0 && fread(&buf.front(), h.size, 1, journal) != 1) {
+        LOGE("Fail to read step %d in %s", index, JOURNAL_NAME);
+        return NULL;
     }
-    MgObject::release_pointer(lastShape);
+    
+    return js.storageForRead(&buf.front());
 }
 
-int MgRecordShapes::applyFile(int& tick, MgShapeFactory *f,
-                              MgShapeDoc* doc, MgShapes* dyns, const char* fn,
-                              long* changeCount, MgShape* lastShape)
+bool MgRecordShapes::Impl::hasStep(int index)
 {
-    FILE *fp = mgopenfile(fn, "rt");
-    if (!fp) {
-        //LOGE("Fail to read file: %s", fn);
-        return 0;
-    }
+    if (maxCount > 0 && index >= maxCount)
+        return false;
+    if (openJournal())
+        return getOffset(0, index) >= 0;
     
-    MgJsonStorage js;
-    MgStorage* s = js.storageForRead(fp);
+    FILE *fp = mgopenfile(getFileName(false, index).c_str(), "rt");
+    if (fp) {
+        fclose(fp);
+    }
+    return !!fp;
+}
+
+void MgRecordShapes::Impl::stopRecordIndex()
+{
+    if (indexFile) {
+        fclose(indexFile);
+        indexFile = NULL;
+        LOGD("Save %s in %s", INDEX_NAME, path.c_str());
+    }
+    recordIndex = false;
+    MgObject::release_pointer(lastDyns);
+}
+
+int MgRecordShapes::applyRecord(int& tick, MgShapeFactory *f,
+                                MgShapeDoc* doc, MgShapes* dyns, MgStorage* s,
+                                long* changeCount, const MgShapes* lastDyns)
+{
     int ret = 0;
     
-    fclose(fp);
     if (s->readNode("record", -1, false)) {
         if (doc) {
             if (s->readFloatArray("transform", &doc->modelTransform().m11, 6, false) == 6) {
@@ -631,13 +1660,21 @@ int MgRecordShapes::applyFile(int& tick, MgShapeFactory *f,
             if (dyns->load(f, s) >= 0)
                 ret |= DYN_CHANGED;
             s->readNode("dynamic", -1, true);
-        } else if (dyns && lastShape
-                   && lastShape->shapec()->isKindOf(MgBaseLines::Type())) {
+        } else if (dyns && lastDyns && s->readString("dynpts") > 0) {
+            std::vector<char> text(s->readString("dynpts") + 1, 0);
+            
+            s->readString("dynpts", &text.front(), (int)text.size() - 1);
+            if (applyIncrement(decodeBase64(&text.front()), s->readFloat("dynq", 0),
+                               lastDyns, dyns)) {
+                ret |= DYN_CHANGED;
+            }
+        } else if (dyns && lastDyns && lastDyns->getLastShape()     // 以前的浮点数组增量
+                   && lastDyns->getLastShape()->shapec()->isKindOf(MgBaseLines::Type())) {
             int n = s->readFloatArray("dyninc", NULL, 0);
             mgvector<float> buf(n);
             
             if (n > 0 && s->readFloatArray("dyninc", buf.address(), n) == n) {
-                MgShape* sp = lastShape->cloneShape();
+                MgShape* sp = lastDyns->getLastShape()->cloneShape();
                 MgBaseLines* lines = (MgBaseLines*)sp->shape();
                 
                 for (int i = 0; i + 1 < n; i += 2) {
@@ -679,7 +1716,7 @@ bool MgRecordShapes::applyFirstFile(MgShapeFactory *factory, MgShapeDoc* doc, co
     
     fclose(fp);
     _im->fileCount = 1;
-    MgObject::release_pointer(_im->lastShape);
+    MgObject::release_pointer(_im->lastDyns);
     
     return doc->load(factory, s, false);
 }
@@ -689,21 +1726,215 @@ int MgRecordShapes::applyRedoFile(MgShapeFactory *f, MgShapeDoc* doc, MgShapes*
     if (index <= 0)
         index = _im->fileCount;
     
-    std::string filename(_im->getFileName(false, index));
-    int ret = applyFile(_im->tick, f, doc, dyns, filename.c_str(), NULL, _im->lastShape);
+    MgJsonStorage js;
+    MgStorage* s = _im->loadStep(false, index, js);
+    int ret = s ? applyRecord(_im->tick, f, doc, dyns, s, NULL, _im->lastDyns) : 0;
     
     if (ret) {
         _im->fileCount = index + 1;
-        MgObject::release_pointer(_im->lastShape);
-        if (dyns) {
-            _im->lastShape = const_cast<MgShape*>(dyns->getLastShape());
-            if (_im->lastShape)
-                _im->lastShape->addRef();
+        _im->setLastDyns(dyns);
+    }
+    return ret;
+}
+
+void MgRecordPrefetcher::run()
+{
+    for (;;) {
+        if (quit)
+            break;
+        if (!hasWork()) {
+            waitForWork();
+            ended = 0;                          // 超时或被唤醒后再看是否有新帧
+            continue;
+        }
+        if (!owner->_im->hasStep(next)) {
+            giAtomicIncrement(&ended);
+            continue;
+        }
+        
+        MgShapes* dyns = MgShapes::create();
+        MgShapes* base = lastDyns;
+        int baseTick = tick;
+        MgJsonStorage js;
+        MgStorage* s = owner->_im->loadStep(false, next, js);
+        int ret = s ? MgRecordShapes::applyRecord(tick, factory, doc, dyns, s, NULL, lastDyns) : 0;
+        
+        if (base) {
+            base->addRef();
+        }
+        if (ret) {
+            copyDyns(lastDyns, dyns);
+        }
+        next++;
+        if (!ret) {                             // 没有变化的帧直接跳过
+            dyns->release();
+            MgObject::release_pointer(base);
+            continue;
+        }
+        
+        MgPrefetchedFrame& item = items[head % (long)items.size()];
+        
+        item.ret = ret;
+        item.index = next - 1;
+        item.tick = tick;
+        item.doc = (ret & ~MgRecordShapes::DYN_CHANGED) ? doc->shallowCopy() : NULL;
+        item.dyns = (ret & MgRecordShapes::DYN_CHANGED) ? dyns : NULL;
+        item.base = base;
+        item.baseTick = baseTick;
+        if (!item.dyns) {
+            dyns->release();
+        }
+        giAtomicIncrement(&head);
+    }
+}
+
+bool MgRecordShapes::startPrefetch(MgShapeFactory *f, const MgShapeDoc* doc, int depth)
+{
+    if (_im->prefetcher || !isPlaying() || depth < 1)
+        return false;
+    
+    MgRecordPrefetcher* p = new MgRecordPrefetcher(this, f,
+        doc ? doc->shallowCopy() : MgShapeDoc::createDoc(), depth);
+    
+    p->next = _im->fileCount > 0 ? _im->fileCount : 1;
+    p->tick = _im->tick;
+    copyDyns(p->lastDyns, _im->lastDyns);
+    if (!p->start()) {
+        LOGE("Fail to start the playback prefetcher");
+        delete p;
+        return false;
+    }
+    _im->prefetcher = p;
+    return true;
+}
+
+void MgRecordShapes::stopPrefetch()
+{
+    MgRecordPrefetcher* p = _im->prefetcher;
+    
+    if (p) {
+        _im->prefetcher = NULL;
+        p->stop();
+        
+        const MgPrefetchedFrame* item = p->front();
+        if (item) {                             // 未取走的帧以后再解码
+            _im->fileCount = item->index;
+            _im->tick = item->baseTick;
+            _im->setLastDyns(item->base);
+        } else {                                // 已解码的帧都取走了
+            _im->fileCount = p->next;
+            _im->tick = p->tick;
+            _im->setLastDyns(p->lastDyns);
+        }
+        delete p;
+    }
+}
+
+bool MgRecordShapes::isPrefetching() const
+{
+    return !!_im->prefetcher;
+}
+
+int MgRecordShapes::getPrefetchedCount() const
+{
+    return _im->prefetcher ? _im->prefetcher->count() : 0;
+}
+
+int MgRecordShapes::getPrefetchedTick() const
+{
+    const MgPrefetchedFrame* item = _im->prefetcher ? _im->prefetcher->front() : NULL;
+    return item ? item->tick : -1;
+}
+
+int MgRecordShapes::takePrefetched(int maxTick, MgShapeDoc** doc, MgShapes** dyns, int* tick)
+{
+    MgRecordPrefetcher* p = _im->prefetcher;
+    const MgPrefetchedFrame* item;
+    int ret = 0;
+    
+    while (p && (item = p->front()) != NULL && (item->tick <= maxTick || (maxTick < 0 && !ret))) {
+        if (item->doc) {                        // 落后时合并多帧，只交出最后的结果
+            MgObject::release_pointer(*doc);
+            *doc = item->doc;
+        }
+        if (item->dyns) {
+            MgObject::release_pointer(*dyns);
+            *dyns = item->dyns;
+        }
+        if (tick) {
+            *tick = item->tick;
         }
+        _im->fileCount = item->index + 1;       // 在播放方更新播放器的状态
+        _im->tick = item->tick;
+        ret |= item->ret;
+        p->pop();
     }
     return ret;
 }
 
+void MgRecordShapes::setCheckpointInterval(int frames, long bytes)
+{
+    _im->checkpointFrames = frames > 0 ? frames : 0x7FFFFFFF;
+    _im->checkpointBytes = bytes > 0 ? bytes : 0x7FFFFFFF;
+}
+
+int MgRecordShapes::seek(MgShapeFactory *f, MgShapeDoc* doc, MgShapes* dyns, int index)
+{
+    stopPrefetch();
+    if (index < 0 || (_im->maxCount > 0 && index >= _im->maxCount))
+        return 0;
+    
+    int from = _im->openJournal() ? index : 0;
+    
+    while (from > 0 && _im->getOffset(CHECKPOINT, from) < 0) {
+        from--;
+    }
+    
+    MgShapes* tmpdyns = MgShapes::create();
+    MgShapes* target = from == index && dyns ? dyns : tmpdyns;
+    
+    if (dyns) {
+        dyns->clear();
+    }
+    MgObject::release_pointer(_im->lastDyns);
+    
+    if (from > 0) {                             // 从最近的检查点开始
+        MgJsonStorage js;
+        MgStorage* s = _im->loadStep(CHECKPOINT, from, js);
+        bool ret = s && s->readNode("checkpoint", -1, false) && doc->load(f, s, false);
+        
+        if (ret) {
+            _im->tick = s->readInt("tick", _im->tick);
+            if (s->readNode("dynamic", -1, false)) {
+                target->load(f, s);
+                s->readNode("dynamic", -1, true);
+            }
+            s->readNode("checkpoint", -1, true);
+        } else {
+            LOGE("Fail to load checkpoint %d, seek from the first frame", from);
+            from = 0;
+        }
+    }
+    if (from == 0 && !applyFirstFile(f, doc)) {
+        tmpdyns->release();
+        return 0;
+    }
+    
+    _im->fileCount = from + 1;
+    _im->setLastDyns(target);
+    
+    for (int i = from + 1; i <= index; i++) {   // 重放检查点之后的步骤
+        target = i == index && dyns ? dyns : tmpdyns;
+        target->clear();
+        if (!applyRedoFile(f, doc, target, i)) {
+            _im->fileCount = i + 1;
+        }
+    }
+    tmpdyns->release();
+    
+    return DOC_CHANGED | DYN_CHANGED;
+}
+
 int MgRecordShapes::applyUndoFile(MgShapeFactory *f, MgShapeDoc* doc,
                                   MgShapes* dyns, int index, long curTick)
 {
@@ -718,20 +1949,16 @@ int MgRecordShapes::applyUndoFile(MgShapeFactory *f, MgShapeDoc* doc,
         return DYN_CHANGED;
     }
     
-    std::string filename(_im->getFileName(true, index - 1));
-    int ret = applyFile(_im->tick, f, doc, NULL, filename.c_str());
+    MgJsonStorage js;
+    MgStorage* s = _im->loadStep(true, index - 1, js);
+    int ret = s ? applyRecord(_im->tick, f, doc, NULL, s) : 0;
     
-    filename = _im->getFileName(false, index - 1);
-    ret |= applyFile(_im->tick, f, NULL, dyns, filename.c_str()) | DYN_CHANGED;
+    s = _im->loadStep(false, index - 1, js);
+    ret |= (s ? applyRecord(_im->tick, f, NULL, dyns, s) : 0) | DYN_CHANGED;
     
     if (ret) {
         _im->fileCount = index - 1;
-        MgObject::release_pointer(_im->lastShape);
-        if (dyns) {
-            _im->lastShape = const_cast<MgShape*>(dyns->getLastShape());
-            if (_im->lastShape)
-                _im->lastShape->addRef();
-        }
+        _im->setLastDyns(dyns);
     }
     return ret;
 }
@@ -108,8 +108,10 @@ static bool drawParallel(const MgParallel& sp, int, GiGraphics& gs, const GiCont
 
 static bool drawLines(const MgLines& sp, int, GiGraphics& gs, const GiContext& ctx, int)
 {
-    return (sp.isClosed() ? gs.drawPolygon(&ctx, sp.getPointCount(), sp.getPoints())
-            : gs.drawLines(&ctx, sp.getPointCount(), sp.getPoints()));
+    MgLinesReader r(sp);    // 紧凑存储时解码到临时缓冲
+    
+    return (sp.isClosed() ? gs.drawPolygon(&ctx, sp.getPointCount(), r.points())
+            : gs.drawLines(&ctx, sp.getPointCount(), r.points()));
 }
 
 static bool drawSplines(const MgSplines& sp, int, GiGraphics& gs, const GiContext& ctx, int)
@@ -119,10 +121,11 @@ static bool drawSplines(const MgSplines& sp, int, GiGraphics& gs, const GiContex
     if (n == 2) {
         return gs.drawLine(&ctx, sp.getPoint(0), sp.getPoint(1));
     }
-    if (sp.getVectors()) {
-        return gs.drawBeziers(&ctx, n, sp.getPoints(), sp.getVectors(), sp.isClosed());
+    MgLinesReader r(sp);
+    if (r.vectors()) {
+        return gs.drawBeziers(&ctx, n, r.points(), r.vectors(), sp.isClosed());
     }
-    return gs.drawQuadSplines(&ctx, n, sp.getPoints(), sp.isClosed());
+    return gs.drawQuadSplines(&ctx, n, r.points(), sp.isClosed());
 }
 
 static bool drawPath(const MgPathShape& sp, int mode, GiGraphics& gs, const GiContext& ctx, int)
@@ -0,0 +1,440 @@
+// mgshapequery.cpp
+// Copyright (c) 2004-2015, https://github.com/rhcad/vgcore, BSD License
+
+#include "mgshapequery.h"
+#include "mgpath.h"
+#include "gilock.h"
+#include <math.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+static const int CHUNK = 32;            // 每次取出计算的图形数
+static const int MAX_THREADS = 16;
+
+// [0,1]区间的5点Gauss积分节点和权重，对9次以内的多项式精确
+static const double GAUSS_T[5] = { 0.0469100770306680, 0.2307653449471585, 0.5,
+    0.7692346550528415, 0.9530899229693320 };
+static const double GAUSS_W[5] = { 0.1184634425280945, 0.2393143352496832, 0.2844444444444444,
+    0.2393143352496832, 0.1184634425280945 };
+
+// 用Green公式沿路径积分求面积和形心，三次曲线段的面积矩被积函数为8次多项式，积分结果是精确的
+struct MgQueryMoments : MgPath::MgSegmentCallback {
+    Point2d org;                    // 积分原点，取图形中心以减少舍入误差
+    double  area, mx, my;           // 闭合子路径的 ∮(x dy - y dx)/2, ∮x²dy/2, -∮y²dx/2
+    double  sa, sx, sy;             // 当前子路径的上述积分
+    double  len, lx, ly;            // 路径长度及 ∫x ds, ∫y ds
+    
+    MgQueryMoments(const Point2d& org) : org(org), area(0), mx(0), my(0)
+        , sa(0), sx(0), sy(0), len(0), lx(0), ly(0) {}
+    
+    virtual void beginSubPath() { sa = sx = sy = 0; }
+    
+    virtual void endSubPath(bool closed) {
+        if (closed) {
+            area += sa;
+            mx += sx;
+            my += sy;
+        }
+    }
+    
+    virtual bool processLine(int, int&, const Point2d& startpt, const Point2d& endpt) {
+        const double x0 = startpt.x - org.x, y0 = startpt.y - org.y;
+        const double dx = endpt.x - startpt.x, dy = endpt.y - startpt.y;
+        
+        for (int k = 0; k < 5; k++) {
+            add(x0 + dx * GAUSS_T[k], y0 + dy * GAUSS_T[k], dx, dy, GAUSS_W[k]);
+        }
+        return true;
+    }
+    
+    virtual bool processBezier(int, int&, const Point2d* pts) {
+        double x[4], y[4];
+        
+        for (int i = 0; i < 4; i++) {
+            x[i] = pts[i].x - org.x;
+            y[i] = pts[i].y - org.y;
+        }
+        for (int k = 0; k < 5; k++) {
+            const double t = GAUSS_T[k], s = 1 - t;
+            const double b0 = s * s * s, b1 = 3 * s * s * t, b2 = 3 * s * t * t, b3 = t * t * t;
+            const double d0 = 3 * s * s, d1 = 6 * s * t, d2 = 3 * t * t;
+            
+            add(b0 * x[0] + b1 * x[1] + b2 * x[2] + b3 * x[3],
+                b0 * y[0] + b1 * y[1] + b2 * y[2] + b3 * y[3],
+                d0 * (x[1] - x[0]) + d1 * (x[2] - x[1]) + d2 * (x[3] - x[2]),
+                d0 * (y[1] - y[0]) + d1 * (y[2] - y[1]) + d2 * (y[3] - y[2]), GAUSS_W[k]);
+        }
+        return true;
+    }
+    
+    void add(double x, double y, double dx, double dy, double w) {
+        const double ds = w * sqrt(dx * dx + dy * dy);
+        
+        sa += w * (x * dy - y * dx) / 2;
+        sx += w * x * x * dy / 2;
+        sy -= w * y * y * dx / 2;
+        len += ds;
+        lx += ds * x;
+        ly += ds * y;
+    }
+};
+
+struct MgShapeQuery::Impl {
+    int                         threads;    // 含调用线程的线程数
+    int                         started;    // 已创建的工作线程数
+    std::vector<const MgShape*> shapes;
+    std::vector<int>            ids;
+    std::vector<Box2d>          extents;
+    std::vector<float>          lengths;
+    std::vector<float>          areas;
+    std::vector<Point2d>        centroids;
+    std::vector<char>           hits;
+    int                         flags;
+    Box2d                       rect;
+    volatile long               next;       // 已取出的块数
+    volatile long               pending;    // 未完成的本轮计算数
+    volatile long               quit;
+#ifdef _WIN32
+    std::vector<HANDLE>         workers;
+    HANDLE                      sem;        // 每个计数让一个工作线程计算一轮
+    HANDLE                      done;
+#else
+    std::vector<pthread_t>      workers;
+    pthread_mutex_t             mutex;
+    pthread_cond_t              wake;
+    pthread_cond_t              done;
+    int                         tickets;    // 待领取的计算轮数
+#endif
+    
+    Impl(int threads);
+    ~Impl();
+    bool startWorkers();
+    void stopWorkers();
+    void execute();
+    void run();
+    void compute(int i);
+    
+    static int getProcessorCount();
+#ifdef _WIN32
+    static DWORD WINAPI threadProc(LPVOID p) { ((Impl*)p)->workerLoop(); return 0; }
+#else
+    static void* threadProc(void* p) { ((Impl*)p)->workerLoop(); return NULL; }
+#endif
+    void workerLoop();
+};
+
+MgShapeQuery::Impl::Impl(int threads)
+    : threads(threads), started(0), flags(0), next(0), pending(0), quit(0)
+{
+    if (this->threads < 1) {
+        this->threads = getProcessorCount();
+    }
+    this->threads = this->threads < MAX_THREADS ? this->threads : MAX_THREADS;
+}
+
+MgShapeQuery::Impl::~Impl()
+{
+    stopWorkers();
+}
+
+int MgShapeQuery::Impl::getProcessorCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+bool MgShapeQuery::Impl::startWorkers()
+{
+    if (started > 0) {
+        return true;
+    }
+#ifdef _WIN32
+    sem = CreateSemaphore(NULL, 0, MAX_THREADS, NULL);
+    done = CreateEvent(NULL, FALSE, FALSE, NULL);
+    for (int i = 1; sem && done && i < threads; i++) {
+        HANDLE thread = CreateThread(NULL, 0, threadProc, this, 0, NULL);
+        if (!thread)
+            break;
+        workers.push_back(thread);
+    }
+    if (workers.empty()) {
+        if (sem) CloseHandle(sem);
+        if (done) CloseHandle(done);
+    }
+#else
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_cond_init(&done, NULL);
+    tickets = 0;
+    for (int i = 1; i < threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, threadProc, this) != 0)
+            break;
+        workers.push_back(thread);
+    }
+    if (workers.empty()) {
+        pthread_cond_destroy(&done);
+        pthread_cond_destroy(&wake);
+        pthread_mutex_destroy(&mutex);
+    }
+#endif
+    started = (int)workers.size();
+    if (started == 0) {
+        threads = 1;                        // 不能创建线程时只在调用线程中计算
+    }
+    return started > 0;
+}
+
+void MgShapeQuery::Impl::stopWorkers()
+{
+    if (started == 0)
+        return;
+    giAtomicIncrement(&quit);
+#ifdef _WIN32
+    ReleaseSemaphore(sem, started, NULL);
+    for (size_t i = 0; i < workers.size(); i++) {
+        WaitForSingleObject(workers[i], INFINITE);
+        CloseHandle(workers[i]);
+    }
+    CloseHandle(sem);
+    CloseHandle(done);
+#else
+    pthread_mutex_lock(&mutex);
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&mutex);
+    for (size_t i = 0; i < workers.size(); i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_cond_destroy(&done);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&mutex);
+#endif
+    workers.clear();
+    started = 0;
+}
+
+void MgShapeQuery::Impl::workerLoop()
+{
+    for (;;) {
+#ifdef _WIN32
+        WaitForSingleObject(sem, INFINITE);
+        if (quit)
+            break;
+        run();
+        if (giAtomicDecrement(&pending) == 0) {
+            SetEvent(done);
+        }
+#else
+        pthread_mutex_lock(&mutex);
+        while (tickets == 0 && !quit) {
+            pthread_cond_wait(&wake, &mutex);
+        }
+        if (quit) {
+            pthread_mutex_unlock(&mutex);
+            break;
+        }
+        tickets--;
+        pthread_mutex_unlock(&mutex);
+        
+        run();
+        
+        pthread_mutex_lock(&mutex);
+        if (--pending == 0) {
+            pthread_cond_signal(&done);
+        }
+        pthread_mutex_unlock(&mutex);
+#endif
+    }
+}
+
+// 本轮的每个计算者(工作线程或调用线程)都从共同的块号取块，直到取完
+void MgShapeQuery::Impl::run()
+{
+    const long count = (long)shapes.size();
+    
+    for (long start = (giAtomicIncrement(&next) - 1) * CHUNK; start < count;
+         start = (giAtomicIncrement(&next) - 1) * CHUNK) {
+        for (long i = start; i < start + CHUNK && i < count; i++) {
+            compute((int)i);
+        }
+    }
+}
+
+void MgShapeQuery::Impl::execute()
+{
+    const int n = mgMin(threads, ((int)shapes.size() + CHUNK - 1) / CHUNK) - 1;
+    
+    next = 0;
+    if (n < 1 || !startWorkers()) {
+        run();
+        return;
+    }
+    
+    const int helpers = mgMin(n, started);  // 不必唤醒所有线程
+#ifdef _WIN32
+    pending = helpers;
+    ReleaseSemaphore(sem, helpers, NULL);
+    run();
+    WaitForSingleObject(done, INFINITE);
+#else
+    pthread_mutex_lock(&mutex);
+    pending = helpers;
+    tickets = helpers;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&mutex);
+    
+    run();
+    
+    pthread_mutex_lock(&mutex);
+    while (pending > 0) {
+        pthread_cond_wait(&done, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+#endif
+}
+
+void MgShapeQuery::Impl::compute(int i)
+{
+    const MgBaseShape* shape = shapes[i]->shapec();
+    
+    if (flags & kExtent) {
+        extents[i] = shape->getExtent();
+    }
+    if (flags & (kLength | kArea | kCentroid)) {
+        MgPath path;                // 输出到局部路径，不建立图形的缓存
+        
+        shape->output(path);
+        if (flags & kLength) {
+            lengths[i] = path.getLength();
+        }
+        if (flags & (kArea | kCentroid)) {
+            const Box2d ext(shape->getExtent());
+            const double tol = 1e-5 * (ext.width() + ext.height());   // 面积、长度可忽略的尺度
+            MgQueryMoments m(ext.center());
+            
+            path.scanSegments(m);
+            if (flags & kArea) {
+                areas[i] = (float)fabs(m.area);
+            }
+            if (flags & kCentroid) {
+                if (fabs(m.area) > tol * tol) {
+                    centroids[i].set((float)(m.org.x + m.mx / m.area), (float)(m.org.y + m.my / m.area));
+                } else if (m.len > tol) {
+                    centroids[i].set((float)(m.org.x + m.lx / m.len), (float)(m.org.y + m.ly / m.len));
+                } else {
+                    centroids[i] = m.org;
+                }
+            }
+        }
+    }
+}
+
+MgShapeQuery::MgShapeQuery(int threads) : im(new Impl(threads))
+{
+}
+
+MgShapeQuery::~MgShapeQuery()
+{
+    delete im;
+}
+
+int MgShapeQuery::getThreadCount() const
+{
+    return im->threads;
+}
+
+int MgShapeQuery::query(const MgShapes* shapes, int flags, MgShapes::Filter filter,
+                        void* data, const Box2d* rect)
+{
+    MgShapeIterator it(shapes);     // 计算完成前保持遍历，列表在其他地方修改时不影响这些图形
+    std::vector<const MgShape*> arr;
+    
+    while (const MgShape* sp = it.getNext()) {
+        if (!filter || filter(sp, data)) {
+            arr.push_back(sp);
+        }
+    }
+    return query((int)arr.size(), arr.empty() ? (const MgShape* const*)0 : &arr[0], flags, rect);
+}
+
+int MgShapeQuery::query(int count, const MgShape* const* shapes, int flags, const Box2d* rect)
+{
+    const size_t n = count > 0 && shapes ? (size_t)count : 0;
+    
+    im->shapes.assign(shapes, shapes + n);
+    im->flags = flags;
+    im->rect = rect ? *rect : Box2d();
+    im->ids.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        im->ids[i] = shapes[i]->getID();
+    }
+    im->extents.resize(flags & kExtent ? n : 0);
+    im->lengths.resize(flags & kLength ? n : 0);
+    im->areas.resize(flags & kArea ? n : 0);
+    im->centroids.resize(flags & kCentroid ? n : 0);
+    im->hits.resize(flags & kHitBox ? n : 0);
+    
+    if (flags & kHitBox) {          // 点中测试会按需建立图形的分块缓存，只在调用线程中进行
+        for (size_t i = 0; i < n; i++) {
+            im->hits[i] = shapes[i]->shapec()->hitTestBox(im->rect) ? 1 : 0;
+        }
+    }
+    if (n > 0 && (flags & ~kHitBox)) {
+        im->execute();
+    }
+    return (int)n;
+}
+
+int MgShapeQuery::getCount() const
+{
+    return (int)im->shapes.size();
+}
+
+const MgShape* MgShapeQuery::getShape(int index) const
+{
+    return index >= 0 && index < getCount() ? im->shapes[index] : MgShape::Null();
+}
+
+const int* MgShapeQuery::getIDs() const
+{
+    return im->ids.empty() ? (const int*)0 : &im->ids[0];
+}
+
+const Box2d* MgShapeQuery::getExtents() const
+{
+    return im->extents.empty() ? (const Box2d*)0 : &im->extents[0];
+}
+
+const float* MgShapeQuery::getLengths() const
+{
+    return im->lengths.empty() ? (const float*)0 : &im->lengths[0];
+}
+
+const float* MgShapeQuery::getAreas() const
+{
+    return im->areas.empty() ? (const float*)0 : &im->areas[0];
+}
+
+const Point2d* MgShapeQuery::getCentroids() const
+{
+    return im->centroids.empty() ? (const Point2d*)0 : &im->centroids[0];
+}
+
+const char* MgShapeQuery::getHits() const
+{
+    return im->hits.empty() ? (const char*)0 : &im->hits[0];
+}
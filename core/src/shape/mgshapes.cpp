@@ -8,37 +8,112 @@
 #include <list>
 #include <map>
 #include <set>
+#include <algorithm>
+
+// 图形改变记录，新记录指向之前的记录，浅拷贝的图形列表共享复制时的记录链
+struct MgShapeChange {
+    MgShapeChange*  prev;
+    long            seq;
+    int             sid;            // 0 表示调整了图形顺序
+    volatile long   refcount;
+    
+    static void release(MgShapeChange*& c) {
+        while (c && giAtomicDecrement(&c->refcount) == 0) {
+            MgShapeChange* prev = c->prev;
+            delete c;
+            c = prev;
+        }
+        c = NULL;
+    }
+};
+
+static volatile long _lineage = 0;
+
+// 图形容器，每个图形被容器引用一次。浅拷贝的图形列表共享同一容器而不必逐个增加图形的引用计数，
+// 修改共享的容器前才复制一份(写时复制)，共享期间容器只读，由最后一个使用者释放
+struct MgShapeBlock {
+    typedef std::list<MgShape*> Container;
+    typedef std::map<int, MgShape*>  ID2SHAPE;
+    
+    Container       shapes;
+    ID2SHAPE        id2shape;       // 批量修改中还包含待替换的新图形
+    volatile long   refcount;
+    
+    MgShapeBlock() : refcount(1) {}
+    ~MgShapeBlock() {
+        for (Container::iterator it = shapes.begin(); it != shapes.end(); ++it) {
+            (*it)->release();
+        }
+    }
+    static void release(MgShapeBlock*& b) {
+        if (b && giAtomicDecrement(&b->refcount) == 0) {
+            delete b;
+        }
+        b = NULL;
+    }
+};
+
+// 图形遍历位置，遍历期间保持所遍历的容器
+struct MgShapeBlockIterator {
+    MgShapeBlock*   block;
+    MgShapeBlock::Container::const_iterator it;
+};
 
 struct MgShapes::I
 {
-    typedef std::list<MgShape*> Container;
+    typedef MgShapeBlock::Container Container;
     typedef Container::const_iterator citerator;
     typedef Container::iterator iterator;
-    typedef std::map<int, MgShape*>  ID2SHAPE;
+    typedef MgShapeBlock::ID2SHAPE  ID2SHAPE;
     
-    Container   shapes;
-    ID2SHAPE    id2shape;
+    MgShapeBlock* block;
     MgObject*   owner;
     int         index;
     int         newShapeID;
     volatile long refcount;
+    int         batchLevel;         // 批量修改的嵌套层数
+    int         batchChanges;       // 批量修改期间增删改的图形数
+    
+    std::set<MgShape*>              removed;    // 批量修改中待从列表移除的图形
+    std::map<MgShape*, MgShape*>    replaced;   // 批量修改中待替换的图形: 列表中的原图形->新图形
+    ID2SHAPE                        origins;    // 已替换图形的ID->列表中的原图形
+    
+    MgShapeChange*  changes;        // 最新的改变记录
+    long            lineage;        // 改变记录链的标识，清空或浅拷贝后修改时换新
+    long            changeSeq;      // 最新的改变序号
+    int             changeLength;   // 记录链的长度
+    bool            ownsChanges;    // 是否可追加改变记录，浅拷贝的列表共享原列表的记录
+    
+    Container& shapes() { detach(); return block->shapes; }
+    ID2SHAPE& id2shape() { detach(); return block->id2shape; }
+    const Container& cshapes() const { return block->shapes; }
+    const ID2SHAPE& cid2shape() const { return block->id2shape; }
+    void detach();
+    void share(MgShapeBlock* b);
     
     MgShape* findShape(int sid) const;
     int getNewID(int sid);
+    MgShape* takePending(int sid);
+    void sync();
+    void logChange(int sid);
+    void resetChanges();
     
     iterator findPositionOfID(int sid) {
-        iterator it = shapes.begin();
-        for (; it != shapes.end() && (*it)->getID() != sid; ++it) ;
+        sync();
+        iterator it = shapes().begin();
+        for (; it != shapes().end() && (*it)->getID() != sid; ++it) ;
         return it;
     }
     iterator findPositionOfIndex(int index) {
-        iterator it = shapes.begin();
-        for (int i = 0; it != shapes.end() && i != index; ++it, ++i) ;
+        sync();
+        iterator it = shapes().begin();
+        for (int i = 0; it != shapes().end() && i != index; ++it, ++i) ;
         return it;
     }
     citerator findPositionOfIndex(int index) const {
-        citerator it = shapes.begin();
-        for (int i = 0; it != shapes.end() && i != index; ++it, ++i) ;
+        const_cast<I*>(this)->sync();
+        citerator it = cshapes().begin();
+        for (int i = 0; it != cshapes().end() && i != index; ++it, ++i) ;
         return it;
     }
 };
@@ -54,15 +129,22 @@ MgShapes::MgShapes(MgObject* owner, int index)
 {
     //LOGD("+MgShapes %ld", giAtomicIncrement(&_n));
     im = new I();
+    im->block = new MgShapeBlock();
     im->owner = owner;
     im->index = index;
     im->newShapeID = 1;
     im->refcount = 1;
+    im->batchLevel = 0;
+    im->batchChanges = 0;
+    im->changes = NULL;
+    im->resetChanges();
 }
 
 MgShapes::~MgShapes()
 {
     clear();
+    MgShapeBlock::release(im->block);
+    MgShapeChange::release(im->changes);
     delete im;
     //LOGD("-MgShapes %ld", giAtomicDecrement(&_n));
 }
@@ -103,17 +185,36 @@ int MgShapes::copyShapes(const MgShapes* src, bool deeply, bool needClear)
     
     int ret = 0;
     MgShapeIterator it(src);
+    bool shareChanges = needClear && !deeply && src && src != this;
     
-    while (MgShape* sp = const_cast<MgShape*>(it.getNext())) {
-        if (deeply) {
-            ret += addShape(*sp) ? 1 : 0;
-        } else {
-            sp->addRef();
-            im->shapes.push_back(sp);
-            im->id2shape[sp->getID()] = sp;
-            ret++;
+    if (shareChanges) {                     // 共享原列表的图形容器，不必逐个增加引用计数
+        src->im->sync();
+        im->share(src->im->block);
+        ret = (int)im->cshapes().size();
+    }
+    else {
+        while (MgShape* sp = const_cast<MgShape*>(it.getNext())) {
+            if (deeply) {
+                ret += addShape(*sp) ? 1 : 0;
+            } else {
+                sp->addRef();
+                im->shapes().push_back(sp);
+                im->id2shape()[sp->getID()] = sp;
+                im->logChange(sp->getID());
+                ret++;
+            }
         }
     }
+    if (shareChanges) {                     // 浅拷贝得到原列表的快照，共享其改变记录
+        MgShapeChange::release(im->changes);
+        im->changes = src->im->changes;
+        if (im->changes)
+            giAtomicIncrement(&im->changes->refcount);
+        im->lineage = src->im->lineage;
+        im->changeSeq = src->im->changeSeq;
+        im->changeLength = src->im->changeLength;
+        im->ownsChanges = false;
+    }
     
     return ret;
 }
@@ -124,7 +225,9 @@ bool MgShapes::equals(const MgObject& src) const
     
     if (src.isKindOf(Type())) {
         const MgShapes& _src = (const MgShapes&)src;
-        ret = (im->shapes == _src.im->shapes);
+        im->sync();
+        _src.im->sync();
+        ret = (im->cshapes() == _src.im->cshapes());
     }
     
     return ret;
@@ -132,16 +235,15 @@ bool MgShapes::equals(const MgObject& src) const
 
 void MgShapes::clear()
 {
-    for (I::iterator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
-        (*it)->release();
-    }
-    im->shapes.clear();
-    im->id2shape.clear();
+    im->sync();
+    im->share(NULL);
+    im->resetChanges();
 }
 
 void MgShapes::clearCachedData()
 {
-    for (I::iterator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
+    im->sync();
+    for (I::citerator it = im->cshapes().begin(); it != im->cshapes().end(); ++it) {
         (*it)->shape()->clearCachedData();
     }
 }
@@ -158,16 +260,43 @@ int MgShapes::getIndex() const
 
 bool MgShapes::updateShape(MgShape* shape, bool force)
 {
-    if (shape && (force || !shape->getParent() || shape->getParent() == this)) {
+    if (shape && (force || !shape->getParent() || shape->getParent() == this)
+        && im->findShape(shape->getID()) == shape) {
+        shape->shape()->update();       // 已是列表中的图形，批量内外都只更新而不释放
+        im->logChange(shape->getID());
+        return true;
+    }
+    if (shape && (force || !shape->getParent() || shape->getParent() == this)
+        && im->batchLevel > 0) {
+        MgShape* oldsp = im->findShape(shape->getID());
+        if (oldsp) {
+            MgShape* orgsp = im->takePending(shape->getID());
+            shape->shape()->update();
+            shape->shape()->resetChangeCount(oldsp->shapec()->getChangeCount()
+                                             + (oldsp->equals(*shape) ? 0 : 1));
+            if (orgsp != oldsp) {
+                oldsp->release();           // 本批量中之前替换的新图形尚未进入列表
+            }
+            im->replaced[orgsp] = shape;
+            im->origins[shape->getID()] = orgsp;
+            shape->setParent(this, shape->getID());
+            im->id2shape()[shape->getID()] = shape;
+            im->batchChanges++;
+            im->logChange(shape->getID());
+            return true;
+        }
+    }
+    else if (shape && (force || !shape->getParent() || shape->getParent() == this)) {
         I::iterator it = im->findPositionOfID(shape->getID());
-        if (it != im->shapes.end()) {
+        if (it != im->shapes().end()) {
             shape->shape()->update();
             shape->shape()->resetChangeCount((*it)->shapec()->getChangeCount()
                                              + ((*it)->equals(*shape) ? 0 : 1));
             (*it)->release();
             *it = shape;
             shape->setParent(this, shape->getID());
-            im->id2shape[shape->getID()] = shape;
+            im->id2shape()[shape->getID()] = shape;
+            im->logChange(shape->getID());
             return true;
         }
     }
@@ -176,7 +305,8 @@ bool MgShapes::updateShape(MgShape* shape, bool force)
 
 void MgShapes::transform(const Matrix2d& mat)
 {
-    for (I::iterator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
+    im->sync();
+    for (I::iterator it = im->shapes().begin(); it != im->shapes().end(); ++it) {
         MgShape* newsp = (*it)->cloneShape();
         newsp->shape()->transform(mat);
         if (!updateShape(newsp, true))
@@ -195,8 +325,10 @@ MgShape* MgShapes::addShape(const MgShape& src)
     MgShape* p = src.cloneShape();
     if (p) {
         p->setParent(this, im->getNewID(src.getID()));
-        im->shapes.push_back(p);
-        im->id2shape[p->getID()] = p;
+        im->shapes().push_back(p);
+        im->id2shape()[p->getID()] = p;
+        im->batchChanges++;
+        im->logChange(p->getID());
     }
     return p;
 }
@@ -206,8 +338,10 @@ bool MgShapes::addShapeDirect(MgShape* shape, bool force)
     if (shape && (force || !shape->getParent() || shape->getParent() == this)) {
         shape->shape()->update();
         shape->setParent(this, im->getNewID(0));
-        im->shapes.push_back(shape);
-        im->id2shape[shape->getID()] = shape;
+        im->shapes().push_back(shape);
+        im->id2shape()[shape->getID()] = shape;
+        im->batchChanges++;
+        im->logChange(shape->getID());
         return true;
     }
     return false;
@@ -215,12 +349,29 @@ bool MgShapes::addShapeDirect(MgShape* shape, bool force)
 
 bool MgShapes::removeShape(int sid)
 {
+    if (im->batchLevel > 0) {
+        MgShape* shape = im->findShape(sid);
+        if (shape) {
+            MgShape* orgsp = im->takePending(sid);
+            if (orgsp != shape) {
+                shape->release();
+            }
+            im->removed.insert(orgsp);      // 结束批量时才从列表移除并释放
+            im->id2shape().erase(sid);
+            im->batchChanges++;
+            im->logChange(sid);
+            return true;
+        }
+        return false;
+    }
+    
     I::iterator it = im->findPositionOfID(sid);
     
-    if (it != im->shapes.end()) {
+    if (it != im->shapes().end()) {
         MgShape* shape = *it;
-        im->shapes.erase(it);
-        im->id2shape.erase(shape->getID());
+        im->shapes().erase(it);
+        im->id2shape().erase(shape->getID());
+        im->logChange(shape->getID());
         shape->release();
         return true;
     }
@@ -232,11 +383,12 @@ bool MgShapes::moveShapeTo(int sid, MgShapes* dest)
 {
     I::iterator it = im->findPositionOfID(sid);
     
-    if (dest && dest != this && it != im->shapes.end()) {
+    if (dest && dest != this && it != im->shapes().end()) {
         MgShape* newsp = (*it)->cloneShape();
         newsp->setParent(dest, dest->im->getNewID(newsp->getID()));
-        dest->im->shapes.push_back(newsp);
-        dest->im->id2shape[newsp->getID()] = newsp;
+        dest->im->shapes().push_back(newsp);
+        dest->im->id2shape()[newsp->getID()] = newsp;
+        dest->im->logChange(newsp->getID());
         
         return removeShape(sid);
     }
@@ -247,11 +399,13 @@ bool MgShapes::moveShapeTo(int sid, MgShapes* dest)
 void MgShapes::copyShapesTo(MgShapes* dest) const
 {
     if (dest && dest != this) {
-        for (I::iterator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
+        im->sync();
+        for (I::citerator it = im->cshapes().begin(); it != im->cshapes().end(); ++it) {
             MgShape* newsp = (*it)->cloneShape();
             newsp->setParent(dest, dest->im->getNewID(newsp->getID()));
-            dest->im->shapes.push_back(newsp);
-            dest->im->id2shape[newsp->getID()] = newsp;
+            dest->im->shapes().push_back(newsp);
+            dest->im->id2shape()[newsp->getID()] = newsp;
+            dest->im->logChange(newsp->getID());
         }
     }
 }
@@ -260,10 +414,11 @@ bool MgShapes::bringToFront(int sid)
 {
     I::iterator it = im->findPositionOfID(sid);
     
-    if (it != im->shapes.end()) {
+    if (it != im->shapes().end()) {
         MgShape* shape = *it;
-        im->shapes.erase(it);
-        im->shapes.push_back(shape);
+        im->shapes().erase(it);
+        im->shapes().push_back(shape);
+        im->logChange(0);
         return true;
     }
     
@@ -274,10 +429,11 @@ bool MgShapes::bringToBack(int sid)
 {
     I::iterator it = im->findPositionOfID(sid);
     
-    if (it != im->shapes.end()) {
+    if (it != im->shapes().end()) {
         MgShape* shape = *it;
-        im->shapes.erase(it);
-        im->shapes.push_front(shape);
+        im->shapes().erase(it);
+        im->shapes().push_front(shape);
+        im->logChange(0);
         return true;
     }
     
@@ -288,11 +444,12 @@ bool MgShapes::bringToIndex(int sid, int index)
 {
     I::iterator it = im->findPositionOfID(sid);
     
-    if (it != im->shapes.end()) {
+    if (it != im->shapes().end()) {
         MgShape* shape = *it;
-        im->shapes.erase(it);
+        im->shapes().erase(it);
         it = im->findPositionOfIndex(index);
-        im->shapes.insert(it, shape);
+        im->shapes().insert(it, shape);
+        im->logChange(0);
         return true;
     }
     
@@ -304,6 +461,7 @@ bool MgShapes::reorderShapes(int n, const int *ids)
     I::Container shapes;
     std::set<int> newids;
     
+    im->sync();
     for (int i = 0; i < n; i++) {
         const MgShape* sp = findShape(ids[i]);
         if (sp) {
@@ -311,8 +469,9 @@ bool MgShapes::reorderShapes(int n, const int *ids)
             newids.insert(sp->getID());
         }
     }
-    if (!newids.empty() && newids.size() == im->shapes.size()) {
-        im->shapes = shapes;
+    if (!newids.empty() && newids.size() == im->cshapes().size()) {
+        im->shapes() = shapes;
+        im->logChange(0);
         return true;
     }
     return false;
@@ -320,46 +479,59 @@ bool MgShapes::reorderShapes(int n, const int *ids)
 
 int MgShapes::getShapeCount() const
 {
-    return (int)im->shapes.size();
+    im->sync();
+    return (int)im->cshapes().size();
 }
 
 void MgShapes::freeIterator(void*& it) const
 {
     if (it) {
-        delete (I::citerator*)it;
+        MgShapeBlockIterator* pit = (MgShapeBlockIterator*)it;
+        MgShapeBlock::release(pit->block);
+        delete pit;
         it = (void*)0;
     }
 }
 
 const MgShape* MgShapes::getFirstShape(void*& it) const
 {
-    if (im->shapes.empty()) {
+    im->sync();
+    if (im->cshapes().empty()) {
         it = NULL;
         return MgShape::Null();
     }
-    it = (void*)(new I::citerator(im->shapes.begin()));
-    return im->shapes.empty() ? MgShape::Null() : im->shapes.front();
+    
+    MgShapeBlockIterator* pit = new MgShapeBlockIterator();
+    
+    pit->block = im->block;                 // 遍历中修改列表时在新容器上修改，不影响遍历
+    giAtomicIncrement(&pit->block->refcount);
+    pit->it = pit->block->shapes.begin();
+    it = (void*)pit;
+    
+    return pit->block->shapes.front();
 }
 
 const MgShape* MgShapes::getNextShape(void*& it) const
 {
-    I::citerator* pit = (I::citerator*)it;
-    if (pit && *pit != im->shapes.end()) {
-        ++(*pit);
-        if (*pit != im->shapes.end())
-            return *(*pit);
+    MgShapeBlockIterator* pit = (MgShapeBlockIterator*)it;
+    if (pit && pit->it != pit->block->shapes.end()) {
+        ++pit->it;
+        if (pit->it != pit->block->shapes.end())
+            return *pit->it;
     }
     return MgShape::Null();
 }
 
 const MgShape* MgShapes::getHeadShape() const
 {
-    return im->shapes.empty() ? MgShape::Null() : im->shapes.front();
+    im->sync();
+    return im->cshapes().empty() ? MgShape::Null() : im->cshapes().front();
 }
 
 const MgShape* MgShapes::getLastShape() const
 {
-    return im->shapes.empty() ? MgShape::Null() : im->shapes.back();
+    im->sync();
+    return im->cshapes().empty() ? MgShape::Null() : im->cshapes().back();
 }
 
 const MgShape* MgShapes::findShape(int sid) const
@@ -372,7 +544,8 @@ const MgShape* MgShapes::findShapeByTag(int tag) const
     if (0 == tag) {
         return MgShape::Null();
     }
-    for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
+    im->sync();
+    for (I::citerator it = im->cshapes().begin(); it != im->cshapes().end(); ++it) {
         if ((*it)->getTag() == tag)
             return *it;
     }
@@ -382,7 +555,8 @@ const MgShape* MgShapes::findShapeByTag(int tag) const
 int MgShapes::getShapeCountByTypeOrTag(int type, int tag) const
 {
     int n = 0;
-    for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
+    im->sync();
+    for (I::citerator it = im->cshapes().begin(); it != im->cshapes().end(); ++it) {
         if ((type != 0 && type == (*it)->shapec()->getType()) ||
             (tag != 0 && tag == (*it)->getTag())) {
             n++;
@@ -394,7 +568,8 @@ int MgShapes::getShapeCountByTypeOrTag(int type, int tag) const
 int MgShapes::getShapeIndex(int sid) const
 {
     int i = 0;
-    for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it, ++i) {
+    im->sync();
+    for (I::citerator it = im->cshapes().begin(); it != im->cshapes().end(); ++it, ++i) {
         if ((*it)->getID() == sid)
             return i;
     }
@@ -404,7 +579,7 @@ int MgShapes::getShapeIndex(int sid) const
 const MgShape* MgShapes::getShapeAtIndex(int index) const
 {
     I::citerator it = im->findPositionOfIndex(index);
-    return it != im->shapes.end() ? *it : MgShape::Null();
+    return it != im->cshapes().end() ? *it : MgShape::Null();
 }
 
 const MgShape* MgShapes::findShapeByType(int type) const
@@ -412,7 +587,8 @@ const MgShape* MgShapes::findShapeByType(int type) const
     if (0 == type) {
         return MgShape::Null();
     }
-    for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
+    im->sync();
+    for (I::citerator it = im->cshapes().begin(); it != im->cshapes().end(); ++it) {
         if ((*it)->shapec()->getType() == type)
             return *it;
     }
@@ -421,7 +597,8 @@ const MgShape* MgShapes::findShapeByType(int type) const
 
 const MgShape* MgShapes::findShapeByTypeAndTag(int type, int tag) const
 {
-    for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
+    im->sync();
+    for (I::citerator it = im->cshapes().begin(); it != im->cshapes().end(); ++it) {
         if ((*it)->shapec()->getType() == type && (*it)->getTag() == tag)
             return *it;
     }
@@ -432,7 +609,8 @@ int MgShapes::traverseByType(int type, void (*c)(const MgShape*, void*), void* d
 {
     int count = 0;
     
-    for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
+    im->sync();
+    for (I::citerator it = im->cshapes().begin(); it != im->cshapes().end(); ++it) {
         const MgBaseShape* shape = (*it)->shapec();
         if (type == 0 || shape->isKindOf(type)) {
             (*c)(*it, d);
@@ -462,7 +640,8 @@ static const float EXTENT_LIMIT = 1e5f - 1.f;
 Box2d MgShapes::getExtent() const
 {
     Box2d extent;
-    for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
+    im->sync();
+    for (I::citerator it = im->cshapes().begin(); it != im->cshapes().end(); ++it) {
         Box2d box((*it)->shapec()->getExtent());
         if (box.xmin > -EXTENT_LIMIT && box.ymin > -EXTENT_LIMIT &&
             box.xmax <  EXTENT_LIMIT && box.ymax <  EXTENT_LIMIT) {
@@ -484,7 +663,8 @@ const MgShape* MgShapes::hitTest(const Box2d& limits, MgHitResult& res,
     const MgShape* retshape = MgShape::Null();
     
     res.dist = limits.width() > 1e4f ? limits.width() : limits.width() * 20.f;
-    for (I::citerator it = im->shapes.begin(); it != im->shapes.end(); ++it) {
+    im->sync();
+    for (I::citerator it = im->cshapes().begin(); it != im->cshapes().end(); ++it) {
         const MgBaseShape* shape = (*it)->shapec();
         Box2d extent(shape->getExtent());
         
@@ -523,7 +703,8 @@ int MgShapes::dyndraw(int mode, GiGraphics& gs, const GiContext *ctx,
     Box2d clip(gs.getClipModel());
     int count = 0;
     
-    for (I::citerator it = im->shapes.begin(); it != im->shapes.end() && !gs.isStopping(); ++it) {
+    im->sync();
+    for (I::citerator it = im->cshapes().begin(); it != im->cshapes().end() && !gs.isStopping(); ++it) {
         const MgShape* sp = *it;
         if (ignoreIds) {
             for (int i = 0; ignoreIds[i]; i++) {
@@ -549,13 +730,14 @@ bool MgShapes::save(MgStorage* s, int startIndex) const
     int index = 0;
     
     if (s && s->writeNode("shapes", im->index, false)) {
+        im->sync();
         ret = saveExtra(s);
         rect = getExtent();
         s->writeFloatArray("extent", &rect.xmin, 4);
-        s->writeInt("count", (int)im->shapes.size() - startIndex);
+        s->writeInt("count", (int)im->cshapes().size() - startIndex);
         
-        for (I::citerator it = im->shapes.begin();
-             ret && it != im->shapes.end(); ++it, ++index)
+        for (I::citerator it = im->cshapes().begin();
+             ret && it != im->cshapes().end(); ++it, ++index)
         {
             if (index < startIndex)
                 continue;
@@ -594,6 +776,7 @@ int MgShapes::load(MgShapeFactory* factory, MgStorage* s, bool addOnly)
     if (ret) {
         if (!addOnly)
             clear();
+        im->sync();
         
         ret = loadExtra(s);
         s->readFloatArray("extent", &rect.xmin, 4, false);
@@ -617,12 +800,13 @@ int MgShapes::load(MgShapeFactory* factory, MgStorage* s, bool addOnly)
                 if (ret) {
                     count++;
                     newsp->shape()->setFlag(kMgClosed, newsp->shape()->isClosed());
-                    im->id2shape[newsp->getID()] = newsp;
                     if (oldsp) {
-                        updateShape(newsp);
+                        updateShape(newsp);         // 替换列表中的原图形
                     }
                     else {
-                        im->shapes.push_back(newsp);
+                        im->id2shape()[newsp->getID()] = newsp;
+                        im->shapes().push_back(newsp);
+                        im->logChange(newsp->getID());
                     }
                 }
                 else {
@@ -643,17 +827,160 @@ int MgShapes::load(MgShapeFactory* factory, MgStorage* s, bool addOnly)
     return ret ? count : (count > 0 ? -count : -1);
 }
 
+void MgShapes::beginBatch()
+{
+    if (im->batchLevel++ == 0) {
+        im->batchChanges = 0;
+    }
+}
+
+int MgShapes::endBatch()
+{
+    if (im->batchLevel > 0 && --im->batchLevel == 0) {
+        im->sync();
+        int n = im->batchChanges;
+        im->batchChanges = 0;
+        return n;
+    }
+    return 0;
+}
+
+bool MgShapes::isInBatch() const
+{
+    return im->batchLevel > 0;
+}
+
 void MgShapes::setNewShapeID(int sid)
 {
     im->newShapeID = sid;
 }
 
+// 修改共享的容器前复制一份。前台文档总保留一个浅拷贝，所以发布后的首次修改要复制列表和
+// ID表并逐个增加图形的引用计数，但这只在发布后有修改时才发生，不修改就不必复制
+void MgShapes::I::detach()
+{
+    if (block->refcount > 1) {
+        MgShapeBlock* b = new MgShapeBlock();
+        
+        b->shapes = block->shapes;
+        b->id2shape = block->id2shape;
+        for (iterator it = b->shapes.begin(); it != b->shapes.end(); ++it) {
+            (*it)->addRef();
+        }
+        MgShapeBlock::release(block);
+        block = b;
+    }
+}
+
+void MgShapes::I::share(MgShapeBlock* b)
+{
+    if (b) {
+        giAtomicIncrement(&b->refcount);
+    }
+    MgShapeBlock::release(block);
+    block = b ? b : new MgShapeBlock();
+}
+
 MgShape* MgShapes::I::findShape(int sid) const
 {
     if (0 == sid || -1 == sid)
         return MgShape::Null();
-    ID2SHAPE::const_iterator it = id2shape.find(sid);
-    return it != id2shape.end() ? it->second : MgShape::Null();
+    ID2SHAPE::const_iterator it = cid2shape().find(sid);
+    return it != cid2shape().end() ? it->second : MgShape::Null();
+}
+
+MgShape* MgShapes::I::takePending(int sid)
+{
+    ID2SHAPE::iterator it = origins.find(sid);
+    MgShape* orgsp = it != origins.end() ? it->second : findShape(sid);
+    
+    if (it != origins.end()) {
+        replaced.erase(orgsp);
+        origins.erase(it);
+    }
+    return orgsp;
+}
+
+void MgShapes::I::sync()
+{
+    if (removed.empty() && replaced.empty()) {
+        return;
+    }
+    for (iterator it = shapes().begin(); it != shapes().end(); ) {
+        std::map<MgShape*, MgShape*>::iterator rep = replaced.find(*it);
+        
+        if (rep != replaced.end()) {
+            (*it)->release();
+            *it++ = rep->second;
+        }
+        else if (removed.find(*it) != removed.end()) {
+            (*it)->release();
+            it = shapes().erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    removed.clear();
+    replaced.clear();
+    origins.clear();
+}
+
+void MgShapes::getChangeMark(long& lineage, long& seq) const
+{
+    lineage = im->lineage;
+    seq = im->changeSeq;
+}
+
+bool MgShapes::getChangedIDs(long lineage, long seq, std::vector<int>& ids) const
+{
+    if (lineage != im->lineage || seq > im->changeSeq) {
+        return false;
+    }
+    
+    const MgShapeChange* c = im->changes;
+    long expected = im->changeSeq;
+    size_t n = ids.size();
+    
+    for (; c && c->seq > seq; c = c->prev, expected--) {
+        ids.push_back(c->sid);
+    }
+    if (expected != seq) {                      // 记录链已被截断
+        ids.resize(n);
+        return false;
+    }
+    std::reverse(ids.begin() + n, ids.end());
+    
+    return true;
+}
+
+void MgShapes::I::logChange(int sid)
+{
+    if (!ownsChanges) {                         // 浅拷贝的列表被修改后就不再共享原列表的记录
+        resetChanges();
+    }
+    else if (changeLength > 4096 && changeLength > 2 * (int)cid2shape().size()) {
+        MgShapeChange::release(changes);        // 截断过长的记录，之前的记录点需要全部比较
+        changeLength = 0;
+    }
+    
+    MgShapeChange* c = new MgShapeChange();
+    
+    c->prev = changes;
+    c->seq = ++changeSeq;
+    c->sid = sid;
+    c->refcount = 1;
+    changes = c;
+    changeLength++;
+}
+
+void MgShapes::I::resetChanges()
+{
+    MgShapeChange::release(changes);
+    lineage = giAtomicIncrement(&_lineage);
+    changeSeq = 0;
+    changeLength = 0;
+    ownsChanges = true;
 }
 
 int MgShapes::I::getNewID(int sid)
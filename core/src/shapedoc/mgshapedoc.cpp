@@ -5,12 +5,14 @@
 #include "mgshapedoc.h"
 #include "mgstorage.h"
 #include <vector>
+#include <algorithm>
 #include "mglayer.h"
 #include "mgcomposite.h"
 #include "mglog.h"
 
 struct MgShapeDoc::Impl {
     std::vector<MgLayer*> layers;
+    std::vector<MgShapes*> batched; // 正在批量修改的图形列表
     MgLayer*    curLayer;
     MgShapes*   curShapes;
     GiContext   context;
@@ -19,6 +21,7 @@ struct MgShapeDoc::Impl {
     Box2d       rectWInitial;
     float       viewScale;
     volatile long   refcount;
+    int         batchLevel;
     bool        readOnly;
 };
 
@@ -34,10 +37,15 @@ MgShapeDoc::MgShapeDoc()
     im->viewScale = 0;
     im->readOnly = false;
     im->refcount = 1;
+    im->batchLevel = 0;
 }
 
 MgShapeDoc::~MgShapeDoc()
 {
+    if (im->batchLevel > 0) {
+        im->batchLevel = 1;
+        endBatch();
+    }
     for (unsigned i = 0; i < im->layers.size(); i++) {
         im->layers[i]->release();
     }
@@ -180,6 +188,35 @@ void MgShapeDoc::clearCachedData()
     }
 }
 
+void MgShapeDoc::beginBatch()
+{
+    if (im->batchLevel++ == 0) {
+        im->batched.assign(im->layers.begin(), im->layers.end());
+        if (std::find(im->batched.begin(), im->batched.end(), im->curShapes) == im->batched.end()) {
+            im->batched.push_back(im->curShapes);
+        }
+        for (unsigned i = 0; i < im->batched.size(); i++) {
+            im->batched[i]->addRef();
+            im->batched[i]->beginBatch();
+        }
+    }
+}
+
+int MgShapeDoc::endBatch()
+{
+    int n = 0;
+    
+    if (im->batchLevel > 0 && --im->batchLevel == 0) {
+        for (unsigned i = 0; i < im->batched.size(); i++) {
+            n += im->batched[i]->endBatch();
+            im->batched[i]->release();
+        }
+        im->batched.clear();
+    }
+    
+    return n;
+}
+
 Box2d MgShapeDoc::getExtent() const
 {
     Box2d rect;
@@ -0,0 +1,100 @@
+//! \file testfitcurves.cpp
+//! \brief Implement the benchmark class of curve fitting: TestFitCurves.
+// Copyright (c) 2004-2015, https://github.com/rhcad/vgcore, BSD License
+
+#include "testfitcurves.h"
+#include "mgcurv.h"
+#include "mglnrel.h"
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+
+void TestFitCurves::makeStroke(int n, Point2d* pts, unsigned seed)
+{
+    float angle = 0.f, turn = 0.f;
+    Point2d pt(0.f, 0.f);
+    
+    srand(seed);
+    for (int i = 0; i < n; i++) {
+        if (i % 40 == 0) {      // change the turning rate now and then
+            turn = ((float)(rand() % 200) / 100.f - 1.f) * 0.05f;
+        }
+        angle += turn;
+        pt += Vector2d(cosf(angle), sinf(angle));
+        pts[i] = pt + Vector2d((float)(rand() % 100) / 400.f, (float)(rand() % 100) / 400.f);
+    }
+}
+
+static void appendSegment(void* data, const Point2d curve[4])
+{
+    std::vector<Point2d>* segs = (std::vector<Point2d>*)data;
+    segs->insert(segs->end(), curve, curve + 4);
+}
+
+float TestFitCurves::maxError(int count, const Point2d* pts, int segCount, const Point2d* segs)
+{
+    const int kSteps = 32;          // each segment is flattened to a polyline of kSteps lines
+    std::vector<Point2d> lines;
+    int n = 0;
+    float maxDist = 0.f;
+    Point2d nearpt;
+    
+    lines.resize(mgMax(segCount, 1) * (kSteps + 1));
+    for (int j = 0; j < segCount; j++) {
+        if (!segs[j * 4].isDegenerate()) {
+            for (int k = 0; k <= kSteps; k++) {
+                mgcurv::fitBezier(segs + j * 4, (float)k / kSteps, lines[n * (kSteps + 1) + k]);
+            }
+            n++;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        float dist = _FLT_MAX;
+        for (int j = 0; j < n * (kSteps + 1); j++) {
+            if ((j + 1) % (kSteps + 1) != 0) {
+                dist = mgMin(dist, mglnrel::ptToLine(lines[j], lines[j + 1], pts[i], nearpt));
+            }
+        }
+        maxDist = mgMax(maxDist, dist);
+    }
+    
+    return maxDist;
+}
+
+bool TestFitCurves::benchmark(int pointCount, int loops, float tol, Result& result)
+{
+    if (pointCount < 3 || loops < 1)
+        return false;
+    
+    std::vector<Point2d> pts(pointCount);
+    std::vector<Point2d> segs, fastSegs;
+    clock_t t;
+    int i;
+    
+    makeStroke(pointCount, &pts.front());
+    result.pointCount = pointCount;
+    
+    t = clock();
+    for (i = 0; i < loops; i++) {
+        segs.clear();
+        mgcurv::fitCurve3(appendSegment, &segs, &pts.front(), pointCount, tol);
+    }
+    result.ms = (float)(clock() - t) * 1000.f / CLOCKS_PER_SEC / loops;
+    
+    t = clock();
+    for (i = 0; i < loops; i++) {
+        fastSegs.clear();
+        mgcurv::fitCurve3Fast(appendSegment, &fastSegs, &pts.front(), pointCount, tol);
+    }
+    result.fastMs = (float)(clock() - t) * 1000.f / CLOCKS_PER_SEC / loops;
+    
+    result.segCount = (int)segs.size() / 4;
+    result.fastSegCount = (int)fastSegs.size() / 4;
+    result.maxError = result.segCount > 0 ? maxError(pointCount, &pts.front(),
+                                                     result.segCount, &segs.front()) : _FLT_MAX;
+    result.fastMaxError = result.fastSegCount > 0 ? maxError(pointCount, &pts.front(),
+                                                             result.fastSegCount, &fastSegs.front()) : _FLT_MAX;
+    
+    return result.segCount > 0 && result.fastSegCount > 0;
+}
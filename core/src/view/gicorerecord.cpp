@@ -8,6 +8,21 @@
 
 static const bool VG_PRETTY = false;
 
+// 视图选项 asyncRecord 为 true 时在后台线程中序列化和写入录制步骤，
+// recordCheckpointFrames 和 recordCheckpointKB 为录制检查点的间隔，
+// undoMemoryKB 大于0时在内存中保留最近步骤的文档快照用于撤销和重做
+static void initRecorder(GiCoreViewImpl* impl, MgRecordShapes* recorder)
+{
+    if (recorder->isPlaying())
+        return;
+    if (impl->getOptionBool("asyncRecord", false)) {
+        recorder->setAsync(true, impl->getOptionInt("recordQueueSize", 16));
+    }
+    recorder->setUndoMemoryBudget(impl->getOptionInt("undoMemoryKB", 0) * 1024L);
+    recorder->setCheckpointInterval(impl->getOptionInt("recordCheckpointFrames", 300),
+                                    impl->getOptionInt("recordCheckpointKB", 1024) * 1024L);
+}
+
 long GiCoreView::getRecordTick(bool forUndo, long curTick)
 {
     MgRecordShapes* recorder = impl->recorder(forUndo);
@@ -23,6 +38,7 @@ bool GiCoreView::startRecord(const char* path, long doc, bool forUndo,
 {
     MgRecordShapes* p = new MgRecordShapes(path, MgShapeDoc::fromHandle(doc), forUndo, curTick);
     impl->setRecorder(forUndo, p);
+    initRecorder(impl, p);
     
     if (isPlaying() || forUndo) {
         return true;
@@ -71,7 +87,7 @@ bool GiCoreView::recordShapes(bool forUndo, long tick, long changeCount, long do
                                    MgShapeDoc::fromHandle(doc),
                                    MgShapes::fromHandle(shapes), arr) ? 2 : 1;
         if (ret > 1 && c) {
-            c->onGetString(recorder->getFileName(false, recorder->getFileCount() - 1).c_str());
+            c->onGetString(recorder->getJournalName().c_str());
         }
     } else {
         GiPlaying::releaseDoc(doc);
@@ -94,6 +110,7 @@ bool GiCoreView::restoreRecord(int type, const char* path, long doc, long change
     recorder = new MgRecordShapes(path, MgShapeDoc::fromHandle(doc), type == 0, curTick);
     recorder->restore(index, count, tick, curTick);
     impl->setRecorder(type == 0, recorder);
+    initRecorder(impl, recorder);
     
     if (type == 0 && changeCount != 0) {
         if (!giAtomicCompareAndSwap(&impl->changeCount, changeCount, impl->changeCount)) {
@@ -104,6 +121,12 @@ bool GiCoreView::restoreRecord(int type, const char* path, long doc, long change
     return true;
 }
 
+bool GiCoreView::flushRecord(bool forUndo, int timeoutMs)
+{
+    MgRecordShapes* recorder = impl->recorder(forUndo);
+    return !recorder || recorder->flush(timeoutMs);
+}
+
 bool GiCoreView::isUndoLoading() const
 {
     return impl->recorder(true) && impl->recorder(true)->isLoading();
@@ -255,20 +278,92 @@ bool GiCoreView::onResume(long curTick)
 // GiPlaying
 //
 
+// 无锁三缓冲发布的前端对象。只有一个线程发布，显示线程随时获取而不会阻塞：
+// 获取方先在 front 所指的槽上登记，再确认该槽仍是前端后才增加引用；
+// 发布方只回收既不是前端又没有获取方登记的槽，因此不会释放正被获取的对象
+struct GiFrontBuffer {
+    struct Slot {
+        MgObject*       obj;            // 读写前后都有原子操作作为屏障
+        volatile long   readers;
+    };
+    Slot            slots[3];
+    volatile long   front;
+    
+    GiFrontBuffer();
+    ~GiFrontBuffer();
+    MgObject* acquire();
+    void publish(MgObject* obj);
+    void clear();
+};
+
+GiFrontBuffer::GiFrontBuffer() : front(0)
+{
+    for (int i = 0; i < 3; i++) {
+        slots[i].obj = NULL;
+        slots[i].readers = 0;
+    }
+}
+
+GiFrontBuffer::~GiFrontBuffer()
+{
+    for (int i = 0; i < 3; i++) {
+        MgObject::release_pointer(slots[i].obj);
+    }
+}
+
+MgObject* GiFrontBuffer::acquire()
+{
+    for (;;) {
+        long i = front;
+        Slot& slot = slots[i];
+        
+        giAtomicIncrement(&slot.readers);
+        if (front == i) {                       // 登记后该槽仍是前端，发布方就不会回收它
+            MgObject* obj = slot.obj;
+            if (obj) {
+                obj->addRef();
+            }
+            giAtomicDecrement(&slot.readers);
+            return obj;
+        }
+        giAtomicDecrement(&slot.readers);       // 前端刚被换掉，重新获取
+    }
+}
+
+void GiFrontBuffer::publish(MgObject* obj)
+{
+    long old = front;
+    long i = (old + 1) % 3;
+    
+    while (slots[i].readers != 0) {             // 登记在非前端槽上的获取方会立即退出
+        i = (i + 1) % 3;
+        if (i == old) {
+            i = (i + 1) % 3;
+        }
+    }
+    MgObject::release_pointer(slots[i].obj);    // 释放两次发布前的对象
+    slots[i].obj = obj;
+    giAtomicCompareAndSwap(&front, i, old);     // 原子切换前端，同时作为内存屏障
+}
+
+void GiFrontBuffer::clear()
+{
+    for (int i = 0; i < 3; i++) {               // 依次发布空对象来回收各槽
+        publish(NULL);
+    }
+}
+
 struct GiPlaying::Impl {
-    MgShapeDoc* frontDoc_;
+    GiFrontBuffer frontDoc;             // 双面时显示用的文档
     MgShapeDoc* backDoc;
-    MgShapes*   front_;
+    GiFrontBuffer frontShapes;          // 双面时显示用的动态图形
     MgShapes*   back;
     int         tag;
     bool        doubleSided;
     volatile long stopping;
     
-    Impl(int tag, bool doubleSided) : frontDoc_(NULL), backDoc(NULL)
-        , front_(NULL), back(NULL), tag(tag), doubleSided(doubleSided), stopping(0) {}
-    
-    MgShapeDoc*& frontDoc() { return doubleSided ? frontDoc_ : backDoc; }
-    MgShapes*& frontShapes() { return doubleSided ? front_ : back; }
+    Impl(int tag, bool doubleSided) : backDoc(NULL)
+        , back(NULL), tag(tag), doubleSided(doubleSided), stopping(0) {}
 };
 
 GiPlaying* GiPlaying::create(MgCoreView* v, int tag, bool doubleSided)
@@ -300,9 +395,9 @@ GiPlaying::~GiPlaying()
 
 void GiPlaying::clear()
 {
-    MgObject::release_pointer(impl->frontDoc_);
+    impl->frontDoc.clear();
     MgObject::release_pointer(impl->backDoc);
-    MgObject::release_pointer(impl->front_);
+    impl->frontShapes.clear();
     MgObject::release_pointer(impl->back);
 }
 
@@ -323,10 +418,14 @@ bool GiPlaying::isStopping() const
 
 long GiPlaying::acquireFrontDoc()
 {
-    if (!impl->frontDoc())
+    MgShapeDoc* doc = impl->doubleSided ? (MgShapeDoc*)impl->frontDoc.acquire() : impl->backDoc;
+    
+    if (!doc)
         return 0;
-    impl->frontDoc()->addRef();
-    return impl->frontDoc()->toHandle();
+    if (!impl->doubleSided) {
+        doc->addRef();
+    }
+    return doc->toHandle();
 }
 
 void GiPlaying::releaseDoc(long doc)
@@ -346,19 +445,20 @@ MgShapeDoc* GiPlaying::getBackDoc()
 void GiPlaying::submitBackDoc()
 {
     if (impl->doubleSided) {
-        MgObject::release_pointer(impl->frontDoc_);
-        if (impl->backDoc) {
-            impl->frontDoc_ = impl->backDoc->shallowCopy();
-        }
+        impl->frontDoc.publish(impl->backDoc ? impl->backDoc->shallowCopy() : NULL);
     }
 }
 
 long GiPlaying::acquireFrontShapes()
 {
-    if (!impl->frontShapes())
+    MgShapes* shapes = impl->doubleSided ? (MgShapes*)impl->frontShapes.acquire() : impl->back;
+    
+    if (!shapes)
         return 0;
-    impl->frontShapes()->addRef();
-    return impl->frontShapes()->toHandle();
+    if (!impl->doubleSided) {
+        shapes->addRef();
+    }
+    return shapes->toHandle();
 }
 
 void GiPlaying::releaseShapes(long shapes)
@@ -388,8 +488,26 @@ MgShapes* GiPlaying::getBackShapes(bool needClear)
 void GiPlaying::submitBackShapes()
 {
     if (impl->doubleSided) {
-        MgObject::release_pointer(impl->front_);
-        impl->front_ = impl->back;
-        impl->front_->addRef();
+        impl->back->addRef();
+        impl->frontShapes.publish(impl->back);
+    }
+}
+
+int GiPlaying::submitPrefetched(MgRecordShapes* player, int tick)
+{
+    MgShapeDoc* doc = NULL;
+    MgShapes* shapes = NULL;
+    int ret = player ? player->takePrefetched(tick, &doc, &shapes) : 0;
+    
+    if (doc) {                                  // 预取的文档已是独立的浅拷贝，直接作为后台文档
+        MgObject::release_pointer(impl->backDoc);
+        impl->backDoc = doc;
+        submitBackDoc();
     }
+    if (shapes) {
+        MgObject::release_pointer(impl->back);
+        impl->back = shapes;
+        submitBackShapes();
+    }
+    return ret;
 }
@@ -36,7 +36,7 @@ GcBaseView::GcBaseView(MgView* mgview, GiView *view)
 GiCoreViewImpl::GiCoreViewImpl(GiCoreView* owner, bool useCmds)
     : _cmds(NULL), curview(NULL), refcount(1)
     , gestureHandler(0), regenPending(-1), appendPending(-1), redrawPending(-1)
-    , changeCount(0), drawCount(0), stopping(0)
+    , changeCount(0), drawCount(0), batchLevel(0), batchDoc(NULL), stopping(0)
 {
     memset(&gsBuf, 0, sizeof(gsBuf));
     memset((void*)&gsUsed, 0, sizeof(gsUsed));
@@ -68,6 +68,7 @@ GiCoreViewImpl::~GiCoreViewImpl()
         delete gsBuf[i];
     }
     MgObject::release_pointer(_cmds);
+    MgObject::release_pointer(batchDoc);
     delete _gcdoc;
 }
 
@@ -20,6 +20,7 @@
 #include "mgcomposite.h"
 #include "mglog.h"
 #include <map>
+#include <vector>
 
 #define CALL_VIEW(func) if (curview) curview->func
 #define CALL_VIEW2(func, v) curview ? curview->func : v
@@ -83,6 +84,10 @@ public:
     volatile long   changeCount;
     volatile long   drawCount;
     
+    int             batchLevel;     // 批量增删改图形的嵌套层数
+    MgShapeDoc*     batchDoc;       // 正在批量修改的文档
+    std::vector<int> batchIds[3];   // 批量中新增、修改和删除的图形ID
+    
     std::map<int, MgShape* (*)()>   _shapeCreators;
     
     typedef enum { kOptBool, kOptInt, kOptFloat, kOptStr } OPT_TYPE;
@@ -161,7 +166,12 @@ public:
     bool shapeWillChanged(MgShape* shape, const MgShape* oldsp) {
         return getCmdSubject()->onShapeWillChanged(motion(), shape, oldsp); }
     void shapeChanged(MgShape* shape) {
-        getCmdSubject()->onShapeChanged(motion(), shape); }
+        if (batchLevel > 0) {
+            batchIds[1].push_back(shape->getID());  // 结束批量时汇总通知
+        } else {
+            getCmdSubject()->onShapeChanged(motion(), shape);
+        }
+    }
     bool shapeDblClick(const MgShape* shape) {
         return CALL_VIEW2(deviceView()->shapeDblClick(shape->shapec()->getType(), shape->getID(),
                                                       shape->getTag()), false);
@@ -203,7 +213,11 @@ public:
             && shape->getParent()->findShape(shape->getID()) == shape
             && !shape->shapec()->getFlag(kMgNoDel)) {
             int sid = shape->getID();
-            ret = getCmdSubject()->onShapeDeleted(motion(), shape);
+            if (batchLevel > 0) {
+                batchIds[2].push_back(sid);
+            } else {
+                ret = getCmdSubject()->onShapeDeleted(motion(), shape);
+            }
             ret += shape->getParent()->removeShape(shape->getID()) ? 1 : 0;
             CALL_VIEW(deviceView()->shapeDeleted(sid));
         }
@@ -239,8 +253,40 @@ public:
     }
     
     void shapeAdded(MgShape* sp) {
-        getCmdSubject()->onShapeAdded(motion(), sp);
-        regenAppend(sp->getID());
+        if (batchLevel > 0) {
+            batchIds[0].push_back(sp->getID());     // 结束批量时汇总通知，再由调用者 regenAll
+        } else {
+            getCmdSubject()->onShapeAdded(motion(), sp);
+            regenAppend(sp->getID());
+        }
+    }
+    
+    void beginShapesBatch() {
+        if (batchLevel++ == 0) {
+            batchDoc = doc();
+            batchDoc->addRef();
+            batchDoc->beginBatch();
+        }
+    }
+    
+    int endShapesBatch() {
+        if (batchLevel <= 0 || --batchLevel > 0) {
+            return 0;
+        }
+        batchDoc->endBatch();
+        MgObject::release_pointer(batchDoc);
+        
+        std::vector<int> ids(batchIds[0]);
+        ids.insert(ids.end(), batchIds[1].begin(), batchIds[1].end());
+        ids.insert(ids.end(), batchIds[2].begin(), batchIds[2].end());
+        if (!ids.empty()) {
+            getCmdSubject()->onShapesBatchChanged(motion(), (int)batchIds[0].size(),
+                (int)batchIds[1].size(), (int)batchIds[2].size(), &ids.front());
+        }
+        for (int i = 0; i < 3; i++) {
+            batchIds[i].clear();
+        }
+        return (int)ids.size();
     }
     
     void redraw(bool changed = true) {